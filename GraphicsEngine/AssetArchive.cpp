@@ -0,0 +1,384 @@
+#pragma once
+#include "AssetArchive.h"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Shaders are loaded on worker threads, so the instance is a function local static, which C++ creates exactly once
+AssetArchive* AssetArchive::getInstance()
+{
+	static AssetArchive* archive = new AssetArchive();
+
+	return archive;
+}
+
+AssetArchive::AssetArchive()
+{
+}
+
+AssetArchive::~AssetArchive()
+{
+	close();
+}
+
+// Archive keys use forward slashes and no leading "./", so lookups don't depend on how a path was spelled
+std::string AssetArchive::normalizePath(const std::string& filePath)
+{
+	auto path = filePath;
+	std::replace(path.begin(), path.end(), '\\', '/');
+
+	while (path.compare(0, 2, "./") == 0)
+	{
+		path = path.substr(2);
+	}
+
+	return path;
+}
+
+// Packs assetPaths into an archive at filePath. Assets are stored under their normalized paths, which is how they are
+// asked for at runtime
+bool AssetArchive::write(const std::string& filePath, const std::vector<std::string>& assetPaths)
+{
+	std::vector<std::string> paths;
+	std::vector<std::vector<char>> contents;
+	unsigned int indexSize = 0;
+
+	for (const auto& assetPath : assetPaths)
+	{
+		std::ifstream asset(assetPath, std::ios::in | std::ios::binary | std::ios::ate);
+
+		if (!asset.is_open())
+		{
+			std::cout << "COULD NOT READ ASSET " << assetPath << std::endl;
+			return false;
+		}
+
+		std::vector<char> content((size_t)asset.tellg());
+		asset.seekg(0);
+
+		if (!content.empty() && !asset.read(&content[0], content.size()))
+		{
+			std::cout << "COULD NOT READ ASSET " << assetPath << std::endl;
+			return false;
+		}
+
+		paths.push_back(normalizePath(assetPath));
+		contents.push_back(std::move(content));
+		indexSize += sizeof(IndexEntry) + (unsigned int)paths.back().size();
+	}
+
+	std::ofstream output(filePath, std::ios::out | std::ios::binary | std::ios::trunc);
+
+	if (!output.is_open())
+	{
+		std::cout << "COULD NOT WRITE ASSET ARCHIVE " << filePath << std::endl;
+		return false;
+	}
+
+	auto align = [](unsigned long long offset) { return (offset + ASSET_ALIGNMENT - 1) / ASSET_ALIGNMENT * ASSET_ALIGNMENT; };
+
+	ArchiveHeader header = { ARCHIVE_MAGIC, ARCHIVE_VERSION, (unsigned int)paths.size(), indexSize };
+	output.write((const char*)&header, sizeof(header));
+
+	unsigned long long offset = align(sizeof(header) + indexSize);
+
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		IndexEntry entry = { offset, contents[i].size(), (unsigned int)paths[i].size() };
+		output.write((const char*)&entry, sizeof(entry));
+		output.write(paths[i].data(), paths[i].size());
+
+		offset = align(offset + contents[i].size());
+	}
+
+	const char padding[ASSET_ALIGNMENT] = {};
+
+	for (const auto& content : contents)
+	{
+		output.write(padding, align(output.tellp()) - (unsigned long long)output.tellp());
+		output.write(content.data(), content.size());
+	}
+
+	std::cout << "WROTE " << paths.size() << " ASSETS TO " << filePath << std::endl;
+
+	return output.good();
+}
+
+bool AssetArchive::map(const std::string& filePath)
+{
+#ifdef _WIN32
+	fileHandle = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		fileHandle = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(fileHandle, &fileSize);
+	mappingSize = (size_t)fileSize.QuadPart;
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	if (mappingHandle != nullptr)
+	{
+		mapping = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	fileDescriptor = ::open(filePath.c_str(), O_RDONLY);
+
+	if (fileDescriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat status;
+
+	if (fstat(fileDescriptor, &status) == 0 && status.st_size > 0)
+	{
+		mappingSize = (size_t)status.st_size;
+		void* address = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		mapping = address == MAP_FAILED ? nullptr : (const char*)address;
+	}
+#endif
+
+	if (mapping == nullptr)
+	{
+		unmap();
+		return false;
+	}
+
+	return true;
+}
+
+void AssetArchive::unmap(void)
+{
+#ifdef _WIN32
+	if (mapping != nullptr)
+	{
+		UnmapViewOfFile(mapping);
+	}
+
+	if (mappingHandle != nullptr)
+	{
+		CloseHandle(mappingHandle);
+		mappingHandle = nullptr;
+	}
+
+	if (fileHandle != nullptr)
+	{
+		CloseHandle(fileHandle);
+		fileHandle = nullptr;
+	}
+#else
+	if (mapping != nullptr)
+	{
+		munmap((void*)mapping, mappingSize);
+	}
+
+	if (fileDescriptor >= 0)
+	{
+		::close(fileDescriptor);
+		fileDescriptor = -1;
+	}
+#endif
+
+	mapping = nullptr;
+	mappingSize = 0;
+}
+
+bool AssetArchive::readIndex(void)
+{
+	ArchiveHeader header;
+
+	if (mappingSize < sizeof(header))
+	{
+		return false;
+	}
+
+	std::copy(mapping, mapping + sizeof(header), (char*)&header);
+
+	if (header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION || sizeof(header) + header.indexSize > mappingSize)
+	{
+		return false;
+	}
+
+	auto cursor = mapping + sizeof(header);
+	auto indexEnd = cursor + header.indexSize;
+
+	for (unsigned int i = 0; i < header.entryCount; i++)
+	{
+		IndexEntry entry;
+
+		if (cursor + sizeof(entry) > indexEnd)
+		{
+			return false;
+		}
+
+		std::copy(cursor, cursor + sizeof(entry), (char*)&entry);
+		cursor += sizeof(entry);
+
+		if (cursor + entry.pathLength > indexEnd || entry.offset + entry.size > mappingSize)
+		{
+			return false;
+		}
+
+		entries[std::string(cursor, entry.pathLength)] = { entry.offset, entry.size };
+		cursor += entry.pathLength;
+	}
+
+	return true;
+}
+
+// Asks the OS to read the whole archive ahead in order, which on network mounts turns many small page faults into
+// one streaming read
+void AssetArchive::prefetch(void)
+{
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range = { (void*)mapping, mappingSize };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	madvise((void*)mapping, mappingSize, MADV_SEQUENTIAL);
+	madvise((void*)mapping, mappingSize, MADV_WILLNEED);
+#endif
+}
+
+bool AssetArchive::open(const std::string& filePath)
+{
+	close();
+
+	auto begin = std::chrono::steady_clock::now();
+
+	if (!map(filePath))
+	{
+		std::cout << "COULD NOT OPEN ASSET ARCHIVE " << filePath << std::endl;
+		return false;
+	}
+
+	if (!readIndex())
+	{
+		std::cout << "ASSET ARCHIVE " << filePath << " IS CORRUPT OR FROM ANOTHER VERSION" << std::endl;
+		close();
+		return false;
+	}
+
+	prefetch();
+	archivePath = filePath;
+
+	auto milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+	std::cout << "OPENED ASSET ARCHIVE " << filePath << " (" << entries.size() << " ASSETS, " << mappingSize
+			  << " BYTES) IN " << milliseconds << " MS" << std::endl;
+
+	return true;
+}
+
+void AssetArchive::close(void)
+{
+	unmap();
+	entries.clear();
+	archivePath.clear();
+}
+
+bool AssetArchive::isOpen(void)
+{
+	return mapping != nullptr;
+}
+
+bool AssetArchive::contains(const std::string& filePath)
+{
+	return entries.find(normalizePath(filePath)) != entries.end();
+}
+
+AssetView AssetArchive::getLooseFile(const std::string& filePath)
+{
+	AssetView view;
+	std::ifstream asset(getLooseFilePath(filePath), std::ios::in | std::ios::binary | std::ios::ate);
+
+	if (!asset.is_open())
+	{
+		return view;
+	}
+
+	auto content = std::make_shared<std::vector<char>>((size_t)asset.tellg());
+	asset.seekg(0);
+
+	if (!content->empty() && !asset.read(&(*content)[0], content->size()))
+	{
+		return view;
+	}
+
+	// Empty files still get a valid, empty view
+	view.data = content->empty() ? "" : content->data();
+	view.size = content->size();
+	view.owner = content;
+
+	return view;
+}
+
+// Returns an invalid view if the asset is neither in the archive nor on disk
+AssetView AssetArchive::get(const std::string& filePath)
+{
+	return get(filePath, looseFilesFirst);
+}
+
+// Overrides the loose files first setting for one read. Hot reloading prefers loose files, since those are what was edited
+AssetView AssetArchive::get(const std::string& filePath, bool preferLooseFile)
+{
+	if (preferLooseFile)
+	{
+		auto view = getLooseFile(filePath);
+
+		if (view.valid())
+		{
+			return view;
+		}
+	}
+
+	auto found = entries.find(normalizePath(filePath));
+
+	if (found != entries.end())
+	{
+		AssetView view;
+		view.data = mapping + found->second.offset;
+		view.size = (size_t)found->second.size;
+
+		return view;
+	}
+
+	return preferLooseFile ? AssetView() : getLooseFile(filePath);
+}
+
+// The path on disk a loose file is read from, which is what file watchers need to look at
+std::string AssetArchive::getLooseFilePath(const std::string& filePath)
+{
+	return directory + filePath;
+}
+
+// Loose files are looked up relative to this directory, which is empty (the working directory) by default
+void AssetArchive::setDirectory(const std::string& directory)
+{
+	this->directory = directory.empty() || directory.back() == '/' || directory.back() == '\\' ? directory : directory + "/";
+}
+
+// Makes files on disk override the archive, for editing and hot reloading assets that have already been packed
+void AssetArchive::setLooseFilesFirst(bool looseFilesFirst)
+{
+	this->looseFilesFirst = looseFilesFirst;
+}
+
+size_t AssetArchive::getAssetCount(void)
+{
+	return entries.size();
+}
\ No newline at end of file
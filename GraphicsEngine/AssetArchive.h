@@ -0,0 +1,83 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+// Read-only view of an asset. Archive assets point straight into the mapping and own nothing; loose files read from
+// disk are held by owner, so a view stays valid for as long as it is kept around
+struct AssetView
+{
+	const char* data = nullptr;
+	size_t size = 0;
+	std::shared_ptr<const std::vector<char>> owner;
+	bool valid(void) const { return data != nullptr; }
+	std::string toString(void) const { return std::string(data, size); }
+};
+
+// Single indexed file holding shaders, mesh caches and textures, mapped into memory once and read in place. The header
+// and index come first and every asset is 16 byte aligned, so opening the archive is one sequential read and binary
+// assets can be used directly. Paths the archive doesn't hold fall back to loose files, which is what development and
+// hot reloading work from
+class AssetArchive
+{
+private:
+	static const unsigned int ARCHIVE_MAGIC = 0x41414753; // "SGAA"
+	static const unsigned int ARCHIVE_VERSION = 1;
+	static const unsigned int ASSET_ALIGNMENT = 16;
+
+	struct ArchiveHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned int entryCount;
+		unsigned int indexSize;
+	};
+
+	struct IndexEntry
+	{
+		unsigned long long offset;
+		unsigned long long size;
+		unsigned int pathLength;
+	};
+
+	struct Entry
+	{
+		unsigned long long offset;
+		unsigned long long size;
+	};
+
+	const char* mapping = nullptr;
+	size_t mappingSize = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+	std::string archivePath;
+	std::string directory;
+	bool looseFilesFirst = false;
+	std::unordered_map<std::string, Entry> entries;
+	AssetArchive();
+	~AssetArchive();
+	bool map(const std::string& filePath);
+	void unmap(void);
+	bool readIndex(void);
+	void prefetch(void);
+	AssetView getLooseFile(const std::string& filePath);
+	static std::string normalizePath(const std::string& filePath);
+public:
+	static AssetArchive* getInstance();
+	static bool write(const std::string& filePath, const std::vector<std::string>& assetPaths);
+	bool open(const std::string& filePath);
+	void close(void);
+	bool isOpen(void);
+	bool contains(const std::string& filePath);
+	AssetView get(const std::string& filePath);
+	AssetView get(const std::string& filePath, bool preferLooseFile);
+	std::string getLooseFilePath(const std::string& filePath);
+	void setDirectory(const std::string& directory);
+	void setLooseFilesFirst(bool looseFilesFirst);
+	size_t getAssetCount(void);
+};
\ No newline at end of file
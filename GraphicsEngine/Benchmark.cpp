@@ -0,0 +1,487 @@
+#pragma once
+#include "Benchmark.h"
+#include "HeadlessWindowContext.h"
+#include "ShaderProgramPipeline.h"
+#include "GeometricalMeshObjects.h"
+#include "Camera.h"
+#include "Pass.h"
+#include "FrameGraph.h"
+#include "Profiler.h"
+#include "GLDispatch.h"
+#include "DynamicResolution.h"
+#include "LightClusters.h"
+#include <gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+// Nearest rank on an ascending list
+double Benchmark::getPercentile(const std::vector<double>& sorted, double percentile)
+{
+	if (sorted.empty())
+	{
+		return 0.0;
+	}
+
+	auto rank = (size_t)std::ceil(percentile / 100.0 * sorted.size());
+
+	return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+bool Benchmark::buildPipelines(const Configuration& configuration)
+{
+	for (const auto& pipelineDescription : configuration.pipelines)
+	{
+		auto programs = ShaderProgram::compileBatch(pipelineDescription.second);
+
+		if (std::find(programs.begin(), programs.end(), nullptr) != programs.end())
+		{
+			std::cout << "BENCHMARK PIPELINE " << pipelineDescription.first << " FAILED TO BUILD" << std::endl;
+			return false;
+		}
+
+		auto pipeline = ShaderProgramPipeline::getPipeline(pipelineDescription.first);
+
+		if (pipeline == nullptr)
+		{
+			return false;
+		}
+
+		if (pipeline->attachedPrograms.empty())
+		{
+			for (auto program : programs)
+			{
+				program->attachToPipeline(pipeline);
+			}
+		}
+	}
+
+	return true;
+}
+
+void Benchmark::summarize(Results& results)
+{
+	auto sorted = results.frameMilliseconds;
+	std::sort(sorted.begin(), sorted.end());
+
+	if (sorted.empty())
+	{
+		return;
+	}
+
+	double total = 0.0;
+
+	for (auto milliseconds : sorted)
+	{
+		total += milliseconds;
+	}
+
+	results.meanMilliseconds = total / sorted.size();
+	results.minMilliseconds = sorted.front();
+	results.maxMilliseconds = sorted.back();
+	results.p50Milliseconds = getPercentile(sorted, 50.0);
+	results.p90Milliseconds = getPercentile(sorted, 90.0);
+	results.p95Milliseconds = getPercentile(sorted, 95.0);
+	results.p99Milliseconds = getPercentile(sorted, 99.0);
+}
+
+// The offscreen context is created on the first run and kept, since compiled programs and pipelines outlive a run
+bool Benchmark::run(const Configuration& configuration, Results& results)
+{
+	if (WindowContext::context == nullptr)
+	{
+		auto headlessContext = new HeadlessWindowContext(configuration.width, configuration.height);
+
+		if (!headlessContext->isValid())
+		{
+			delete headlessContext;
+			return false;
+		}
+	}
+
+	results = Results();
+
+	// glGetString returns null when there is no current context or the query fails
+	auto renderer = glGetString(GL_RENDERER);
+	auto version = glGetString(GL_VERSION);
+	results.renderer = renderer != nullptr ? (const char*)renderer : "unknown";
+	results.version = version != nullptr ? (const char*)version : "unknown";
+
+	auto setupBegin = std::chrono::steady_clock::now();
+
+	if (!buildPipelines(configuration))
+	{
+		return false;
+	}
+
+	std::unordered_map<std::string, ShaderProgramPipeline*> gPrograms;
+	std::unordered_map<std::string, ShaderProgramPipeline*> lPrograms;
+
+	gPrograms[configuration.meshPipeline] = ShaderProgramPipeline::getPipeline(configuration.meshPipeline);
+	lPrograms[configuration.lightPipeline] = ShaderProgramPipeline::getPipeline(configuration.lightPipeline);
+
+	if (configuration.instancedObjectCount > 0)
+	{
+		gPrograms[configuration.instancedPipeline] = ShaderProgramPipeline::getPipeline(configuration.instancedPipeline);
+	}
+
+	auto size = WindowContext::context->getSize();
+	SphericalCamera camera(glm::vec2(0, 0), glm::vec2(1, 1), glm::vec3(0, 0, 0), glm::vec3(0, 0, 1), UP,
+						   glm::perspective(45.0f, (float)size.first / size.second, 0.1f, 1000.0f));
+	camera.setViewport(size.first, size.second);
+
+	auto layout = configuration.compactGBuffer ? GeometryPass::COMPACT_GBUFFER : GeometryPass::FULL_GBUFFER;
+	GeometryPass* geometryPass = new GeometryPass(gPrograms, "GEOMETRYPASS", nullptr, 1, 0, false, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT,
+												  layout);
+	geometryPass->setupCamera(&camera);
+
+	for (const auto& pipeline : gPrograms)
+	{
+		pipeline.second->setDepthPrePass(configuration.depthPrePass);
+	}
+
+	LightPass* lightPass = new LightPass(lPrograms, true);
+	lightPass->setupCamera(&camera);
+	geometryPass->addNeighbor(lightPass);
+
+	// Objects are scattered through a cube around the camera that grows with the object count, so density stays
+	// comparable across sizes
+	std::mt19937 random(configuration.seed);
+	float extent = 4.0f * std::cbrt((float)std::max(configuration.polyhedronCount + configuration.instancedObjectCount *
+																	configuration.instancesPerObject, 1));
+	std::uniform_real_distribution<float> position(-extent, extent);
+	std::uniform_real_distribution<float> radius(0.5f, 1.5f);
+
+	std::vector<Graphics::DecoratedGraphicsObject*> sceneObjects;
+	std::vector<Graphics::MatrixInstancedMeshObject<glm::mat4, float>*> instancedObjects;
+
+	for (int i = 0; i < configuration.polyhedronCount; i++)
+	{
+		auto polyhedron = new Graphics::Polyhedron(configuration.polyhedronResolution,
+												   glm::vec3(position(random), position(random), position(random)), glm::vec3(radius(random)));
+
+		geometryPass->addRenderableObjects(polyhedron, "POLYHEDRON" + std::to_string(i), configuration.meshPipeline);
+		sceneObjects.push_back(polyhedron);
+		results.sceneTriangles += polyhedron->indices.size() / 3;
+	}
+
+	for (int i = 0; i < configuration.instancedObjectCount; i++)
+	{
+		std::vector<glm::mat4> transforms(configuration.instancesPerObject);
+
+		for (auto& transform : transforms)
+		{
+			transform = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(position(random), position(random), position(random))),
+								   glm::vec3(radius(random)));
+		}
+
+		auto polyhedron = new Graphics::Polyhedron(configuration.polyhedronResolution, glm::vec3(), glm::vec3(1.0f));
+		auto instanced = new Graphics::MatrixInstancedMeshObject<glm::mat4, float>(polyhedron, transforms, "INSTANCEMATRIX");
+
+		geometryPass->addRenderableObjects(instanced, "INSTANCED" + std::to_string(i), configuration.instancedPipeline);
+		sceneObjects.push_back(polyhedron);
+		sceneObjects.push_back(instanced);
+		instancedObjects.push_back(instanced);
+		results.sceneTriangles += polyhedron->indices.size() / 3 * transforms.size();
+		results.sceneInstances += transforms.size();
+	}
+
+	for (size_t i = 0; i < configuration.meshPaths.size(); i++)
+	{
+		auto mesh = new Graphics::ImportedMeshObject(configuration.meshPaths[i].c_str());
+
+		geometryPass->addRenderableObjects(mesh, "MESH" + std::to_string(i), configuration.meshPipeline);
+		sceneObjects.push_back(mesh);
+		results.sceneTriangles += mesh->indices.size() / 3;
+	}
+
+	results.sceneObjects = configuration.polyhedronCount + configuration.instancedObjectCount + configuration.meshPaths.size();
+
+	// Lights reach a few percent of the scene each, so a pixel sees a small fraction of them
+	LightList lights;
+	LightClusters lightClusters(&lights);
+	std::uniform_real_distribution<float> lightRadius(extent * 0.02f, extent * 0.08f);
+	std::uniform_real_distribution<float> lightColor(0.2f, 1.0f);
+
+	for (int i = 0; i < configuration.lightCount; i++)
+	{
+		lights.add(Light(glm::vec3(position(random), position(random), position(random)), lightRadius(random),
+						 glm::vec3(lightColor(random), lightColor(random), lightColor(random))));
+	}
+
+	if (configuration.lightCount > 0)
+	{
+		lightClusters.useCompute = configuration.computeLightClusters;
+		lightPass->setLightClusters(&lightClusters);
+	}
+
+	ShaderProgramPipeline::warmUp();
+	glFinish();
+
+	results.setupMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setupBegin).count();
+
+	// Every instance turns a little around the scene's vertical axis each frame
+	auto step = glm::rotate(glm::mat4(1.0f), 0.002f, glm::vec3(0, 1, 0));
+	double drawCalls = 0.0;
+	double uploadedBytes = 0.0;
+	double resolutionScale = 0.0;
+	double lightsPerCluster = 0.0;
+	double lightAssignment = 0.0;
+	auto dynamicResolution = DynamicResolution::getInstance();
+	dynamicResolution->setEnabled(configuration.targetFrameMilliseconds > 0.0);
+	dynamicResolution->setTargetFrameTime(configuration.targetFrameMilliseconds);
+	dynamicResolution->setScale(1.0f);
+
+	{
+		FrameGraph frameGraph(geometryPass);
+
+		for (int frame = 0; frame < configuration.warmupFrames + configuration.measuredFrames; frame++)
+		{
+			auto begin = std::chrono::steady_clock::now();
+			Profiler::getInstance()->resetCounters();
+
+			camera.camTheta += 0.01;
+			camera.update();
+
+			if (configuration.animateInstances)
+			{
+				for (auto instanced : instancedObjects)
+				{
+					for (auto& transform : instanced->extendedData)
+					{
+						transform = step * transform;
+					}
+
+					instanced->dirty = true;
+					instanced->updateIfDirty();
+				}
+			}
+
+			frameGraph.execute();
+
+			// Frame time includes the GPU, since nothing is presented that would otherwise bound it
+			glFinish();
+
+			if (frame < configuration.warmupFrames)
+			{
+				geometryPass->resetDepthPrePassStatistics();
+				continue;
+			}
+
+			results.frameMilliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+			drawCalls += Profiler::getInstance()->getCounter(Profiler::DRAW_CALLS);
+			uploadedBytes += Profiler::getInstance()->getCounter(Profiler::UPLOADED_BYTES);
+			resolutionScale += dynamicResolution->getScale();
+
+			auto& clusterStatistics = lightClusters.getStatistics();
+
+			if (clusterStatistics.clusters > 0)
+			{
+				lightsPerCluster += (double)clusterStatistics.lightIndices / clusterStatistics.clusters;
+				lightAssignment += clusterStatistics.assignmentMilliseconds;
+				results.maxClusterLights = std::max(results.maxClusterLights, clusterStatistics.maxClusterLights);
+			}
+		}
+
+		results.renderTargets = frameGraph.getRenderTargetStatistics();
+	}
+
+	dynamicResolution->setEnabled(false);
+	dynamicResolution->setScale(1.0f);
+
+	if (configuration.measuredFrames > 0)
+	{
+		results.drawCallsPerFrame = drawCalls / configuration.measuredFrames;
+		results.uploadedBytesPerFrame = uploadedBytes / configuration.measuredFrames;
+		results.meanResolutionScale = resolutionScale / configuration.measuredFrames;
+		results.lightsPerCluster = lightsPerCluster / configuration.measuredFrames;
+		results.lightAssignmentMilliseconds = lightAssignment / configuration.measuredFrames;
+	}
+
+	auto& depthPrePass = geometryPass->getDepthPrePassStatistics();
+
+	if (depthPrePass.frames > 0)
+	{
+		results.depthSamplesPerFrame = (double)depthPrePass.depthSamples / depthPrePass.frames;
+		results.shadedSamplesPerFrame = (double)depthPrePass.shadedSamples / depthPrePass.frames;
+	}
+
+	for (const auto& pipeline : gPrograms)
+	{
+		pipeline.second->setDepthPrePass(false);
+	}
+
+	summarize(results);
+
+	for (auto object = sceneObjects.rbegin(); object != sceneObjects.rend(); object++)
+	{
+		delete *object;
+	}
+
+	delete lightPass;
+	delete geometryPass;
+
+	return true;
+}
+
+void Benchmark::writeJSON(const Configuration& configuration, const Results& results, std::ostream& stream)
+{
+	stream << "{" << std::endl;
+	stream << "\t\"renderer\": \"";
+	Profiler::writeEscaped(stream, results.renderer.c_str());
+	stream << "\"," << std::endl;
+	stream << "\t\"version\": \"";
+	Profiler::writeEscaped(stream, results.version.c_str());
+	stream << "\"," << std::endl;
+	stream << "\t\"configuration\": { \"width\": " << configuration.width << ", \"height\": " << configuration.height <<
+		", \"polyhedra\": " << configuration.polyhedronCount << ", \"resolution\": " << configuration.polyhedronResolution <<
+		", \"instancedObjects\": " << configuration.instancedObjectCount << ", \"instancesPerObject\": " <<
+		configuration.instancesPerObject << ", \"meshes\": " << configuration.meshPaths.size() << ", \"seed\": " <<
+		configuration.seed << ", \"animateInstances\": " << (configuration.animateInstances ? "true" : "false") << ", \"compactGBuffer\": " <<
+		(configuration.compactGBuffer ? "true" : "false") << ", \"depthPrePass\": " << (configuration.depthPrePass ? "true" : "false") <<
+		", \"lights\": " << configuration.lightCount << ", \"computeLightClusters\": " <<
+		(configuration.computeLightClusters ? "true" : "false") << " }," << std::endl;
+	stream << "\t\"scene\": { \"objects\": " << results.sceneObjects << ", \"instances\": " << results.sceneInstances <<
+		", \"triangles\": " << results.sceneTriangles << " }," << std::endl;
+	stream << "\t\"setupMilliseconds\": " << results.setupMilliseconds << "," << std::endl;
+	stream << "\t\"frames\": " << results.frameMilliseconds.size() << "," << std::endl;
+	stream << "\t\"frameMilliseconds\": { \"mean\": " << results.meanMilliseconds << ", \"min\": " << results.minMilliseconds <<
+		", \"p50\": " << results.p50Milliseconds << ", \"p90\": " << results.p90Milliseconds << ", \"p95\": " <<
+		results.p95Milliseconds << ", \"p99\": " << results.p99Milliseconds << ", \"max\": " << results.maxMilliseconds << " }," << std::endl;
+	stream << "\t\"drawCallsPerFrame\": " << results.drawCallsPerFrame << "," << std::endl;
+	stream << "\t\"uploadedBytesPerFrame\": " << results.uploadedBytesPerFrame << "," << std::endl;
+	stream << "\t\"targetFrameMilliseconds\": " << configuration.targetFrameMilliseconds << "," << std::endl;
+	stream << "\t\"meanResolutionScale\": " << results.meanResolutionScale << "," << std::endl;
+	stream << "\t\"depthPrePassSamplesPerFrame\": { \"depth\": " << results.depthSamplesPerFrame << ", \"shaded\": " <<
+		results.shadedSamplesPerFrame << " }," << std::endl;
+	stream << "\t\"lightClusters\": { \"lightsPerCluster\": " << results.lightsPerCluster << ", \"maxClusterLights\": " <<
+		results.maxClusterLights << ", \"assignmentMilliseconds\": " << results.lightAssignmentMilliseconds << " }," << std::endl;
+	stream << "\t\"renderTargets\": { \"requested\": " << results.renderTargets.requestedTargets << ", \"allocated\": " <<
+		results.renderTargets.allocatedTargets << ", \"requestedBytes\": " << results.renderTargets.requestedBytes << ", \"allocatedBytes\": " <<
+		results.renderTargets.allocatedBytes << " }" << std::endl;
+	stream << "}" << std::endl;
+}
+
+// --name=value options. --pipeline=SIGNATURE:first.vert,second.frag may be repeated, the stage coming from the file
+// extension (.vert/.vs, .frag/.fs, .geom/.gs)
+bool Benchmark::parseArguments(int argc, char** argv, Configuration& configuration)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		auto equals = argument.find('=');
+		auto name = argument.substr(0, equals);
+		auto value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+		if (name == "--width") configuration.width = std::stoi(value);
+		else if (name == "--height") configuration.height = std::stoi(value);
+		else if (name == "--polyhedra") configuration.polyhedronCount = std::stoi(value);
+		else if (name == "--resolution") configuration.polyhedronResolution = std::stoi(value);
+		else if (name == "--instanced-objects") configuration.instancedObjectCount = std::stoi(value);
+		else if (name == "--instances") configuration.instancesPerObject = std::stoi(value);
+		else if (name == "--mesh") configuration.meshPaths.push_back(value);
+		else if (name == "--warmup") configuration.warmupFrames = std::stoi(value);
+		else if (name == "--frames") configuration.measuredFrames = std::stoi(value);
+		else if (name == "--seed") configuration.seed = (unsigned int)std::stoul(value);
+		else if (name == "--static") configuration.animateInstances = false;
+		else if (name == "--compact-gbuffer") configuration.compactGBuffer = true;
+		else if (name == "--depth-pre-pass") configuration.depthPrePass = true;
+		else if (name == "--lights") configuration.lightCount = std::stoi(value);
+		else if (name == "--compute-light-clusters") configuration.computeLightClusters = true;
+		else if (name == "--target-frame-time") configuration.targetFrameMilliseconds = std::stod(value);
+		else if (name == "--mesh-pipeline") configuration.meshPipeline = value;
+		else if (name == "--instanced-pipeline") configuration.instancedPipeline = value;
+		else if (name == "--light-pipeline") configuration.lightPipeline = value;
+		else if (name == "--output") configuration.outputPath = value;
+		else if (name == "--pipeline")
+		{
+			auto colon = value.find(':');
+
+			if (colon == std::string::npos)
+			{
+				std::cout << "EXPECTED --pipeline=SIGNATURE:FILE,FILE..." << std::endl;
+				return false;
+			}
+
+			std::vector<ShaderProgram::ProgramDescription> descriptions;
+			auto signature = value.substr(0, colon);
+			auto files = value.substr(colon + 1);
+
+			for (size_t start = 0; start <= files.size();)
+			{
+				auto comma = std::min(files.find(',', start), files.size());
+				auto file = files.substr(start, comma - start);
+				auto extension = file.substr(std::min(file.find_last_of('.') + 1, file.size()));
+				start = comma + 1;
+
+				GLenum shader = extension == "vert" || extension == "vs" ? GL_VERTEX_SHADER :
+								extension == "frag" || extension == "fs" ? GL_FRAGMENT_SHADER :
+								extension == "geom" || extension == "gs" ? GL_GEOMETRY_SHADER : GL_NONE;
+
+				if (shader == GL_NONE)
+				{
+					std::cout << "CAN'T TELL THE SHADER STAGE OF " << file << std::endl;
+					return false;
+				}
+
+				ShaderProgram::ProgramDescription description;
+				description.filePath = file;
+				description.signature = signature + "_" + extension;
+				description.shader = shader;
+				descriptions.push_back(description);
+			}
+
+			configuration.pipelines.push_back(std::make_pair(signature, descriptions));
+		}
+		else
+		{
+			std::cout << "UNKNOWN BENCHMARK OPTION " << argument << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Entry point for a benchmark executable. Writes the JSON report to --output (benchmark.json by default), keeping it apart
+// from the engine's logs on stdout
+int Benchmark::main(int argc, char** argv)
+{
+	Configuration configuration;
+
+	if (!parseArguments(argc, argv, configuration))
+	{
+		return 2;
+	}
+
+	Results results;
+
+	if (!run(configuration, results))
+	{
+		std::cout << "BENCHMARK FAILED" << std::endl;
+		return 1;
+	}
+
+	std::ofstream output(configuration.outputPath, std::ios::out | std::ios::trunc);
+
+	if (!output.is_open())
+	{
+		std::cout << "COULDN'T OPEN " << configuration.outputPath << " FOR WRITING" << std::endl;
+		return 1;
+	}
+
+	writeJSON(configuration, results, output);
+
+	if (!output)
+	{
+		std::cout << "COULDN'T WRITE " << configuration.outputPath << std::endl;
+		return 1;
+	}
+
+	std::cout << "BENCHMARK RESULTS WRITTEN TO " << configuration.outputPath << std::endl;
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include "ShaderProgram.h"
+#include "RenderTargetPool.h"
+
+// Runs the real GeometryPass -> LightPass frame graph over a generated stress scene in an offscreen context and reports
+// frame time percentiles, draw calls and uploaded bytes as JSON. Scenes are built from Polyhedrons, matrix instanced
+// Polyhedrons and imported meshes, sized by the configuration and placed from a fixed seed so runs are comparable.
+// The engine ships no shaders, so the configuration names the programs each pipeline is built from
+class Benchmark
+{
+public:
+	struct Configuration
+	{
+		int width = 1280;
+		int height = 720;
+		int polyhedronCount = 1000;
+		int polyhedronResolution = 16;
+		int instancedObjectCount = 10;
+		int instancesPerObject = 10000;
+		std::vector<std::string> meshPaths;
+		int warmupFrames = 30;
+		int measuredFrames = 300;
+		unsigned int seed = 1;
+		// Rewrites every instance transform each frame, which measures the upload path as well as drawing
+		bool animateInstances = true;
+		// Renders into GeometryPass' COMPACT_GBUFFER layout; the light pipeline then has to decode it
+		bool compactGBuffer = false;
+		// Lays down depth for the mesh and instanced pipelines before shading them
+		bool depthPrePass = false;
+		// Point lights scattered through the scene and culled into clusters for the light pipeline; 0 leaves them out
+		int lightCount = 0;
+		// Builds the cluster lists with the compute shader rather than on the CPU
+		bool computeLightClusters = false;
+		// GPU milliseconds per frame the dynamic resolution aims for; 0 renders at full resolution
+		double targetFrameMilliseconds = 0.0;
+		std::string meshPipeline = "GEOMETRY";
+		std::string instancedPipeline = "INSTANCED";
+		std::string lightPipeline = "LIGHT";
+		std::vector<std::pair<std::string, std::vector<ShaderProgram::ProgramDescription>>> pipelines;
+		// The report only goes here, since the engine logs to stdout
+		std::string outputPath = "benchmark.json";
+	};
+
+	struct Results
+	{
+		std::vector<double> frameMilliseconds;
+		double setupMilliseconds = 0.0;
+		double meanMilliseconds = 0.0;
+		double minMilliseconds = 0.0;
+		double maxMilliseconds = 0.0;
+		double p50Milliseconds = 0.0;
+		double p90Milliseconds = 0.0;
+		double p95Milliseconds = 0.0;
+		double p99Milliseconds = 0.0;
+		double drawCallsPerFrame = 0.0;
+		double uploadedBytesPerFrame = 0.0;
+		double meanResolutionScale = 1.0;
+		// Samples passing the depth pre-pass, which shading would have cost without it, against those actually shaded
+		double depthSamplesPerFrame = 0.0;
+		double shadedSamplesPerFrame = 0.0;
+		// Mean over the clusters, and the most any single cluster held
+		double lightsPerCluster = 0.0;
+		unsigned int maxClusterLights = 0;
+		double lightAssignmentMilliseconds = 0.0;
+		RenderTargetPool::Statistics renderTargets;
+		unsigned long long sceneObjects = 0;
+		unsigned long long sceneInstances = 0;
+		unsigned long long sceneTriangles = 0;
+		std::string renderer;
+		std::string version;
+	};
+private:
+	static double getPercentile(const std::vector<double>& sorted, double percentile);
+	static bool buildPipelines(const Configuration& configuration);
+	static void summarize(Results& results);
+public:
+	static bool run(const Configuration& configuration, Results& results);
+	static void writeJSON(const Configuration& configuration, const Results& results, std::ostream& stream);
+	static bool parseArguments(int argc, char** argv, Configuration& configuration);
+	static int main(int argc, char** argv);
+};
\ No newline at end of file
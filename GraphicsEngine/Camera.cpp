@@ -1,6 +1,7 @@
 #pragma once
 #include "Camera.h"
 #include "WindowContext.h"
+#include "DynamicResolution.h"
 #include <gtc/matrix_transform.hpp>
 
 Camera* Camera::activeCamera = NULL;
@@ -27,10 +28,10 @@ void Camera::setViewport(int width, int height)
 	screenWidth = width;
 	screenHeight = height;
 
-	glViewport(relativePosition.x * screenWidth,
-			   screenHeight - (relativePosition.y + relativeDimensions.y) * screenHeight,
-			   screenWidth * relativeDimensions.x,
-			   screenHeight * relativeDimensions.y);
+	DynamicResolution::getInstance()->setOutputViewport(relativePosition.x * screenWidth,
+														screenHeight - (relativePosition.y + relativeDimensions.y) * screenHeight,
+														screenWidth * relativeDimensions.x,
+														screenHeight * relativeDimensions.y);
 
 	Projection = glm::perspective(45.0f, (float)width / height, 0.1f, 1000.0f);
 };
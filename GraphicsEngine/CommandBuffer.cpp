@@ -0,0 +1,272 @@
+#pragma once
+#include "CommandBuffer.h"
+#include "GraphicsObject.h"
+#include "Profiler.h"
+
+void CommandBuffer::clear(void)
+{
+	stream.clear();
+	callbacks.clear();
+	commandCount = 0;
+}
+
+bool CommandBuffer::empty(void) const
+{
+	return commandCount == 0;
+}
+
+size_t CommandBuffer::size(void) const
+{
+	return commandCount;
+}
+
+size_t CommandBuffer::byteSize(void) const
+{
+	return stream.size();
+}
+
+void CommandBuffer::writeUniformHeader(Opcode opcode, GLuint program, GLint location)
+{
+	write(opcode);
+	write(program);
+	write(location);
+	commandCount++;
+}
+
+void CommandBuffer::setPipelineState(const PipelineState& state)
+{
+	write(SET_PIPELINE_STATE);
+	write(state.depthTest);
+	write(state.blend);
+	write(state.cullFace);
+	write(state.polygonFace);
+	write(state.polygonMode);
+	write(state.blendSource);
+	write(state.blendDestination);
+	write(state.depthFunction);
+	write(state.depthWrite);
+	write(state.colorWrite);
+	commandCount++;
+}
+
+void CommandBuffer::bindPipeline(GLuint pipeline)
+{
+	write(BIND_PIPELINE);
+	write(pipeline);
+	commandCount++;
+}
+
+void CommandBuffer::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	write(BIND_TEXTURE);
+	write(unit);
+	write(target);
+	write(texture);
+	commandCount++;
+}
+
+// Uniforms at location -1 are ignored by GL anyway, so they are dropped at record time
+void CommandBuffer::uniform1i(GLuint program, GLint location, GLint value)
+{
+	if (location < 0)
+	{
+		return;
+	}
+
+	writeUniformHeader(UNIFORM_1I, program, location);
+	write(value);
+}
+
+void CommandBuffer::uniform1ui(GLuint program, GLint location, GLuint value)
+{
+	if (location < 0)
+	{
+		return;
+	}
+
+	writeUniformHeader(UNIFORM_1UI, program, location);
+	write(value);
+}
+
+void CommandBuffer::uniform1f(GLuint program, GLint location, GLfloat value)
+{
+	if (location < 0)
+	{
+		return;
+	}
+
+	writeUniformHeader(UNIFORM_1F, program, location);
+	write(value);
+}
+
+void CommandBuffer::uniform2iv(GLuint program, GLint location, const GLint* value)
+{
+	if (location < 0)
+	{
+		return;
+	}
+
+	writeUniformHeader(UNIFORM_2IV, program, location);
+	write(value[0]);
+	write(value[1]);
+}
+
+void CommandBuffer::uniform4fv(GLuint program, GLint location, const GLfloat* value)
+{
+	if (location < 0)
+	{
+		return;
+	}
+
+	writeUniformHeader(UNIFORM_4FV, program, location);
+	size_t offset = stream.size();
+	stream.resize(offset + 4 * sizeof(GLfloat));
+	memcpy(&stream[offset], value, 4 * sizeof(GLfloat));
+}
+
+void CommandBuffer::uniformMatrix4fv(GLuint program, GLint location, const GLfloat* value)
+{
+	if (location < 0)
+	{
+		return;
+	}
+
+	writeUniformHeader(UNIFORM_MATRIX4FV, program, location);
+	size_t offset = stream.size();
+	stream.resize(offset + 16 * sizeof(GLfloat));
+	memcpy(&stream[offset], value, 16 * sizeof(GLfloat));
+}
+
+void CommandBuffer::drawObject(Graphics::DecoratedGraphicsObject* object)
+{
+	write(DRAW_OBJECT);
+	write(object);
+	commandCount++;
+}
+
+// Replays commands at this point of the buffer, so parts of a pass can be recorded on their own (and on other threads)
+// and still run in order. commands is only read at replay, so it may be recorded after this call, but must outlive it
+void CommandBuffer::executeCommands(const CommandBuffer* commands)
+{
+	write(EXECUTE_COMMANDS);
+	write(commands);
+	commandCount++;
+}
+
+// Escape hatch for GL work that has no dedicated opcode (frame buffer setup, per-pass GL configuration)
+void CommandBuffer::callback(std::function<void()> function)
+{
+	write(FUNCTOR);
+	write(callbacks.size());
+	callbacks.push_back(function);
+	commandCount++;
+}
+
+void CommandBuffer::replay(void) const
+{
+	size_t offset = 0;
+
+	while (offset < stream.size())
+	{
+		auto opcode = read<Opcode>(offset);
+
+		switch (opcode)
+		{
+		case SET_PIPELINE_STATE:
+		{
+			auto depthTest = read<bool>(offset);
+			auto blend = read<bool>(offset);
+			auto cullFace = read<bool>(offset);
+			auto polygonFace = read<GLenum>(offset);
+			auto polygonMode = read<GLenum>(offset);
+			auto blendSource = read<GLenum>(offset);
+			auto blendDestination = read<GLenum>(offset);
+			auto depthFunction = read<GLenum>(offset);
+			auto depthWrite = read<bool>(offset);
+			auto colorWrite = read<bool>(offset);
+			GLStateCache::getInstance()->apply(PipelineState(depthTest, blend, cullFace, polygonFace, polygonMode, blendSource, blendDestination,
+															 depthFunction, depthWrite, colorWrite));
+			break;
+		}
+		case BIND_PIPELINE:
+		{
+			GLStateCache::getInstance()->bindProgramPipeline(read<GLuint>(offset));
+			break;
+		}
+		case BIND_TEXTURE:
+		{
+			auto unit = read<GLuint>(offset);
+			auto target = read<GLenum>(offset);
+			auto texture = read<GLuint>(offset);
+			GLStateCache::getInstance()->bindTexture(unit, target, texture);
+			break;
+		}
+		case UNIFORM_1I:
+		{
+			auto program = read<GLuint>(offset);
+			auto location = read<GLint>(offset);
+			glProgramUniform1i(program, location, read<GLint>(offset));
+			break;
+		}
+		case UNIFORM_1UI:
+		{
+			auto program = read<GLuint>(offset);
+			auto location = read<GLint>(offset);
+			glProgramUniform1ui(program, location, read<GLuint>(offset));
+			break;
+		}
+		case UNIFORM_1F:
+		{
+			auto program = read<GLuint>(offset);
+			auto location = read<GLint>(offset);
+			glProgramUniform1f(program, location, read<GLfloat>(offset));
+			break;
+		}
+		case UNIFORM_2IV:
+		{
+			auto program = read<GLuint>(offset);
+			auto location = read<GLint>(offset);
+			auto x = read<GLint>(offset);
+			auto y = read<GLint>(offset);
+			glProgramUniform2i(program, location, x, y);
+			break;
+		}
+		case UNIFORM_4FV:
+		{
+			auto program = read<GLuint>(offset);
+			auto location = read<GLint>(offset);
+			glProgramUniform4fv(program, location, 1, (const GLfloat*)&stream[offset]);
+			offset += 4 * sizeof(GLfloat);
+			break;
+		}
+		case UNIFORM_MATRIX4FV:
+		{
+			auto program = read<GLuint>(offset);
+			auto location = read<GLint>(offset);
+			glProgramUniformMatrix4fv(program, location, 1, GL_FALSE, (const GLfloat*)&stream[offset]);
+			offset += 16 * sizeof(GLfloat);
+			break;
+		}
+		case DRAW_OBJECT:
+		{
+			auto object = read<Graphics::DecoratedGraphicsObject*>(offset);
+			object->enableBuffers();
+			object->draw();
+			Profiler::getInstance()->count(Profiler::DRAW_CALLS);
+			break;
+		}
+		case EXECUTE_COMMANDS:
+		{
+			read<const CommandBuffer*>(offset)->replay();
+			break;
+		}
+		case FUNCTOR:
+		{
+			callbacks[read<size_t>(offset)]();
+			break;
+		}
+		default:
+			return;
+		}
+	}
+}
\ No newline at end of file
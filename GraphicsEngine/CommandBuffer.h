@@ -0,0 +1,76 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include <cstring>
+#include <glew.h>
+#include "GLStateCache.h"
+
+namespace Graphics
+{
+	class DecoratedGraphicsObject;
+}
+
+// Compact, CPU-side list of GL work. Recording touches no GL state, so it can happen on any thread; replay issues the
+// recorded calls in order and must run on the thread that owns the context
+class CommandBuffer
+{
+public:
+	enum Opcode : unsigned char
+	{
+		SET_PIPELINE_STATE,
+		BIND_PIPELINE,
+		BIND_TEXTURE,
+		UNIFORM_1I,
+		UNIFORM_1UI,
+		UNIFORM_1F,
+		UNIFORM_2IV,
+		UNIFORM_4FV,
+		UNIFORM_MATRIX4FV,
+		DRAW_OBJECT,
+		EXECUTE_COMMANDS,
+		FUNCTOR
+	};
+private:
+	std::vector<unsigned char> stream;
+	std::vector<std::function<void()>> callbacks;
+	size_t commandCount = 0;
+	template<typename T> void write(const T& value);
+	template<typename T> T read(size_t& offset) const;
+	void writeUniformHeader(Opcode opcode, GLuint program, GLint location);
+public:
+	CommandBuffer() {};
+	~CommandBuffer() {};
+	void clear(void);
+	bool empty(void) const;
+	size_t size(void) const;
+	size_t byteSize(void) const;
+	void setPipelineState(const PipelineState& state);
+	void bindPipeline(GLuint pipeline);
+	void bindTexture(GLuint unit, GLenum target, GLuint texture);
+	void uniform1i(GLuint program, GLint location, GLint value);
+	void uniform1ui(GLuint program, GLint location, GLuint value);
+	void uniform1f(GLuint program, GLint location, GLfloat value);
+	void uniform2iv(GLuint program, GLint location, const GLint* value);
+	void uniform4fv(GLuint program, GLint location, const GLfloat* value);
+	void uniformMatrix4fv(GLuint program, GLint location, const GLfloat* value);
+	void drawObject(Graphics::DecoratedGraphicsObject* object);
+	void callback(std::function<void()> function);
+	void executeCommands(const CommandBuffer* commands);
+	void replay(void) const;
+};
+
+template<typename T> void CommandBuffer::write(const T& value)
+{
+	size_t offset = stream.size();
+	stream.resize(offset + sizeof(T));
+	memcpy(&stream[offset], &value, sizeof(T));
+}
+
+template<typename T> T CommandBuffer::read(size_t& offset) const
+{
+	T value;
+	memcpy(&value, &stream[offset], sizeof(T));
+	offset += sizeof(T);
+
+	return value;
+}
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "GeometricalMeshObjects.h"
 #include "ShaderProgramPipeline.h"
 #include "Pass.h"
+#include "FrameGraph.h"
 
 class AbstractContext
 {
@@ -49,6 +50,7 @@ protected:
 public:
 	bool dirty = true;
 	Pass* passRootNode = nullptr;
+	FrameGraph* frameGraph = nullptr;
 	std::map<std::string, Graphics::DecoratedGraphicsObject*> geometries;
 	GraphicsSceneContext() {};
 	~GraphicsSceneContext() {};
@@ -82,6 +84,8 @@ void GraphicsSceneContext<ControllerType, CameraType, ContextType>::setupPasses(
 
 	LightPass* lP = new LightPass(lPrograms, true);
 
+	ShaderProgramPipeline::warmUp();
+
 	gP->addNeighbor(lP);
 
 	passRootNode = gP;
@@ -98,14 +102,33 @@ void GraphicsSceneContext<ControllerType, CameraType, ContextType>::update(void)
 		}
 	}
 
+	if (ShaderProgram::processReloads())
+	{
+		dirty = true;
+	}
+
 	if (dirty)
 	{
 		if (passRootNode != nullptr)
 		{
-			passRootNode->execute();
+			if (frameGraph == nullptr || frameGraph->getRoot() != passRootNode)
+			{
+				delete frameGraph;
+				frameGraph = new FrameGraph(passRootNode);
+			}
+
+			frameGraph->execute();
 		}
 		dirty = false;
 	}
+
+	// Hover reads land a frame or two after they were requested, so they're collected every frame, cursor moving or not
+	auto geometryPass = dynamic_cast<GeometryPass*>(passRootNode);
+
+	if (geometryPass != nullptr && geometryPass->pollPicking())
+	{
+		dirty = true;
+	}
 }
 
 template<class ControllerType, class CameraType, class ContextType>
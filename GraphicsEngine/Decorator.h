@@ -2,12 +2,29 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <unordered_map>
+#include <memory>
+#include <utility>
+#include "SignatureRegistry.h"
+
+// One index per chain, created by the base object and shared by every link stacked on top of it.
+// Each signature maps to its deepest occurrence and that link's depth
+template <class T> struct DecoratorSignatureIndex
+{
+	std::unordered_map<SignatureID, std::pair<T*, int>> entries;
+	T* top = nullptr;
+};
 
 template <class T> class Decorator
 {
+protected:
+	std::shared_ptr<DecoratorSignatureIndex<T>> signatureIndex;
+	// Number of links below this one
+	int depth = 0;
 public:
 	T* child = nullptr;
 	std::string signature;
+	SignatureID signatureID = SignatureRegistry::INVALID;
 
 	Decorator();
 	Decorator(T* child, const std::string& signature);
@@ -17,7 +34,10 @@ public:
 	virtual T* clone();
 	// TODO: Recursive Lookup of signature through children
 	virtual T* signatureLookup(const std::string& signature);
-	virtual std::vector<T*>* signatureLookup(std::vector<std::string>& signatures);
+	virtual T* signatureLookup(SignatureID signatureID);
+	virtual std::vector<T*> signatureLookup(const std::vector<std::string>& signatures);
+	virtual void setSignature(const std::string& signature);
+	virtual void rebuildSignatureIndex(void);
 	// TODO: Look for buffer with signature and call the function at occurrence
 	virtual bool signatureCallback(const std::string& signature/*, function callback*/);
 	virtual bool signatureCallback(const std::vector<std::string>& signatures/*, function callback*/);
@@ -34,14 +54,31 @@ public:
 
 template <class T> Decorator<T>::Decorator()
 {
+	rebuildSignatureIndex();
 }
 
 template <class T> Decorator<T>::Decorator(T* child, const std::string& signature) : child(child), signature(signature)
 {
+	signatureID = SignatureRegistry::getID(signature);
+	rebuildSignatureIndex();
 }
 
+// Chains are torn down from the top, so the index is handed back to the link below
 template <class T> Decorator<T>::~Decorator()
 {
+	if (signatureIndex->top != (T*)this)
+	{
+		return;
+	}
+
+	auto found = signatureIndex->entries.find(signatureID);
+
+	if (found != signatureIndex->entries.end() && found->second.first == (T*)this)
+	{
+		signatureIndex->entries.erase(found);
+	}
+
+	signatureIndex->top = child;
 }
 
 template <class T> T* Decorator<T>::clone()
@@ -51,6 +88,7 @@ template <class T> T* Decorator<T>::clone()
 	if (child != nullptr)
 	{
 		copy->child = child->clone();
+		copy->rebuildSignatureIndex();
 	}
 
 	return copy;
@@ -58,45 +96,91 @@ template <class T> T* Decorator<T>::clone()
 
 template <class T> T* Decorator<T>::signatureLookup(const std::string& signature)
 {
-	std::vector<std::string> signatures;
-	signatures.push_back(signature);
+	return signatureLookup(SignatureRegistry::findID(signature));
+}
 
-	std::vector<T*>* v = signatureLookup(signatures);
+template <class T> T* Decorator<T>::signatureLookup(SignatureID signatureID)
+{
+	auto found = signatureIndex->entries.find(signatureID);
 
-	if (v->size())
+	// An occurrence above this link means the signature isn't in the part of the chain seen from here
+	if (found != signatureIndex->entries.end() && found->second.second <= depth)
 	{
-		return v->at(0);
+		return found->second.first;
 	}
-	else
+
+	return nullptr;
+}
+
+template <class T> std::vector<T*> Decorator<T>::signatureLookup(const std::vector<std::string>& signatures)
+{
+	std::vector<T*> v;
+
+	for (const auto& s : signatures)
 	{
-		return nullptr;
+		auto found = signatureLookup(s);
+
+		if (found != nullptr)
+		{
+			v.push_back(found);
+		}
 	}
+
+	return v;
 }
 
-template <class T> std::vector<T*>* Decorator<T>::signatureLookup(std::vector<std::string>& signatures)
+template <class T> void Decorator<T>::setSignature(const std::string& signature)
 {
-	std::vector<T*>* v;
+	this->signature = signature;
+	signatureID = SignatureRegistry::getID(signature);
+
+	// Renaming can hide or reveal other occurrences, so the whole chain is reindexed from its top
+	auto& entries = signatureIndex->entries;
+	entries.clear();
+
+	for (T* current = signatureIndex->top; current != nullptr; current = current->child)
+	{
+		if (current->signatureID != SignatureRegistry::INVALID)
+		{
+			entries[current->signatureID] = std::make_pair(current, current->depth);
+		}
+	}
+}
 
+// Chains are built bottom-up, so a link stacked on the top of its child's chain just adds itself to the shared index.
+// A link stacked further down starts a branch, which gets its own copy of the entries below it
+template <class T> void Decorator<T>::rebuildSignatureIndex(void)
+{
 	if (child == nullptr)
 	{
-		v = new std::vector<T*>();
+		depth = 0;
+		signatureIndex = std::make_shared<DecoratorSignatureIndex<T>>();
 	}
-	else
+	else if (child->signatureIndex->top == child)
 	{
-		v = child->signatureLookup(signatures);
+		depth = child->depth + 1;
+		signatureIndex = child->signatureIndex;
 	}
-
-	for (int i = 0; i < signatures.size(); i++)
+	else
 	{
-		if (signatures[i] == signature)
+		depth = child->depth + 1;
+		signatureIndex = std::make_shared<DecoratorSignatureIndex<T>>();
+
+		for (const auto& entry : child->signatureIndex->entries)
 		{
-			signatures.erase(signatures.begin() + i);
-			v->push_back((T*)this);
-			break;
+			if (entry.second.second < depth)
+			{
+				signatureIndex->entries.insert(entry);
+			}
 		}
 	}
 
-	return v;
+	signatureIndex->top = (T*)this;
+
+	if (signatureID != SignatureRegistry::INVALID)
+	{
+		signatureIndex->entries.emplace(signatureID, std::make_pair((T*)this, depth));
+	}
 }
 
 template <class T> bool Decorator<T>::signatureCallback(const std::string& signature/*, function callback*/)
@@ -1,6 +1,9 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "SignatureRegistry.h"
 
 template<class T> class DirectedGraphNode
 {
@@ -27,8 +30,17 @@ protected:
 
 	std::vector<DirectedEdge*> neighborEdges;
 	std::vector<DirectedEdge*> parentEdges;
+	// Every node reachable from this one (itself included), in depth-first discovery order
+	std::unordered_map<SignatureID, T*> signatureIndex;
+
+	virtual void mergeSignatureIndex(const std::unordered_map<SignatureID, T*>& index);
+	void invalidateTopology(void);
 public:
+	// Bumped whenever this node or anything reachable from it changes, so a compiled view of the graph rooted here
+	// knows when to rebuild without being disturbed by edits to unrelated graphs
+	unsigned int topologyVersion = 0;
 	std::string signature;
+	SignatureID signatureID = SignatureRegistry::INVALID;
 	DirectedGraphNode();
 	DirectedGraphNode(std::vector<DirectedEdge*> neighbors, std::string signature);
 	DirectedGraphNode(std::string signature);
@@ -39,6 +51,7 @@ public:
 	virtual T* clone();
 	// TODO: Recursive Lookup of signature through children
 	virtual T* signatureLookup(std::string signature);
+	virtual T* signatureLookup(SignatureID signatureID);
 	virtual std::vector<T*>* signatureLookup(std::vector<std::string>& signatures);
 	// TODO: Look for buffer with signature and call the function at occurrence
 	virtual bool signatureCallback(std::string signature/*, function callback*/);
@@ -54,12 +67,16 @@ template<class T> DirectedGraphNode<T>::DirectedGraphNode()
 }
 
 template<class T> DirectedGraphNode<T>::DirectedGraphNode(std::vector<DirectedEdge*> neighbors, std::string signature) :
-	neighbors(neighbors), signature(signature)
+	signature(signature), signatureID(SignatureRegistry::getID(signature))
 {
+	signatureIndex.emplace(signatureID, (T*)this);
+	addNeighbors(neighbors);
 }
 
-template<class T> DirectedGraphNode<T>::DirectedGraphNode(std::string signature) : signature(signature)
+template<class T> DirectedGraphNode<T>::DirectedGraphNode(std::string signature) :
+	signature(signature), signatureID(SignatureRegistry::getID(signature))
 {
+	signatureIndex.emplace(signatureID, (T*)this);
 }
 
 template<class T> DirectedGraphNode<T>::~DirectedGraphNode()
@@ -76,29 +93,80 @@ template<class T> void DirectedGraphNode<T>::addNeighbor(T* neighbor, DirectedEd
 
 	neighborEdges.push_back(edge);
 	neighbor->parentEdges.push_back(edge);
+	invalidateTopology();
+
+	mergeSignatureIndex(neighbor->signatureIndex);
 }
 
-template <class T> T* DirectedGraphNode<T>::clone()
+template<class T> void DirectedGraphNode<T>::addNeighbors(std::vector<DirectedEdge*> neighbors)
 {
-	return nullptr;
+	for (const auto& edge : neighbors)
+	{
+		addNeighbor(edge->data->destination, edge);
+	}
 }
 
-template <class T> T* DirectedGraphNode<T>::signatureLookup(std::string signature)
+// Topology changes are rare compared to lookups, so the new reachable set is pushed up to every ancestor here
+template<class T> void DirectedGraphNode<T>::mergeSignatureIndex(const std::unordered_map<SignatureID, T*>& index)
 {
-	if (signature == this->signature)
+	size_t previousSize = signatureIndex.size();
+
+	for (const auto& entry : index)
 	{
-		return (T*)this;
+		signatureIndex.emplace(entry.first, entry.second);
 	}
 
-	for (const auto& neighbor : neighborEdges)
+	if (signatureIndex.size() == previousSize)
+	{
+		return;
+	}
+
+	for (const auto& parent : parentEdges)
+	{
+		parent->data->source->mergeSignatureIndex(signatureIndex);
+	}
+}
+
+// Each ancestor is bumped once, however many paths lead up to it
+template<class T> void DirectedGraphNode<T>::invalidateTopology(void)
+{
+	std::vector<DirectedGraphNode<T>*> pending = { this };
+	std::unordered_set<DirectedGraphNode<T>*> visited = { this };
+
+	while (!pending.empty())
 	{
-		auto output = neighbor->data->destination->signatureLookup(signature);
+		auto node = pending.back();
+		pending.pop_back();
+		node->topologyVersion++;
 
-		if (output != nullptr)
+		for (const auto& parent : node->parentEdges)
 		{
-			return output;
+			if (visited.insert(parent->data->source).second)
+			{
+				pending.push_back(parent->data->source);
+			}
 		}
 	}
+}
+
+template <class T> T* DirectedGraphNode<T>::clone()
+{
+	return nullptr;
+}
+
+template <class T> T* DirectedGraphNode<T>::signatureLookup(std::string signature)
+{
+	return signatureLookup(SignatureRegistry::findID(signature));
+}
+
+template <class T> T* DirectedGraphNode<T>::signatureLookup(SignatureID signatureID)
+{
+	auto found = signatureIndex.find(signatureID);
+
+	if (found != signatureIndex.end())
+	{
+		return found->second;
+	}
 
 	return nullptr;
 }
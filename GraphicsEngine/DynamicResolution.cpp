@@ -0,0 +1,249 @@
+#pragma once
+#include "DynamicResolution.h"
+#include "GLStateCache.h"
+#include <algorithm>
+#include <cmath>
+
+DynamicResolution* DynamicResolution::dynamicResolution = nullptr;
+
+DynamicResolution* DynamicResolution::getInstance()
+{
+	if (dynamicResolution == nullptr)
+	{
+		dynamicResolution = new DynamicResolution();
+	}
+
+	return dynamicResolution;
+}
+
+DynamicResolution::DynamicResolution() : resolutionScale(1.0f)
+{
+	outputViewport[0] = outputViewport[1] = outputViewport[2] = outputViewport[3] = 0;
+}
+
+DynamicResolution::~DynamicResolution()
+{
+	if (queriesCreated)
+	{
+		for (auto& frameQuery : frameQueries)
+		{
+			glDeleteQueries(2, frameQuery.queries);
+		}
+	}
+}
+
+void DynamicResolution::setEnabled(bool enabled)
+{
+	this->enabled = enabled;
+	measured = false;
+}
+
+bool DynamicResolution::isEnabled(void)
+{
+	return enabled;
+}
+
+void DynamicResolution::setTargetFrameTime(double milliseconds)
+{
+	targetMilliseconds = std::max(milliseconds, 0.1);
+}
+
+double DynamicResolution::getTargetFrameTime(void)
+{
+	return targetMilliseconds;
+}
+
+void DynamicResolution::setScaleRange(float minimum, float maximum)
+{
+	minimumScale = std::min(std::max(minimum, 0.1f), 1.0f);
+	maximumScale = std::min(std::max(maximum, minimumScale), 1.0f);
+	setScale(scale);
+}
+
+void DynamicResolution::setScale(float scale)
+{
+	this->scale = std::min(std::max(scale, minimumScale), maximumScale);
+	measured = false;
+	updateResolutionScale();
+}
+
+float DynamicResolution::getScale(void)
+{
+	return scale;
+}
+
+double DynamicResolution::getAverageFrameTime(void)
+{
+	return measured ? averageMilliseconds : 0.0;
+}
+
+double DynamicResolution::getLastFrameTime(void)
+{
+	return lastMilliseconds;
+}
+
+void DynamicResolution::beginFrame(void)
+{
+	if (!enabled)
+	{
+		return;
+	}
+
+	if (!queriesCreated)
+	{
+		for (auto& frameQuery : frameQueries)
+		{
+			glGenQueries(2, frameQuery.queries);
+			frameQuery.pending = false;
+		}
+
+		queriesCreated = true;
+	}
+
+	collectFrameQueries();
+
+	// Frames whose results are still in flight after a whole ring's worth of frames just go unmeasured
+	auto& frameQuery = frameQueries[nextFrameQuery];
+
+	if (frameQuery.pending)
+	{
+		openFrameQuery = -1;
+		return;
+	}
+
+	glQueryCounter(frameQuery.queries[0], GL_TIMESTAMP);
+	frameQuery.scale = scale;
+	openFrameQuery = nextFrameQuery;
+	nextFrameQuery = (nextFrameQuery + 1) % QUERY_RING_SIZE;
+}
+
+void DynamicResolution::endFrame(void)
+{
+	if (!enabled)
+	{
+		return;
+	}
+
+	if (openFrameQuery >= 0)
+	{
+		glQueryCounter(frameQueries[openFrameQuery].queries[1], GL_TIMESTAMP);
+		frameQueries[openFrameQuery].pending = true;
+		openFrameQuery = -1;
+	}
+
+	collectFrameQueries();
+	updateScale();
+}
+
+// Oldest first, stopping at the first frame the GPU hasn't finished, since no later one can have
+void DynamicResolution::collectFrameQueries(void)
+{
+	for (int i = 0; i < QUERY_RING_SIZE; i++)
+	{
+		auto& frameQuery = frameQueries[(nextFrameQuery + i) % QUERY_RING_SIZE];
+
+		if (!frameQuery.pending)
+		{
+			continue;
+		}
+
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(frameQuery.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (available != GL_TRUE)
+		{
+			return;
+		}
+
+		GLuint64 begin = 0;
+		GLuint64 end = 0;
+		glGetQueryObjectui64v(frameQuery.queries[0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frameQuery.queries[1], GL_QUERY_RESULT, &end);
+		frameQuery.pending = false;
+
+		// Frames rendered before the last scale change say nothing about the current one
+		if (frameQuery.scale != scale)
+		{
+			continue;
+		}
+
+		lastMilliseconds = (end - begin) * 1e-6;
+		averageMilliseconds = measured ? averageMilliseconds + (lastMilliseconds - averageMilliseconds) * 0.2 : lastMilliseconds;
+		measured = true;
+	}
+}
+
+// GPU time of the scaled passes goes with their pixel count, the square of the scale. Going down takes the whole step
+// the measurement asks for, going up only a small one at a time, so a single fast frame doesn't set off oscillation
+void DynamicResolution::updateScale(void)
+{
+	if (!measured || averageMilliseconds <= 0.0)
+	{
+		return;
+	}
+
+	double step = std::sqrt(targetMilliseconds / averageMilliseconds);
+	float next = scale;
+
+	if (averageMilliseconds > targetMilliseconds * 1.05)
+	{
+		next = scale * (float)std::max(step, 0.75);
+	}
+	else if (averageMilliseconds < targetMilliseconds * 0.85)
+	{
+		next = scale * (float)std::min(step, 1.02);
+	}
+
+	next = std::min(std::max(next, minimumScale), maximumScale);
+
+	// Changes of less than a pixel in a hundred aren't worth restarting the measurement for, unless they reach the range
+	if (next != scale && (std::abs(next - scale) >= 0.01f || next == minimumScale || next == maximumScale))
+	{
+		setScale(next);
+	}
+}
+
+void DynamicResolution::updateResolutionScale(void)
+{
+	if (outputViewport[2] <= 0 || outputViewport[3] <= 0)
+	{
+		resolutionScale = glm::vec4(1.0f);
+		return;
+	}
+
+	GLsizei width = std::max(1, (int)std::lround(outputViewport[2] * scale));
+	GLsizei height = std::max(1, (int)std::lround(outputViewport[3] * scale));
+	float scaleX = (float)width / outputViewport[2];
+	float scaleY = (float)height / outputViewport[3];
+
+	resolutionScale = glm::vec4(scaleX, scaleY, scaleX - 0.5f / outputViewport[2], scaleY - 0.5f / outputViewport[3]);
+}
+
+// Replaces the camera's glViewport, so scaled passes can derive their rectangle from it
+void DynamicResolution::setOutputViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	outputViewport[0] = x;
+	outputViewport[1] = y;
+	outputViewport[2] = width;
+	outputViewport[3] = height;
+
+	updateResolutionScale();
+	GLStateCache::getInstance()->viewport(x, y, width, height);
+}
+
+glm::vec2 DynamicResolution::applyViewport(bool scaled)
+{
+	auto stateCache = GLStateCache::getInstance();
+
+	if (!scaled || scale == 1.0f)
+	{
+		stateCache->viewport(outputViewport[0], outputViewport[1], outputViewport[2], outputViewport[3]);
+		return glm::vec2(1.0f);
+	}
+
+	GLsizei width = std::max(1, (int)std::lround(outputViewport[2] * scale));
+	GLsizei height = std::max(1, (int)std::lround(outputViewport[3] * scale));
+	stateCache->viewport((GLint)std::lround(outputViewport[0] * scale), (GLint)std::lround(outputViewport[1] * scale), width, height);
+
+	return glm::vec2(resolutionScale);
+}
\ No newline at end of file
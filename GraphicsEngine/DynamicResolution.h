@@ -0,0 +1,65 @@
+#pragma once
+#include <glew.h>
+#include "glm.hpp"
+
+// Renders the scaled passes (the G-buffer and intermediate passes) into the lower left part of their targets, so the
+// resolution can change every frame without reallocating anything, and the passes reading them scale their texture
+// coordinates by resolutionScale to sample only that part. The scale follows the GPU time of the frame, measured with
+// timestamp queries read back a few frames later: it drops as soon as frames run over the target and creeps back up
+// while there is headroom. Disabled by default, in which case the scale only changes through setScale
+class DynamicResolution
+{
+public:
+	static const int QUERY_RING_SIZE = 4;
+private:
+	struct FrameQuery
+	{
+		GLuint queries[2];
+		float scale;
+		bool pending;
+	};
+
+	static DynamicResolution* dynamicResolution;
+	bool enabled = false;
+	double targetMilliseconds = 1000.0 / 60.0;
+	double averageMilliseconds = 0.0;
+	double lastMilliseconds = 0.0;
+	bool measured = false;
+	float minimumScale = 0.5f;
+	float maximumScale = 1.0f;
+	float scale = 1.0f;
+	FrameQuery frameQueries[QUERY_RING_SIZE];
+	bool queriesCreated = false;
+	int nextFrameQuery = 0;
+	int openFrameQuery = -1;
+	GLint outputViewport[4];
+	DynamicResolution();
+	~DynamicResolution();
+	void collectFrameQueries(void);
+	void updateScale(void);
+	void updateResolutionScale(void);
+public:
+	// xy scale full resolution texture coordinates onto the rendered part, zw clamp them to its last texel centres so
+	// bilinear upsampling never reads what lies outside of it
+	glm::vec4 resolutionScale;
+
+	static DynamicResolution* getInstance();
+	void setEnabled(bool enabled);
+	bool isEnabled(void);
+	// GPU milliseconds a frame should take
+	void setTargetFrameTime(double milliseconds);
+	double getTargetFrameTime(void);
+	void setScaleRange(float minimum, float maximum);
+	void setScale(float scale);
+	float getScale(void);
+	// Smoothed GPU time of recent frames, 0 until the first one has been read back
+	double getAverageFrameTime(void);
+	double getLastFrameTime(void);
+	// Bracket a frame's GPU work on the GL thread. The scale only changes in endFrame, so a frame never mixes two
+	void beginFrame(void);
+	void endFrame(void);
+	// Full resolution rectangle the camera renders to
+	void setOutputViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	// Sets the viewport for a pass, scaled or not, and returns the fraction of the output it covers in each axis
+	glm::vec2 applyViewport(bool scaled);
+};
\ No newline at end of file
@@ -0,0 +1,326 @@
+#pragma once
+#include "EngineMicrobenchmarks.h"
+#include "GLDispatch.h"
+#include "GeometricalMeshObjects.h"
+#include "ReferencedGraphicsObject.h"
+#include "Pass.h"
+#include <random>
+
+namespace
+{
+	typedef Microbenchmark::State State;
+
+	// Round robin over a handful of objects, so no two consecutive GUIDs of an object coalesce and every assignment
+	// becomes a range of its own, the worst case for the tables
+	const int GUID_OWNER_COUNT = 64;
+
+	std::vector<Graphics::DecoratedGraphicsObject*> makeGUIDOwners(void)
+	{
+		std::vector<Graphics::DecoratedGraphicsObject*> owners;
+
+		for (int i = 0; i < GUID_OWNER_COUNT; i++)
+		{
+			owners.push_back(new Graphics::Triangle());
+		}
+
+		return owners;
+	}
+
+	void deleteAll(std::vector<Graphics::DecoratedGraphicsObject*>& objects)
+	{
+		for (auto object = objects.rbegin(); object != objects.rend(); object++)
+		{
+			delete *object;
+		}
+
+		objects.clear();
+	}
+
+	void assignNewGUID(State& state)
+	{
+		auto owners = makeGUIDOwners();
+		auto count = (int)state.range();
+
+		while (state.keepRunning())
+		{
+			state.pauseTiming();
+			auto manager = new Graphics::ReferenceManager();
+			state.resumeTiming();
+
+			for (int i = 0; i < count; i++)
+			{
+				Microbenchmark::doNotOptimize(manager->assignNewGUID(owners[i % GUID_OWNER_COUNT], i / GUID_OWNER_COUNT));
+			}
+
+			state.pauseTiming();
+			delete manager;
+			state.resumeTiming();
+		}
+
+		state.setItemsProcessed(state.getIterations() * count);
+		deleteAll(owners);
+	}
+
+	void getInstance(State& state)
+	{
+		auto owners = makeGUIDOwners();
+		auto count = (int)state.range();
+		Graphics::ReferenceManager manager;
+
+		for (int i = 0; i < count; i++)
+		{
+			manager.assignNewGUID(owners[i % GUID_OWNER_COUNT], i / GUID_OWNER_COUNT);
+		}
+
+		std::mt19937 random(1);
+		std::uniform_int_distribution<int> guid(1, count);
+		std::vector<int> guids(4096);
+
+		for (auto& g : guids)
+		{
+			g = guid(random);
+		}
+
+		while (state.keepRunning())
+		{
+			for (auto g : guids)
+			{
+				Microbenchmark::doNotOptimize(manager.getInstance(g));
+			}
+		}
+
+		state.setItemsProcessed(state.getIterations() * guids.size());
+		state.setLabel(std::to_string(manager.getRangeCount()) + " ranges");
+		deleteAll(owners);
+	}
+
+	// Chains of the given depth over a Triangle, looking up the link nearest the mesh
+	std::vector<Graphics::DecoratedGraphicsObject*> makeChain(int depth)
+	{
+		std::vector<Graphics::DecoratedGraphicsObject*> chain{ new Graphics::Triangle() };
+
+		for (int i = 0; i < depth; i++)
+		{
+			chain.push_back(new Graphics::ExtendedMeshObject<GLfloat, GLfloat>(chain.back(), "LINK" + std::to_string(i)));
+		}
+
+		return chain;
+	}
+
+	// GUIDs 31 to 31 + count are selected, so every word has its top bit set, which is where enumeration once ran past
+	// the word. There is no test target, so the result is verified here, once and before timing starts
+	bool selectionEnumeratesInOrder(const Graphics::SelectionManager& selection, unsigned int count)
+	{
+		auto guids = selection.getSelectedGUIDs();
+
+		if (guids.size() != count + 1)
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < guids.size(); i++)
+		{
+			if (guids[i] != 31 + i)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void getSelectedGUIDs(State& state)
+	{
+		auto count = (unsigned int)state.range();
+		Graphics::SelectionManager selection;
+		selection.add(31);
+		selection.addRange(32, count);
+
+		if (!selectionEnumeratesInOrder(selection, count))
+		{
+			std::cout << "SELECTED GUIDS DON'T MATCH THE SELECTION" << std::endl;
+			state.setLabel("MISMATCH");
+		}
+
+		while (state.keepRunning())
+		{
+			Microbenchmark::doNotOptimize(selection.getSelectedGUIDs());
+		}
+
+		state.setItemsProcessed(state.getIterations() * selection.size());
+	}
+
+	void signatureLookupByString(State& state)
+	{
+		auto chain = makeChain((int)state.range());
+		std::string signature = "LINK0";
+
+		while (state.keepRunning())
+		{
+			Microbenchmark::doNotOptimize(chain.back()->signatureLookup(signature));
+		}
+
+		state.setItemsProcessed(state.getIterations());
+		deleteAll(chain);
+	}
+
+	void signatureLookupByID(State& state)
+	{
+		auto chain = makeChain((int)state.range());
+		auto signatureID = SignatureRegistry::getID("LINK0");
+
+		while (state.keepRunning())
+		{
+			Microbenchmark::doNotOptimize(chain.back()->signatureLookup(signatureID));
+		}
+
+		state.setItemsProcessed(state.getIterations());
+		deleteAll(chain);
+	}
+
+	// Fills the uniform tables the way reflection and setupCamera would, with no programs behind them
+	class UniformTraversalPass : public RenderPass
+	{
+	protected:
+		void initFrameBuffers(void) override {};
+	public:
+		UniformTraversalPass(int uniformCount, GLfloat* data) : RenderPass({}, "UNIFORMTRAVERSAL", nullptr)
+		{
+			const UniformType types[] = { MATRIX4FV, VECTOR4FV, FLOAT };
+
+			for (int i = 0; i < uniformCount; i++)
+			{
+				auto name = "uniform" + std::to_string(i);
+
+				uniformIDs["PROGRAM"].emplace(name, std::make_tuple(name, 1, i, types[i % 3], 1));
+				floatTypeUniformPointers["PROGRAM"][name] = std::make_tuple(name, data);
+			}
+		}
+	};
+
+	void setUniforms(State& state)
+	{
+		auto count = (int)state.range();
+		glm::mat4 data(1.0f);
+		UniformTraversalPass pass(count, &data[0][0]);
+		CommandBuffer commands;
+
+		while (state.keepRunning())
+		{
+			commands.clear();
+			pass.setUniforms(commands, "PROGRAM");
+		}
+
+		state.setItemsProcessed(state.getIterations() * count);
+	}
+
+	void bakeTransform(State& state)
+	{
+		Graphics::Polyhedron polyhedron((int)state.range(), glm::vec3(1.0f), glm::vec3(2.0f));
+
+		while (state.keepRunning())
+		{
+			polyhedron.bakeTransform();
+			Microbenchmark::clobberMemory();
+		}
+
+		state.setItemsProcessed(state.getIterations() * polyhedron.vertices.size());
+	}
+
+	void normalizeVertices(State& state)
+	{
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+		std::vector<Graphics::Vertex> source((size_t)state.range());
+
+		for (auto& vertex : source)
+		{
+			vertex = Graphics::Vertex(glm::vec3(coordinate(random), coordinate(random), coordinate(random)), glm::vec3(0, 0, 1));
+		}
+
+		auto vertices = source;
+
+		while (state.keepRunning())
+		{
+			// Normalizing the same vertices over and over would soon leave only denormals
+			state.pauseTiming();
+			vertices = source;
+			state.resumeTiming();
+
+			Graphics::ImportedMeshObject::normalizeVertices(vertices);
+			Microbenchmark::clobberMemory();
+		}
+
+		state.setItemsProcessed(state.getIterations() * source.size());
+	}
+
+	void constructPolyhedron(State& state)
+	{
+		size_t vertexCount = 0;
+
+		while (state.keepRunning())
+		{
+			auto polyhedron = new Graphics::Polyhedron((int)state.range(), glm::vec3(0.0f), glm::vec3(1.0f));
+
+			state.pauseTiming();
+			vertexCount = polyhedron->vertices.size();
+			delete polyhedron;
+			state.resumeTiming();
+		}
+
+		state.setItemsProcessed(state.getIterations() * vertexCount);
+	}
+
+	void constructCylinder(State& state)
+	{
+		size_t vertexCount = 0;
+
+		while (state.keepRunning())
+		{
+			auto cylinder = new Graphics::Cylinder((int)state.range());
+
+			state.pauseTiming();
+			vertexCount = cylinder->vertices.size();
+			delete cylinder;
+			state.resumeTiming();
+		}
+
+		state.setItemsProcessed(state.getIterations() * vertexCount);
+	}
+}
+
+void EngineMicrobenchmarks::registerAll(void)
+{
+	Microbenchmark::registerBenchmark("ReferenceManager/assignNewGUID", assignNewGUID, { 1 << 10, 1 << 14, 1 << 17 });
+	Microbenchmark::registerBenchmark("ReferenceManager/getInstance", getInstance, { 1 << 10, 1 << 14, 1 << 17 });
+	Microbenchmark::registerBenchmark("SelectionManager/getSelectedGUIDs", getSelectedGUIDs, { 1 << 10, 1 << 16 });
+	Microbenchmark::registerBenchmark("Decorator/signatureLookup/string", signatureLookupByString, { 4, 16, 64 });
+	Microbenchmark::registerBenchmark("Decorator/signatureLookup/id", signatureLookupByID, { 4, 16, 64 });
+	Microbenchmark::registerBenchmark("RenderPass/setUniforms", setUniforms, { 8, 32, 128 });
+	Microbenchmark::registerBenchmark("MeshObject/bakeTransform", bakeTransform, { 32, 128, 512 });
+	Microbenchmark::registerBenchmark("ImportedMeshObject/normalizeVertices", normalizeVertices, { 1 << 12, 1 << 16, 1 << 20 });
+	Microbenchmark::registerBenchmark("Polyhedron/construct", constructPolyhedron, { 32, 128, 512 });
+	Microbenchmark::registerBenchmark("Cylinder/construct", constructCylinder, { 64, 1024, 16384 });
+}
+
+// Installs the null backend unless the caller already set GLDispatch up, so no context is needed
+int EngineMicrobenchmarks::main(int argc, char** argv)
+{
+	auto dispatch = GLDispatch::getInstance();
+	bool installed = !dispatch->isInstalled();
+
+	if (installed)
+	{
+		dispatch->install(GLDispatch::NULL_BACKEND);
+	}
+
+	registerAll();
+	auto result = Microbenchmark::main(argc, argv);
+
+	if (installed)
+	{
+		dispatch->uninstall();
+	}
+
+	return result;
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+#include "Microbenchmark.h"
+
+// CPU hot paths that run without a GL context: GUID bookkeeping, signature lookups on decorator chains, uniform map
+// traversal, transform baking, mesh normalization and the procedural meshes. GL calls go to the GLDispatch null
+// backend, so the objects involved can be built anywhere
+class EngineMicrobenchmarks
+{
+public:
+	static void registerAll(void);
+	// Entry point for a microbenchmark executable, taking Microbenchmark's options
+	static int main(int argc, char** argv);
+};
\ No newline at end of file
@@ -1,5 +1,9 @@
 #pragma once
 #include "FrameBuffer.h"
+#include "GLStateCache.h"
+#include <algorithm>
+
+std::unordered_map<GLuint, GLuint> DecoratedFrameBuffer::depthAttachments;
 
 DecoratedFrameBuffer::DecoratedFrameBuffer(int width, int height, std::string signature, GLenum type, glm::vec4 defaultColor,
 										   GLenum clearType) :
@@ -40,12 +44,21 @@ void DecoratedFrameBuffer::bindTexture()
 
 void DecoratedFrameBuffer::bindRBO()
 {
+	auto shared = depthAttachments.find(FBO);
+
+	if (shared != depthAttachments.end())
+	{
+		RBO = shared->second;
+		return;
+	}
+
 	glGenRenderbuffers(1, &RBO);
 	glBindRenderbuffer(GL_RENDERBUFFER, RBO);
 	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
 	glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, RBO);
+	depthAttachments[FBO] = RBO;
 }
 
 DecoratedFrameBuffer* DecoratedFrameBuffer::drawBuffers(std::vector<GLenum>& buff)
@@ -56,10 +69,18 @@ DecoratedFrameBuffer* DecoratedFrameBuffer::drawBuffers(std::vector<GLenum>& buf
 	do
 	{
 		int aNumber = currentBuffer->attachmentNumber;
+
+		// Transient buffers drawn outside of a FrameGraph never get a pooled texture, so give them a dedicated one
+		if (currentBuffer->transient && currentBuffer->texture == 0)
+		{
+			currentBuffer->attachTexture(RenderTargetPool::createTexture(currentBuffer->getDescription()));
+			currentBuffer->dedicatedTexture = currentBuffer->texture;
+		}
+
 //		std::cout << aNumber << " " << currentBuffer->FBO << std::endl;
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, currentBuffer->FBO);
 		glClearColor(currentBuffer->defaultColor.r, currentBuffer->defaultColor.g, currentBuffer->defaultColor.b, currentBuffer->defaultColor.a);
-		glClear(currentBuffer->clearType);
+		GLStateCache::getInstance()->clear(currentBuffer->clearType);
 		buff[aNumber] = GL_COLOR_ATTACHMENT0 + aNumber;
 		lastBuffer = currentBuffer;
 		currentBuffer = currentBuffer->child;
@@ -78,7 +99,7 @@ void DecoratedFrameBuffer::postDrawBuffers(std::vector<GLuint>& buff)
 	std::cout << std::endl;*/
 	glDrawBuffers(buff.size(), &(buff[0]));
 	glClearColor(defaultColor.r, defaultColor.g, defaultColor.b, defaultColor.a);
-	glClear(clearType);
+	GLStateCache::getInstance()->clear(clearType);
 }
 
 int DecoratedFrameBuffer::bindTexturesForPass(int textureOffset)
@@ -88,14 +109,33 @@ int DecoratedFrameBuffer::bindTexturesForPass(int textureOffset)
 	do
 	{
 //		std::cout << "\t\t" << index << " " << currentBuffer->signature << " " << currentBuffer->attachmentNumber << std::endl;
-		glActiveTexture(GL_TEXTURE0 + index++);
-		glBindTexture(currentBuffer->type, currentBuffer->texture);
+		GLStateCache::getInstance()->bindTexture(index++, currentBuffer->type, currentBuffer->texture);
 		currentBuffer = currentBuffer->child;
 	} while (currentBuffer != nullptr);
 
 	return index;
 }
 
+RenderTargetDescription DecoratedFrameBuffer::getDescription(void)
+{
+	return { width, height, GL_RGB, GL_RGB, GL_UNSIGNED_BYTE, GL_LINEAR };
+}
+
+void DecoratedFrameBuffer::attachTexture(GLuint texture)
+{
+	this->texture = texture;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + attachmentNumber, type, texture, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (dedicatedTexture != 0 && dedicatedTexture != texture)
+	{
+		GLStateCache::getInstance()->deleteTexture(dedicatedTexture);
+		dedicatedTexture = 0;
+	}
+}
+
 std::string DecoratedFrameBuffer::printOwnProperties(void)
 {
 	return std::to_string(attachmentNumber) + "\n";
@@ -116,7 +156,7 @@ DefaultFrameBuffer* DefaultFrameBuffer::getInstance()
 DefaultFrameBuffer::DefaultFrameBuffer()
 {
 	FBO = 0;
-	signature = "DEFAULT";
+	setSignature("DEFAULT");
 	defaultColor = glm::vec4(1.0f);
 	clearType = GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT;
 }
@@ -141,9 +181,11 @@ int DefaultFrameBuffer::bindTexturesForPass(int textureOffset)
 	return 0;
 }
 
-ImageFrameBuffer::ImageFrameBuffer(int width, int height, std::string signature, glm::vec4 defaultColor, GLenum clearType) :
+ImageFrameBuffer::ImageFrameBuffer(int width, int height, std::string signature, glm::vec4 defaultColor, GLenum clearType, bool transient) :
 	DecoratedFrameBuffer(width, height, signature, GL_TEXTURE_2D, defaultColor)
 {
+	this->transient = transient;
+
 	bindFBO();
 	bindTexture();
 	bindRBO();
@@ -152,8 +194,10 @@ ImageFrameBuffer::ImageFrameBuffer(int width, int height, std::string signature,
 }
 
 ImageFrameBuffer::ImageFrameBuffer(DecoratedFrameBuffer* child, int width, int height, std::string signature, glm::vec4 defaultColor,
-								   GLenum clearType) : DecoratedFrameBuffer(child, width, height, signature, GL_TEXTURE_2D, defaultColor)
+								   GLenum clearType, bool transient) : DecoratedFrameBuffer(child, width, height, signature, GL_TEXTURE_2D, defaultColor)
 {
+	this->transient = transient;
+
 	bindFBO();
 	bindTexture();
 	bindRBO();
@@ -162,9 +206,11 @@ ImageFrameBuffer::ImageFrameBuffer(DecoratedFrameBuffer* child, int width, int h
 }
 
 ImageFrameBuffer::ImageFrameBuffer(int attachmentNumber, GLuint FBO, int width, int height, std::string signature, glm::vec4 defaultColor,
-								   GLenum clearType) :
+								   GLenum clearType, bool transient) :
 	DecoratedFrameBuffer(attachmentNumber, FBO, width, height, signature, GL_TEXTURE_2D, defaultColor)
 {
+	this->transient = transient;
+
 	bindFBO();
 	bindTexture();
 	bindRBO();
@@ -174,17 +220,84 @@ ImageFrameBuffer::ImageFrameBuffer(int attachmentNumber, GLuint FBO, int width,
 
 void ImageFrameBuffer::bindTexture()
 {
-	glGenTextures(1, &texture);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(type, texture);
+	// Transient textures are assigned later, once the frame graph knows their lifetimes
+	if (transient)
+	{
+		return;
+	}
 
-	glTexImage2D(type, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(type, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(type, 0);
+	texture = RenderTargetPool::createTexture(getDescription());
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + attachmentNumber, type, texture, 0);
 }
 
+ImageFrameBuffer::ImageFrameBuffer(int attachmentNumber, GLuint FBO, int width, int height, std::string signature, GLint internalFormat,
+								   GLenum format, GLenum dataType, glm::vec4 defaultColor, GLenum clearType, bool transient) :
+	DecoratedFrameBuffer(attachmentNumber, FBO, width, height, signature, GL_TEXTURE_2D, defaultColor, clearType),
+	internalFormat(internalFormat), format(format), dataType(dataType)
+{
+	this->transient = transient;
+
+	bindFBO();
+	bindTexture();
+	bindRBO();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+RenderTargetDescription ImageFrameBuffer::getDescription(void)
+{
+	return { width, height, internalFormat, format, dataType, GL_LINEAR };
+}
+
+DepthFrameBuffer::DepthFrameBuffer(GLuint FBO, int width, int height, std::string signature) :
+	DecoratedFrameBuffer(-1, FBO, width, height, signature, GL_TEXTURE_2D, glm::vec4(), GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT)
+{
+	bindFBO();
+	bindTexture();
+	bindRBO();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+DepthFrameBuffer::~DepthFrameBuffer()
+{
+	GLStateCache::getInstance()->deleteTexture(texture);
+}
+
+void DepthFrameBuffer::bindTexture()
+{
+	texture = RenderTargetPool::createTexture(getDescription());
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, type, texture, 0);
+}
+
+// Attachments created on this FBO afterwards find it in depthAttachments and leave it alone; a renderbuffer made by one
+// created before is replaced
+void DepthFrameBuffer::bindRBO()
+{
+	auto shared = depthAttachments.find(FBO);
+
+	if (shared != depthAttachments.end() && shared->second != 0)
+	{
+		glDeleteRenderbuffers(1, &shared->second);
+	}
+
+	RBO = 0;
+	depthAttachments[FBO] = 0;
+}
+
+DecoratedFrameBuffer* DepthFrameBuffer::drawBuffers(std::vector<GLuint>&)
+{
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+	GLStateCache::getInstance()->clear(clearType);
+
+	return this;
+}
+
+RenderTargetDescription DepthFrameBuffer::getDescription(void)
+{
+	return { width, height, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, GL_NEAREST };
+}
+
 PickingBuffer::PickingBuffer(DecoratedFrameBuffer* child, int width, int height, std::string signature) :
 	DecoratedFrameBuffer(child, width, height, signature, GL_TEXTURE_2D, glm::vec4(0), GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT)
 {
@@ -217,34 +330,179 @@ PickingBuffer::PickingBuffer(int attachmentNumber, GLuint FBO, int width, int he
 
 void PickingBuffer::bindTexture()
 {
-	glGenTextures(1, &texture);
-	glBindTexture(type, texture);
-
-	glTexImage2D(type, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
-	glTexParameteri(type, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	texture = RenderTargetPool::createTexture(getDescription());
 
 	auto error = glGetError();
 
 	if (error != GL_NO_ERROR)
 		std::cout << error << std::endl;
 
-	glBindTexture(type, 0);
-
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + attachmentNumber, type, texture, 0);
 }
 
-GLuint* PickingBuffer::getValues(int x, int y, int sampleW, int sampleH)
+RenderTargetDescription PickingBuffer::getDescription(void)
 {
+	return { width, height, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, GL_LINEAR };
+}
+
+PickingBuffer::~PickingBuffer()
+{
+	for (auto& readback : readbacks)
+	{
+		if (readback.fence != nullptr)
+		{
+			glDeleteSync(readback.fence);
+		}
+
+		if (readback.PBO != 0)
+		{
+			glDeleteBuffers(1, &readback.PBO);
+		}
+	}
+
+	delete regionPicker;
+}
+
+void PickingBuffer::bindReadbackBuffers(void)
+{
+	for (auto& readback : readbacks)
+	{
+		glGenBuffers(1, &readback.PBO);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.PBO);
+		glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(GLuint), NULL, GL_STREAM_READ);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+glm::ivec2 PickingBuffer::toRenderedPixel(int x, int y)
+{
+	if (renderScale == glm::vec2(1.0f))
+	{
+		return glm::ivec2(x, y);
+	}
+
+	return glm::ivec2((int)(x * renderScale.x), (int)(y * renderScale.y));
+}
+
+// Queues a copy of the value under (x, y) into the next pack buffer of the ring and returns straight away. If every
+// slot is still in flight the oldest request is abandoned, so the CPU never waits on the GPU here
+void PickingBuffer::requestValue(int x, int y)
+{
+	if (readbacks[0].PBO == 0)
+	{
+		bindReadbackBuffers();
+	}
+
+	auto& readback = readbacks[nextReadback];
+
+	if (readback.fence != nullptr)
+	{
+		glDeleteSync(readback.fence);
+	}
+
 	glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
 	glReadBuffer(GL_COLOR_ATTACHMENT0 + attachmentNumber);
-	int length = 4 * width * height;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.PBO);
+
+	auto pixel = toRenderedPixel(x, y);
+	glReadPixels(pixel.x, pixel.y, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 
-	GLuint* data = new GLuint[4];
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	nextReadback = (nextReadback + 1) % READBACK_RING_SIZE;
+}
+
+// Collects every request whose fence has signalled, oldest first, without blocking. Returns true if at least one
+// completed, in which case value holds the most recent result; otherwise value holds the last known one
+bool PickingBuffer::pollValue(GLuint& value)
+{
+	bool resolved = false;
 
-	glReadPixels(x, y, sampleW, sampleH, GL_RGBA_INTEGER, GL_UNSIGNED_INT, data);
+	for (int i = 0; i < READBACK_RING_SIZE; i++)
+	{
+		auto& readback = readbacks[(nextReadback + i) % READBACK_RING_SIZE];
+
+		if (readback.fence == nullptr)
+		{
+			continue;
+		}
+
+		auto status = glClientWaitSync(readback.fence, 0, 0);
+
+		// Fences signal in submission order, so nothing newer can be done either
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			break;
+		}
+
+		glDeleteSync(readback.fence);
+		readback.fence = nullptr;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.PBO);
+		glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, sizeof(GLuint), &latestValue);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		resolved = true;
+	}
+
+	value = latestValue;
+
+	return resolved;
+}
+
+GLuint PickingBuffer::getLatestValue(void)
+{
+	return latestValue;
+}
+
+// Blocking fallback : synchronises with the GPU. data must hold sampleW * sampleH values
+void PickingBuffer::getValues(int x, int y, GLuint* data, int sampleW, int sampleH)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+	glReadBuffer(GL_COLOR_ATTACHMENT0 + attachmentNumber);
+
+	auto pixel = toRenderedPixel(x, y);
+	glReadPixels(pixel.x, pixel.y, sampleW, sampleH, GL_RED_INTEGER, GL_UNSIGNED_INT, data);
 
 	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 
-	return data;
+	latestValue = data[0];
+}
+
+// Corners may be given in any order and are clamped to the buffer; both are inclusive
+void PickingBuffer::requestRegion(int x0, int y0, int x1, int y1, unsigned int idLimit, const std::vector<glm::ivec2>& lasso)
+{
+	auto corner0 = toRenderedPixel(x0, y0);
+	auto corner1 = toRenderedPixel(x1, y1);
+	int minX = std::max(0, std::min(corner0.x, corner1.x));
+	int minY = std::max(0, std::min(corner0.y, corner1.y));
+	int maxX = std::min(width - 1, std::max(corner0.x, corner1.x));
+	int maxY = std::min(height - 1, std::max(corner0.y, corner1.y));
+	std::vector<glm::ivec2> renderedLasso;
+
+	for (const auto& point : lasso)
+	{
+		renderedLasso.push_back(toRenderedPixel(point.x, point.y));
+	}
+
+	getRegionPicker()->request(texture, FBO, GL_COLOR_ATTACHMENT0 + attachmentNumber, minX, minY, maxX - minX + 1, maxY - minY + 1,
+							   idLimit, renderedLasso);
+}
+
+bool PickingBuffer::pollRegion(std::vector<unsigned int>& ids)
+{
+	return getRegionPicker()->poll(ids);
+}
+
+RegionPicker* PickingBuffer::getRegionPicker(void)
+{
+	if (regionPicker == nullptr)
+	{
+		regionPicker = new RegionPicker();
+	}
+
+	return regionPicker;
 }
\ No newline at end of file
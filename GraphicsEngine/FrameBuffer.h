@@ -1,5 +1,7 @@
 #pragma once
 #include "Decorator.h"
+#include "RenderTargetPool.h"
+#include "RegionPicker.h"
 #include <unordered_set>
 #include <glew.h>
 #include <glm.hpp>
@@ -7,10 +9,14 @@
 class DecoratedFrameBuffer : public Decorator<DecoratedFrameBuffer>
 {
 protected:
+	// Depth-stencil renderbuffer shared by every attachment of a given FBO
+	static std::unordered_map<GLuint, GLuint> depthAttachments;
 	virtual void bindFBO(void);
 	virtual void bindTexture(void) = 0;
 	virtual void bindRBO(void);
-	GLuint texture;
+	GLuint texture = 0;
+	// Texture a transient buffer made for itself when drawn outside of a FrameGraph, freed once a pooled one replaces it
+	GLuint dedicatedTexture = 0;
 	GLuint RBO;
 	GLenum type;
 	GLenum clearType;
@@ -20,6 +26,11 @@ protected:
 	glm::vec4 defaultColor;
 public:
 	GLuint FBO = 0;
+	// Transient buffers only live for part of a frame, so their texture is handed out by a RenderTargetPool rather than
+	// owned by the buffer
+	bool transient = false;
+	// Fraction of the buffer, in each axis, that the last pass drawing into it covered; anything outside holds stale data
+	glm::vec2 renderScale = glm::vec2(1.0f);
 
 	DecoratedFrameBuffer() {};
 	DecoratedFrameBuffer(int width, int height, std::string signature, GLenum type, glm::vec4 defaultColor = glm::vec4(),
@@ -36,6 +47,8 @@ public:
 	void drawBuffers(std::vector<std::string> signatures);
 
 	virtual int bindTexturesForPass(int textureOffset = 0);
+	virtual RenderTargetDescription getDescription(void);
+	virtual void attachTexture(GLuint texture);
 
 	DecoratedFrameBuffer* make(void) { return NULL; };
 	std::string printOwnProperties(void);
@@ -60,25 +73,71 @@ public:
 class ImageFrameBuffer : public DecoratedFrameBuffer
 {
 protected:
+	GLint internalFormat = GL_RGB;
+	GLenum format = GL_RGB;
+	GLenum dataType = GL_UNSIGNED_BYTE;
 	virtual void bindTexture(void);
 public:
-	ImageFrameBuffer(int width, int height, std::string signature, glm::vec4 defaultColor = glm::vec4(), GLenum clearType = GL_COLOR_BUFFER_BIT);
+	ImageFrameBuffer(int width, int height, std::string signature, glm::vec4 defaultColor = glm::vec4(), GLenum clearType = GL_COLOR_BUFFER_BIT,
+					 bool transient = false);
 	ImageFrameBuffer(DecoratedFrameBuffer* child, int width, int height, std::string signature, glm::vec4 defaultColor = glm::vec4(),
-					 GLenum clearType = GL_COLOR_BUFFER_BIT);
+					 GLenum clearType = GL_COLOR_BUFFER_BIT, bool transient = false);
 	ImageFrameBuffer(int attachmentNumber, GLuint FBO, int width, int height, std::string signature, glm::vec4 defaultColor = glm::vec4(),
-					 GLenum clearType = GL_COLOR_BUFFER_BIT);
+					 GLenum clearType = GL_COLOR_BUFFER_BIT, bool transient = false);
+	// Attachment stored in a format other than RGB8
+	ImageFrameBuffer(int attachmentNumber, GLuint FBO, int width, int height, std::string signature, GLint internalFormat, GLenum format,
+					 GLenum dataType, glm::vec4 defaultColor = glm::vec4(), GLenum clearType = GL_COLOR_BUFFER_BIT, bool transient = false);
 	~ImageFrameBuffer() {};
+	RenderTargetDescription getDescription(void) override;
+};
+
+// Depth-stencil texture standing in for the FBO's shared renderbuffer, so later passes can sample depth. It takes no
+// draw buffer slot, and clears depth and stencil when the pass binds its outputs
+class DepthFrameBuffer : public DecoratedFrameBuffer
+{
+protected:
+	virtual void bindTexture(void);
+	virtual void bindRBO(void);
+public:
+	DepthFrameBuffer(GLuint FBO, int width, int height, std::string signature);
+	~DepthFrameBuffer();
+	DecoratedFrameBuffer* drawBuffers(std::vector<GLuint>& buff) override;
+	RenderTargetDescription getDescription(void) override;
 };
 
 class PickingBuffer : public DecoratedFrameBuffer
 {
+public:
+	static const int READBACK_RING_SIZE = 3;
 protected:
+	// One slot of the asynchronous readback ring : a pixel pack buffer and the fence that tells when it has been filled
+	struct Readback
+	{
+		GLuint PBO = 0;
+		GLsync fence = nullptr;
+	};
+
+	Readback readbacks[READBACK_RING_SIZE];
+	int nextReadback = 0;
+	GLuint latestValue = 0;
+	RegionPicker* regionPicker = nullptr;
 	virtual void bindTexture(void);
+	void bindReadbackBuffers(void);
+	// Maps full resolution pixel coordinates onto the part of the buffer that was actually rendered
+	glm::ivec2 toRenderedPixel(int x, int y);
 public:
 	PickingBuffer(int width, int height, std::string signature);
 	PickingBuffer(DecoratedFrameBuffer* child, int width, int height, std::string signature);
 	PickingBuffer(int attachmentNumber, GLuint FBO, int width, int height, std::string signature);
-	~PickingBuffer() {};
+	~PickingBuffer();
+	RenderTargetDescription getDescription(void) override;
+
+	void requestValue(int x, int y);
+	bool pollValue(GLuint& value);
+	GLuint getLatestValue(void);
+	void getValues(int x, int y, GLuint* data, int sampleW = 1, int sampleH = 1);
 
-	GLuint* getValues(int x, int y, int sampleW = 1, int sampleH = 1);
+	void requestRegion(int x0, int y0, int x1, int y1, unsigned int idLimit, const std::vector<glm::ivec2>& lasso = std::vector<glm::ivec2>());
+	bool pollRegion(std::vector<unsigned int>& ids);
+	RegionPicker* getRegionPicker(void);
 };
\ No newline at end of file
@@ -0,0 +1,444 @@
+#pragma once
+#include "FrameGraph.h"
+#include "Pass.h"
+#include "FrameBuffer.h"
+#include "Profiler.h"
+#include "GLDispatch.h"
+#include "DynamicResolution.h"
+#include <chrono>
+#include <queue>
+
+// One thread less than the hardware offers, since the GL thread records too
+unsigned int FrameGraph::getDefaultRecordingThreadCount(void)
+{
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+
+	return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+}
+
+FrameGraph::FrameGraph(Pass* root, unsigned int recordingThreadCount) : root(root), compiledTopologyVersion(root->topologyVersion),
+	programGeneration(ShaderProgram::getGeneration())
+{
+	setRecordingThreadCount(recordingThreadCount);
+}
+
+FrameGraph::~FrameGraph()
+{
+	delete recordingThreads;
+}
+
+void FrameGraph::setRecordingThreadCount(unsigned int count)
+{
+	delete recordingThreads;
+	recordingThreads = new ThreadPool(count);
+}
+
+Pass* FrameGraph::getRoot(void)
+{
+	return root;
+}
+
+bool FrameGraph::needsCompile(void)
+{
+	return !compiled || compiledTopologyVersion != root->topologyVersion;
+}
+
+// Kahn's algorithm restricted to the nodes reachable from the root, visiting neighbors in insertion order so the
+// resulting schedule matches the order the recursive Pass::execute used to produce
+void FrameGraph::topologicalSort(std::vector<Pass*>& sorted)
+{
+	std::unordered_map<Pass*, int> inDegree;
+	std::vector<Pass*> stack = { root };
+	inDegree[root] = 0;
+
+	while (!stack.empty())
+	{
+		Pass* current = stack.back();
+		stack.pop_back();
+
+		for (const auto& edge : current->neighborEdges)
+		{
+			Pass* destination = edge->data->destination;
+
+			if (inDegree.find(destination) == inDegree.end())
+			{
+				inDegree[destination] = 0;
+				stack.push_back(destination);
+			}
+
+			inDegree[destination]++;
+		}
+	}
+
+	std::queue<Pass*> ready;
+	ready.push(root);
+
+	while (!ready.empty())
+	{
+		Pass* current = ready.front();
+		ready.pop();
+		sorted.push_back(current);
+
+		for (const auto& edge : current->neighborEdges)
+		{
+			Pass* destination = edge->data->destination;
+
+			if (--inDegree[destination] == 0)
+			{
+				ready.push(destination);
+			}
+		}
+	}
+
+	if (sorted.size() != inDegree.size())
+	{
+		std::cout << "FRAME GRAPH CONTAINS A CYCLE, " << inDegree.size() - sorted.size() << " PASSES WILL NOT BE SCHEDULED" << std::endl;
+	}
+}
+
+// A pass is live if it has side effects of its own (terminal output, post-execute functors, alwaysExecute), or if a
+// live pass consumes it. Render edges only count as consumption when they actually hand over frame buffers; edges
+// declared with "NONE" are ordering-only. Edges without render data are treated as plain dependencies
+void FrameGraph::cull(const std::vector<Pass*>& sorted, std::unordered_map<Pass*, bool>& live)
+{
+	for (auto it = sorted.rbegin(); it != sorted.rend(); ++it)
+	{
+		Pass* current = *it;
+		bool isLive = current->hasSideEffects();
+
+		for (const auto& edge : current->neighborEdges)
+		{
+			if (isLive)
+			{
+				break;
+			}
+
+			if (!live[edge->data->destination])
+			{
+				continue;
+			}
+
+			auto renderData = dynamic_cast<RenderPass::RenderEdgeData*>(edge->data);
+			isLive = renderData == nullptr || !renderData->frameBuffers.empty();
+		}
+
+		live[current] = isLive;
+	}
+}
+
+void FrameGraph::compile(void)
+{
+	std::vector<Pass*> sorted;
+	std::unordered_map<Pass*, bool> live;
+
+	topologicalSort(sorted);
+	cull(sorted, live);
+
+	std::unordered_map<Pass*, ScheduledPass> previous;
+
+	for (const auto& scheduled : schedule)
+	{
+		previous[scheduled.pass] = scheduled;
+	}
+
+	schedule.clear();
+	scheduleIndex.clear();
+
+	for (const auto& pass : sorted)
+	{
+		ScheduledPass scheduled = { pass, !live[pass], 0.0, 0.0, 0.0, 0.0, 0, 0 };
+		auto found = previous.find(pass);
+
+		if (found != previous.end())
+		{
+			scheduled.lastRecordTime = found->second.lastRecordTime;
+			scheduled.lastReplayTime = found->second.lastReplayTime;
+			scheduled.lastCPUTime = found->second.lastCPUTime;
+			scheduled.averageCPUTime = found->second.averageCPUTime;
+			scheduled.executionCount = found->second.executionCount;
+			scheduled.deferredFrames = found->second.deferredFrames;
+			scheduled.culled = !live[pass];
+		}
+
+		scheduleIndex[pass] = schedule.size();
+		schedule.push_back(scheduled);
+	}
+
+	allocateTransientTargets();
+
+	compiledTopologyVersion = root->topologyVersion;
+	compiled = true;
+}
+
+// A transient buffer is alive from the pass that renders into it up to the last scheduled pass that samples it
+void FrameGraph::allocateTransientTargets(void)
+{
+	std::vector<RenderTargetPool::TransientTarget> targets;
+	std::unordered_map<DecoratedFrameBuffer*, int> targetIndex;
+
+	for (size_t i = 0; i < schedule.size(); i++)
+	{
+		auto renderPass = dynamic_cast<RenderPass*>(schedule[i].pass);
+
+		if (schedule[i].culled || renderPass == nullptr)
+		{
+			continue;
+		}
+
+		for (const auto& fb : renderPass->frameBuffers)
+		{
+			for (auto current = fb.second; current != nullptr; current = current->child)
+			{
+				if (current->transient && targetIndex.find(current) == targetIndex.end())
+				{
+					targetIndex[current] = targets.size();
+					targets.push_back({ current, current->getDescription(), (int)i, (int)i });
+
+					// Outputs of passes that skip frames are sampled in frames they don't render, so they can't share
+					if (renderPass->getUpdateRate() != Pass::EVERY_FRAME)
+					{
+						targets.back().firstUse = 0;
+						targets.back().lastUse = (int)schedule.size() - 1;
+					}
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < schedule.size(); i++)
+	{
+		if (schedule[i].culled)
+		{
+			continue;
+		}
+
+		for (const auto& edge : schedule[i].pass->neighborEdges)
+		{
+			auto renderData = dynamic_cast<RenderPass::RenderEdgeData*>(edge->data);
+			auto consumer = scheduleIndex.find(edge->data->destination);
+
+			if (renderData == nullptr || consumer == scheduleIndex.end())
+			{
+				continue;
+			}
+
+			for (const auto& fb : renderData->frameBuffers)
+			{
+				for (auto current = fb; current != nullptr; current = current->child)
+				{
+					auto found = targetIndex.find(current);
+
+					if (found != targetIndex.end() && targets[found->second].lastUse < consumer->second)
+					{
+						targets[found->second].lastUse = consumer->second;
+					}
+				}
+			}
+		}
+	}
+
+	renderTargets.plan(targets);
+}
+
+// Passes that run every frame always do. Due passes with a lower rate are admitted in schedule order while their
+// average cost fits in what is left of the frame budget, and the rest wait for a later frame, still due. The first of
+// them is always admitted so a budget smaller than any one pass can't starve them all
+void FrameGraph::selectDuePasses(void)
+{
+	double spentMilliseconds = 0.0;
+	bool admittedDeferrable = false;
+
+	duePasses.clear();
+
+	for (auto& scheduled : schedule)
+	{
+		if (scheduled.culled)
+		{
+			continue;
+		}
+
+		bool due = scheduled.pass->isDue();
+
+		if (due && scheduled.pass->getUpdateRate() != Pass::EVERY_FRAME && frameBudgetMilliseconds > 0.0)
+		{
+			due = !admittedDeferrable || spentMilliseconds + scheduled.averageCPUTime <= frameBudgetMilliseconds;
+			admittedDeferrable = admittedDeferrable || due;
+			scheduled.deferredFrames = due ? 0 : scheduled.deferredFrames + 1;
+		}
+
+		scheduled.pass->advanceFrame(due);
+
+		if (due)
+		{
+			spentMilliseconds += scheduled.averageCPUTime;
+			duePasses.push_back(&scheduled);
+		}
+	}
+}
+
+void FrameGraph::setFrameBudget(double milliseconds)
+{
+	frameBudgetMilliseconds = milliseconds;
+}
+
+// Every due pass records into its own command buffer, concurrently across the recording threads, and the buffers are
+// then replayed in schedule order on the calling (GL) thread. Recording never depends on another pass' results, so
+// independent branches of the DAG don't need to wait on each other
+void FrameGraph::execute(void)
+{
+	PROFILE_ZONE("FrameGraph::execute", "frame");
+
+	if (needsCompile())
+	{
+		compile();
+	}
+
+	// Shader hot reloads swap programs between frames, so no recording can be looking at the old uniform tables
+	if (programGeneration != ShaderProgram::getGeneration())
+	{
+		for (auto& scheduled : schedule)
+		{
+			scheduled.pass->refreshProgramBindings();
+		}
+
+		programGeneration = ShaderProgram::getGeneration();
+	}
+
+	selectDuePasses();
+
+	if (commandBuffers.size() < duePasses.size())
+	{
+		commandBuffers.resize(duePasses.size());
+	}
+
+	// Work that fans out over the recording threads itself goes first, while they are idle
+	for (auto scheduled : duePasses)
+	{
+		auto begin = std::chrono::steady_clock::now();
+
+		scheduled->pass->prepareRecording(recordingThreads);
+
+		auto end = std::chrono::steady_clock::now();
+		scheduled->lastRecordTime = std::chrono::duration<double, std::milli>(end - begin).count();
+	}
+
+	recordingThreads->parallelFor(duePasses.size(), [this](size_t i)
+	{
+		ProfileZone zone(duePasses[i]->pass->signature.c_str(), "record");
+		auto begin = std::chrono::steady_clock::now();
+
+		commandBuffers[i].clear();
+		duePasses[i]->pass->recordCommands(commandBuffers[i]);
+
+		auto end = std::chrono::steady_clock::now();
+		duePasses[i]->lastRecordTime += std::chrono::duration<double, std::milli>(end - begin).count();
+	});
+
+	// The jobs passes split off (chunks of their objects) are spread over the threads together, so a single pass with
+	// many objects still records in parallel
+	recordingJobs.clear();
+
+	for (size_t i = 0; i < duePasses.size(); i++)
+	{
+		size_t jobCount = duePasses[i]->pass->getRecordingJobCount();
+
+		for (size_t job = 0; job < jobCount; job++)
+		{
+			recordingJobs.push_back({ i, job, 0.0 });
+		}
+	}
+
+	recordingThreads->parallelFor(recordingJobs.size(), [this](size_t i)
+	{
+		auto& job = recordingJobs[i];
+		ProfileZone zone(duePasses[job.duePass]->pass->signature.c_str(), "record");
+		auto begin = std::chrono::steady_clock::now();
+
+		duePasses[job.duePass]->pass->recordJob(job.job);
+
+		job.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	});
+
+	for (const auto& job : recordingJobs)
+	{
+		duePasses[job.duePass]->lastRecordTime += job.milliseconds;
+	}
+
+	DynamicResolution::getInstance()->beginFrame();
+
+	for (size_t i = 0; i < duePasses.size(); i++)
+	{
+		auto& scheduled = *duePasses[i];
+		ProfileZone zone(scheduled.pass->signature.c_str(), "replay");
+		auto begin = std::chrono::steady_clock::now();
+
+		Profiler::getInstance()->beginGPUZone(scheduled.pass->signature.c_str(), "pass");
+		commandBuffers[i].replay();
+		Profiler::getInstance()->endGPUZone();
+		scheduled.pass->postExecute();
+
+		auto end = std::chrono::steady_clock::now();
+
+		scheduled.lastReplayTime = std::chrono::duration<double, std::milli>(end - begin).count();
+		scheduled.lastCPUTime = scheduled.lastRecordTime + scheduled.lastReplayTime;
+		scheduled.executionCount++;
+		scheduled.averageCPUTime += (scheduled.lastCPUTime - scheduled.averageCPUTime) / scheduled.executionCount;
+	}
+
+	// The new scale, if any, is picked up by the next frame's recording
+	DynamicResolution::getInstance()->endFrame();
+	Profiler::getInstance()->collectGPUZones();
+	GLDispatch::getInstance()->endFrame();
+}
+
+const std::vector<FrameGraph::ScheduledPass>& FrameGraph::getSchedule(void)
+{
+	if (needsCompile())
+	{
+		compile();
+	}
+
+	return schedule;
+}
+
+const FrameGraph::ScheduledPass* FrameGraph::getScheduledPass(Pass* pass)
+{
+	if (needsCompile())
+	{
+		compile();
+	}
+
+	auto found = scheduleIndex.find(pass);
+
+	if (found != scheduleIndex.end())
+	{
+		return &schedule[found->second];
+	}
+
+	return nullptr;
+}
+
+const RenderTargetPool::Statistics& FrameGraph::getRenderTargetStatistics(void)
+{
+	if (needsCompile())
+	{
+		compile();
+	}
+
+	return renderTargets.getStatistics();
+}
+
+void FrameGraph::printSchedule(std::ostream& stream)
+{
+	for (const auto& scheduled : getSchedule())
+	{
+		stream << scheduled.pass->signature << (scheduled.culled ? " (CULLED)" : "") << ": " << scheduled.lastCPUTime << "ms LAST (" <<
+			scheduled.lastRecordTime << "ms RECORDING, " << scheduled.lastReplayTime << "ms REPLAY), " << scheduled.averageCPUTime <<
+			"ms AVERAGE" << (scheduled.deferredFrames > 0 ? ", DEFERRED " + std::to_string(scheduled.deferredFrames) + " FRAMES" : "") <<
+			std::endl;
+	}
+
+	auto& statistics = renderTargets.getStatistics();
+	stream << statistics.requestedTargets << " TRANSIENT TARGETS IN " << statistics.allocatedTargets << " TEXTURES, " <<
+		statistics.requestedBytes / 1024 << "KB REQUESTED, " << statistics.allocatedBytes / 1024 << "KB ALLOCATED" << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <iostream>
+#include "RenderTargetPool.h"
+#include "CommandBuffer.h"
+#include "ThreadPool.h"
+
+class Pass;
+
+// Flattened, topologically sorted view of a Pass DAG. The graph is compiled once into a linear schedule (culling
+// passes whose outputs nothing consumes) and only recompiled when the pass topology changes
+class FrameGraph
+{
+public:
+	struct ScheduledPass
+	{
+		Pass* pass;
+		bool culled;
+		double lastRecordTime;
+		double lastReplayTime;
+		double lastCPUTime;
+		double averageCPUTime;
+		unsigned long executionCount;
+		// Consecutive frames the pass was due but didn't fit in the frame budget
+		unsigned long deferredFrames;
+	};
+private:
+	Pass* root;
+	unsigned int compiledTopologyVersion;
+	unsigned int programGeneration;
+	bool compiled = false;
+	std::vector<ScheduledPass> schedule;
+	std::unordered_map<Pass*, int> scheduleIndex;
+	RenderTargetPool renderTargets;
+	ThreadPool* recordingThreads = nullptr;
+	std::vector<CommandBuffer> commandBuffers;
+	std::vector<ScheduledPass*> duePasses;
+
+	struct RecordingJob
+	{
+		size_t duePass;
+		size_t job;
+		double milliseconds;
+	};
+
+	std::vector<RecordingJob> recordingJobs;
+	double frameBudgetMilliseconds = 0.0;
+	void topologicalSort(std::vector<Pass*>& sorted);
+	void cull(const std::vector<Pass*>& sorted, std::unordered_map<Pass*, bool>& live);
+	void allocateTransientTargets(void);
+	void selectDuePasses(void);
+public:
+	static unsigned int getDefaultRecordingThreadCount(void);
+	FrameGraph(Pass* root, unsigned int recordingThreadCount = getDefaultRecordingThreadCount());
+	~FrameGraph();
+	Pass* getRoot(void);
+	void compile(void);
+	bool needsCompile(void);
+	void setRecordingThreadCount(unsigned int count);
+	// CPU milliseconds per frame, counted by the passes' average cost. Passes that update every frame always run; due
+	// passes with a lower rate that don't fit are spread across the following frames. 0, the default, disables it
+	void setFrameBudget(double milliseconds);
+	void execute(void);
+	const std::vector<ScheduledPass>& getSchedule(void);
+	const ScheduledPass* getScheduledPass(Pass* pass);
+	const RenderTargetPool::Statistics& getRenderTargetStatistics(void);
+	void printSchedule(std::ostream& stream = std::cout);
+};
\ No newline at end of file
@@ -0,0 +1,363 @@
+#pragma once
+#define GL_DISPATCH_IMPLEMENTATION
+#include "GLDispatch.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+// GL 1.1 entry points start out pointing at the driver, so redirected calls behave as before until installed
+#define X(name, category, returnType, parameters, arguments, bytes) decltype(&::gl##name) glDispatch##name = &::gl##name;
+GL_DISPATCH_CORE_ENTRY_POINTS(X)
+#undef X
+
+namespace
+{
+	// Where counted calls are forwarded to: the driver's functions, or the null backend's
+#define X(name, category, returnType, parameters, arguments, bytes) decltype(&::gl##name) backend##name = nullptr;
+	GL_DISPATCH_CORE_ENTRY_POINTS(X)
+#undef X
+#define X(name, category, returnType, parameters, arguments, bytes) decltype(__glew##name) backend##name = nullptr;
+	GL_DISPATCH_GLEW_ENTRY_POINTS(X)
+#undef X
+
+	// What install() replaced, restored by uninstall()
+#define X(name, category, returnType, parameters, arguments, bytes) decltype(&::gl##name) original##name = nullptr;
+	GL_DISPATCH_CORE_ENTRY_POINTS(X)
+#undef X
+#define X(name, category, returnType, parameters, arguments, bytes) decltype(__glew##name) original##name = nullptr;
+	GL_DISPATCH_GLEW_ENTRY_POINTS(X)
+#undef X
+
+#define X(name, category, returnType, parameters, arguments, bytes) \
+	returnType GLAPIENTRY counted##name parameters \
+	{ \
+		GLDispatch::getInstance()->count(GLDispatch::ENTRY_##name, GLDispatch::category, (unsigned long long)(bytes)); \
+		return backend##name arguments; \
+	}
+	GL_DISPATCH_CORE_ENTRY_POINTS(X)
+	GL_DISPATCH_GLEW_ENTRY_POINTS(X)
+#undef X
+
+	// The null backend. Anything not handled below does nothing and returns zero
+	template <class T> T nullResult()
+	{
+		return T();
+	}
+
+	// Stands in for every entry point; its parameters are deduced from the pointer it is assigned to
+	template <class T, class... Parameters> T GLAPIENTRY ignored(Parameters...)
+	{
+		return nullResult<T>();
+	}
+
+	GLuint nextNullName = 1;
+
+	void GLAPIENTRY nullGenerateNames(GLsizei n, GLuint* names)
+	{
+		for (GLsizei i = 0; i < n; i++)
+		{
+			names[i] = nextNullName++;
+		}
+	}
+
+	GLuint GLAPIENTRY nullCreateProgram(void)
+	{
+		return nextNullName++;
+	}
+
+	GLuint GLAPIENTRY nullCreateShader(GLenum)
+	{
+		return nextNullName++;
+	}
+
+	GLuint GLAPIENTRY nullCreateShaderProgramv(GLenum, GLsizei, const GLchar* const*)
+	{
+		return nextNullName++;
+	}
+
+	GLsync GLAPIENTRY nullFenceSync(GLenum, GLbitfield)
+	{
+		return (GLsync)(size_t)nextNullName++;
+	}
+
+	GLenum GLAPIENTRY nullClientWaitSync(GLsync, GLbitfield, GLuint64)
+	{
+		return GL_ALREADY_SIGNALED;
+	}
+
+	const GLubyte* GLAPIENTRY nullGetString(GLenum name)
+	{
+		return (const GLubyte*)(name == GL_VERSION ? "4.5 GLDispatch" : name == GL_SHADING_LANGUAGE_VERSION ? "4.50" : "GLDispatch null backend");
+	}
+
+	// Compiles, links and validation succeed, logs are empty and programs have no active resources
+	void GLAPIENTRY nullGetObjectiv(GLuint, GLenum pname, GLint* params)
+	{
+		*params = pname == GL_COMPILE_STATUS || pname == GL_LINK_STATUS || pname == GL_VALIDATE_STATUS ? GL_TRUE : 0;
+	}
+
+	void GLAPIENTRY nullGetInfoLog(GLuint, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+	{
+		if (length != nullptr)
+		{
+			*length = 0;
+		}
+
+		if (bufSize > 0)
+		{
+			infoLog[0] = '\0';
+		}
+	}
+
+	// How many values a glGet writes for pname. The lists of formats are as long as their count, which is 0 here
+	GLsizei getNullValueCount(GLenum pname)
+	{
+		switch (pname)
+		{
+		case GL_VIEWPORT: case GL_SCISSOR_BOX: case GL_COLOR_WRITEMASK: case GL_BLEND_COLOR: case GL_COLOR_CLEAR_VALUE:
+			return 4;
+		case GL_MAX_VIEWPORT_DIMS: case GL_DEPTH_RANGE: case GL_ALIASED_LINE_WIDTH_RANGE: case GL_LINE_WIDTH_RANGE:
+		case GL_POINT_SIZE_RANGE: case GL_POLYGON_MODE: case GL_VIEWPORT_BOUNDS_RANGE:
+			return 2;
+		case GL_COMPRESSED_TEXTURE_FORMATS: case GL_PROGRAM_BINARY_FORMATS: case GL_SHADER_BINARY_FORMATS:
+			return 0;
+		default:
+			return 1;
+		}
+	}
+
+	void GLAPIENTRY nullGetIntegerv(GLenum pname, GLint* data)
+	{
+		std::fill(data, data + getNullValueCount(pname), 0);
+	}
+
+	void GLAPIENTRY nullGetInteger64v(GLenum pname, GLint64* data)
+	{
+		std::fill(data, data + getNullValueCount(pname), 0);
+	}
+
+	// Indexed queries, such as GL_MAX_COMPUTE_WORK_GROUP_SIZE, give one value per index
+	void GLAPIENTRY nullGetIntegeri_v(GLenum, GLuint, GLint* data)
+	{
+		*data = 0;
+	}
+
+	void GLAPIENTRY nullGetProgramInterfaceiv(GLuint, GLenum, GLenum, GLint* params)
+	{
+		*params = 0;
+	}
+
+	void GLAPIENTRY nullGetProgramBinary(GLuint, GLsizei, GLsizei* length, GLenum*, void*)
+	{
+		if (length != nullptr)
+		{
+			*length = 0;
+		}
+	}
+
+	void GLAPIENTRY nullGetQueryObjectiv(GLuint, GLenum pname, GLint* params)
+	{
+		*params = pname == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0;
+	}
+
+	void GLAPIENTRY nullGetQueryObjectui64v(GLuint, GLenum, GLuint64* params)
+	{
+		*params = 0;
+	}
+
+	void GLAPIENTRY nullGetBufferSubData(GLenum, GLintptr, GLsizeiptr size, void* data)
+	{
+		memset(data, 0, (size_t)size);
+	}
+
+	GLint GLAPIENTRY nullGetUniformLocation(GLuint, const GLchar*)
+	{
+		return -1;
+	}
+}
+
+// A function local static, created once whichever thread asks first
+GLDispatch* GLDispatch::getInstance()
+{
+	static GLDispatch* dispatch = new GLDispatch();
+
+	return dispatch;
+}
+
+GLDispatch::GLDispatch() : installed(false), backend(DRIVER), frameCount(0)
+{
+}
+
+const char* GLDispatch::getEntryPointName(EntryPoint entryPoint)
+{
+	static const char* names[] =
+	{
+#define X(name, category, returnType, parameters, arguments, bytes) "gl" #name,
+		GL_DISPATCH_CORE_ENTRY_POINTS(X)
+		GL_DISPATCH_GLEW_ENTRY_POINTS(X)
+#undef X
+	};
+
+	return entryPoint < ENTRY_POINT_COUNT ? names[entryPoint] : "";
+}
+
+const char* GLDispatch::getCategoryName(Category category)
+{
+	static const char* names[] = { "DRAW", "STATE", "UNIFORM", "UPLOAD", "RESOURCE", "QUERY", "CLEAR" };
+
+	return category < CATEGORY_COUNT ? names[category] : "";
+}
+
+// Takes effect for every call made afterwards. Over the driver this needs glewInit to have run first
+void GLDispatch::install(Backend backend)
+{
+	if (installed)
+	{
+		uninstall();
+	}
+
+#define X(name, category, returnType, parameters, arguments, bytes) \
+	original##name = glDispatch##name; \
+	backend##name = backend == DRIVER ? original##name : static_cast<decltype(original##name)>(ignored<returnType>); \
+	glDispatch##name = counted##name;
+	GL_DISPATCH_CORE_ENTRY_POINTS(X)
+#undef X
+#define X(name, category, returnType, parameters, arguments, bytes) \
+	original##name = __glew##name; \
+	backend##name = backend == DRIVER ? original##name : static_cast<decltype(original##name)>(ignored<returnType>); \
+	__glew##name = counted##name;
+	GL_DISPATCH_GLEW_ENTRY_POINTS(X)
+#undef X
+
+	if (backend == NULL_BACKEND)
+	{
+		backendGenTextures = nullGenerateNames;
+		backendGenBuffers = nullGenerateNames;
+		backendGenFramebuffers = nullGenerateNames;
+		backendGenProgramPipelines = nullGenerateNames;
+		backendGenQueries = nullGenerateNames;
+		backendGenRenderbuffers = nullGenerateNames;
+		backendGenVertexArrays = nullGenerateNames;
+		backendCreateProgram = nullCreateProgram;
+		backendCreateShader = nullCreateShader;
+		backendCreateShaderProgramv = nullCreateShaderProgramv;
+		backendFenceSync = nullFenceSync;
+		backendClientWaitSync = nullClientWaitSync;
+		backendGetString = nullGetString;
+		backendGetIntegerv = nullGetIntegerv;
+		backendGetInteger64v = nullGetInteger64v;
+		backendGetIntegeri_v = nullGetIntegeri_v;
+		backendGetProgramiv = nullGetObjectiv;
+		backendGetShaderiv = nullGetObjectiv;
+		backendGetProgramPipelineiv = nullGetObjectiv;
+		backendGetProgramInfoLog = nullGetInfoLog;
+		backendGetShaderInfoLog = nullGetInfoLog;
+		backendGetProgramInterfaceiv = nullGetProgramInterfaceiv;
+		backendGetProgramBinary = nullGetProgramBinary;
+		backendGetQueryObjectiv = nullGetQueryObjectiv;
+		backendGetQueryObjectui64v = nullGetQueryObjectui64v;
+		backendGetBufferSubData = nullGetBufferSubData;
+		backendGetUniformLocation = nullGetUniformLocation;
+	}
+
+	this->backend = backend;
+	installed = true;
+	resetStatistics();
+
+	std::cout << "GL DISPATCH INSTALLED OVER THE " << (backend == DRIVER ? "DRIVER" : "NULL BACKEND") << std::endl;
+}
+
+void GLDispatch::uninstall(void)
+{
+	if (!installed)
+	{
+		return;
+	}
+
+#define X(name, category, returnType, parameters, arguments, bytes) glDispatch##name = original##name;
+	GL_DISPATCH_CORE_ENTRY_POINTS(X)
+#undef X
+#define X(name, category, returnType, parameters, arguments, bytes) __glew##name = original##name;
+	GL_DISPATCH_GLEW_ENTRY_POINTS(X)
+#undef X
+
+	installed = false;
+}
+
+bool GLDispatch::isInstalled(void)
+{
+	return installed;
+}
+
+GLDispatch::Backend GLDispatch::getBackend(void)
+{
+	return backend;
+}
+
+// Called by the FrameGraph once a frame has been submitted
+void GLDispatch::endFrame(void)
+{
+	if (!installed)
+	{
+		return;
+	}
+
+	lastFrameStatistics = statistics;
+	statistics = Statistics();
+	frameCount++;
+}
+
+void GLDispatch::resetStatistics(void)
+{
+	statistics = Statistics();
+	lastFrameStatistics = Statistics();
+	frameCount = 0;
+}
+
+const GLDispatch::Statistics& GLDispatch::getStatistics(void)
+{
+	return statistics;
+}
+
+const GLDispatch::Statistics& GLDispatch::getLastFrameStatistics(void)
+{
+	return lastFrameStatistics;
+}
+
+unsigned long long GLDispatch::getFrameCount(void)
+{
+	return frameCount;
+}
+
+unsigned long long GLDispatch::getCalls(const Statistics& statistics, const std::string& entryPoint)
+{
+	auto name = entryPoint.compare(0, 2, "gl") == 0 ? entryPoint : "gl" + entryPoint;
+
+	for (int i = 0; i < ENTRY_POINT_COUNT; i++)
+	{
+		if (name == getEntryPointName((EntryPoint)i))
+		{
+			return statistics.calls[i];
+		}
+	}
+
+	return 0;
+}
+
+void GLDispatch::printStatistics(const Statistics& statistics)
+{
+	std::cout << "GL CALLS: " << statistics.totalCalls << ", UPLOADED BYTES: " << statistics.uploadedBytes << std::endl;
+
+	for (int i = 0; i < CATEGORY_COUNT; i++)
+	{
+		std::cout << "\t" << getCategoryName((Category)i) << ": " << statistics.categoryCalls[i] << std::endl;
+	}
+
+	for (int i = 0; i < ENTRY_POINT_COUNT; i++)
+	{
+		if (statistics.calls[i] > 0)
+		{
+			std::cout << "\t" << getEntryPointName((EntryPoint)i) << ": " << statistics.calls[i] << std::endl;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,199 @@
+#pragma once
+#include <string>
+#include <glew.h>
+
+// Every GL entry point the engine calls, as X(name, category, return type, parameters, arguments, uploaded bytes).
+// GL 1.1 functions are exported by the driver library rather than loaded by GLEW, so they get their own pointers and
+// are redirected to them below. Calls to anything missing from these lists are neither counted nor stubbed
+#define GL_DISPATCH_CORE_ENTRY_POINTS(X) \
+	X(GetError, QUERY, GLenum, (void), (), 0) \
+	X(GetString, QUERY, const GLubyte*, (GLenum name), (name), 0) \
+	X(GetIntegerv, QUERY, void, (GLenum pname, GLint* data), (pname, data), 0) \
+	X(ReadPixels, QUERY, void, (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels), (x, y, width, height, format, type, pixels), 0) \
+	X(ReadBuffer, STATE, void, (GLenum src), (src), 0) \
+	X(DrawBuffer, STATE, void, (GLenum buf), (buf), 0) \
+	X(Finish, QUERY, void, (void), (), 0) \
+	X(TexParameteri, STATE, void, (GLenum target, GLenum pname, GLint param), (target, pname, param), 0) \
+	X(Enable, STATE, void, (GLenum cap), (cap), 0) \
+	X(Disable, STATE, void, (GLenum cap), (cap), 0) \
+	X(DepthMask, STATE, void, (GLboolean flag), (flag), 0) \
+	X(DepthFunc, STATE, void, (GLenum func), (func), 0) \
+	X(ColorMask, STATE, void, (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha), (red, green, blue, alpha), 0) \
+	X(BlendFunc, STATE, void, (GLenum sfactor, GLenum dfactor), (sfactor, dfactor), 0) \
+	X(PolygonMode, STATE, void, (GLenum face, GLenum mode), (face, mode), 0) \
+	X(ClearColor, STATE, void, (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha), (red, green, blue, alpha), 0) \
+	X(Clear, CLEAR, void, (GLbitfield mask), (mask), 0) \
+	X(Viewport, STATE, void, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height), 0) \
+	X(TexImage2D, RESOURCE, void, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels), (target, level, internalformat, width, height, border, format, type, pixels), 0) \
+	X(GenTextures, RESOURCE, void, (GLsizei n, GLuint* textures), (n, textures), 0) \
+	X(DeleteTextures, RESOURCE, void, (GLsizei n, const GLuint* textures), (n, textures), 0) \
+	X(BindTexture, STATE, void, (GLenum target, GLuint texture), (target, texture), 0) \
+	X(DrawArrays, DRAW, void, (GLenum mode, GLint first, GLsizei count), (mode, first, count), 0) \
+	X(DrawElements, DRAW, void, (GLenum mode, GLsizei count, GLenum type, const void* indices), (mode, count, type, indices), 0)
+
+#define GL_DISPATCH_GLEW_ENTRY_POINTS(X) \
+	X(ActiveTexture, STATE, void, (GLenum texture), (texture), 0) \
+	X(AttachShader, RESOURCE, void, (GLuint program, GLuint shader), (program, shader), 0) \
+	X(BeginQuery, QUERY, void, (GLenum target, GLuint id), (target, id), 0) \
+	X(BindBuffer, STATE, void, (GLenum target, GLuint buffer), (target, buffer), 0) \
+	X(BindBufferBase, STATE, void, (GLenum target, GLuint index, GLuint buffer), (target, index, buffer), 0) \
+	X(BindFramebuffer, STATE, void, (GLenum target, GLuint framebuffer), (target, framebuffer), 0) \
+	X(BindImageTexture, STATE, void, (GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format), (unit, texture, level, layered, layer, access, format), 0) \
+	X(BindProgramPipeline, STATE, void, (GLuint pipeline), (pipeline), 0) \
+	X(BindRenderbuffer, STATE, void, (GLenum target, GLuint renderbuffer), (target, renderbuffer), 0) \
+	X(BindVertexArray, STATE, void, (GLuint array), (array), 0) \
+	X(BufferData, UPLOAD, void, (GLenum target, GLsizeiptr size, const void* data, GLenum usage), (target, size, data, usage), size) \
+	X(BufferSubData, UPLOAD, void, (GLenum target, GLintptr offset, GLsizeiptr size, const void* data), (target, offset, size, data), size) \
+	X(ClearBufferSubData, UPLOAD, void, (GLenum target, GLenum internalformat, GLintptr offset, GLsizeiptr size, GLenum format, GLenum type, const void* data), (target, internalformat, offset, size, format, type, data), 0) \
+	X(ClientWaitSync, QUERY, GLenum, (GLsync sync, GLbitfield flags, GLuint64 timeout), (sync, flags, timeout), 0) \
+	X(CompileShader, RESOURCE, void, (GLuint shader), (shader), 0) \
+	X(CreateProgram, RESOURCE, GLuint, (void), (), 0) \
+	X(CreateShader, RESOURCE, GLuint, (GLenum type), (type), 0) \
+	X(CreateShaderProgramv, RESOURCE, GLuint, (GLenum type, GLsizei count, const GLchar* const* strings), (type, count, strings), 0) \
+	X(DeleteBuffers, RESOURCE, void, (GLsizei n, const GLuint* buffers), (n, buffers), 0) \
+	X(DeleteProgram, RESOURCE, void, (GLuint program), (program), 0) \
+	X(DeleteProgramPipelines, RESOURCE, void, (GLsizei n, const GLuint* pipelines), (n, pipelines), 0) \
+	X(DeleteQueries, RESOURCE, void, (GLsizei n, const GLuint* ids), (n, ids), 0) \
+	X(DeleteRenderbuffers, RESOURCE, void, (GLsizei n, const GLuint* renderbuffers), (n, renderbuffers), 0) \
+	X(DeleteShader, RESOURCE, void, (GLuint shader), (shader), 0) \
+	X(DeleteSync, RESOURCE, void, (GLsync sync), (sync), 0) \
+	X(DeleteVertexArrays, RESOURCE, void, (GLsizei n, const GLuint* arrays), (n, arrays), 0) \
+	X(DetachShader, RESOURCE, void, (GLuint program, GLuint shader), (program, shader), 0) \
+	X(DispatchCompute, DRAW, void, (GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z), (num_groups_x, num_groups_y, num_groups_z), 0) \
+	X(DrawBuffers, STATE, void, (GLsizei n, const GLenum* bufs), (n, bufs), 0) \
+	X(DrawElementsInstanced, DRAW, void, (GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount), (mode, count, type, indices, instancecount), 0) \
+	X(EnableVertexAttribArray, STATE, void, (GLuint index), (index), 0) \
+	X(EndQuery, QUERY, void, (GLenum target), (target), 0) \
+	X(FenceSync, RESOURCE, GLsync, (GLenum condition, GLbitfield flags), (condition, flags), 0) \
+	X(FramebufferRenderbuffer, STATE, void, (GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer), (target, attachment, renderbuffertarget, renderbuffer), 0) \
+	X(FramebufferTexture2D, STATE, void, (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level), (target, attachment, textarget, texture, level), 0) \
+	X(GenBuffers, RESOURCE, void, (GLsizei n, GLuint* buffers), (n, buffers), 0) \
+	X(GenFramebuffers, RESOURCE, void, (GLsizei n, GLuint* framebuffers), (n, framebuffers), 0) \
+	X(GenProgramPipelines, RESOURCE, void, (GLsizei n, GLuint* pipelines), (n, pipelines), 0) \
+	X(GenQueries, RESOURCE, void, (GLsizei n, GLuint* ids), (n, ids), 0) \
+	X(GenRenderbuffers, RESOURCE, void, (GLsizei n, GLuint* renderbuffers), (n, renderbuffers), 0) \
+	X(GenVertexArrays, RESOURCE, void, (GLsizei n, GLuint* arrays), (n, arrays), 0) \
+	X(GetBufferSubData, QUERY, void, (GLenum target, GLintptr offset, GLsizeiptr size, void* data), (target, offset, size, data), 0) \
+	X(GetInteger64v, QUERY, void, (GLenum pname, GLint64* data), (pname, data), 0) \
+	X(GetIntegeri_v, QUERY, void, (GLenum target, GLuint index, GLint* data), (target, index, data), 0) \
+	X(GetProgramBinary, QUERY, void, (GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary), (program, bufSize, length, binaryFormat, binary), 0) \
+	X(GetProgramInfoLog, QUERY, void, (GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog), (program, bufSize, length, infoLog), 0) \
+	X(GetProgramInterfaceiv, QUERY, void, (GLuint program, GLenum programInterface, GLenum pname, GLint* params), (program, programInterface, pname, params), 0) \
+	X(GetProgramPipelineiv, QUERY, void, (GLuint pipeline, GLenum pname, GLint* params), (pipeline, pname, params), 0) \
+	X(GetProgramResourceName, QUERY, void, (GLuint program, GLenum programInterface, GLuint index, GLsizei bufSize, GLsizei* length, GLchar* name), (program, programInterface, index, bufSize, length, name), 0) \
+	X(GetProgramResourceiv, QUERY, void, (GLuint program, GLenum programInterface, GLuint index, GLsizei propCount, const GLenum* props, GLsizei count, GLsizei* length, GLint* params), (program, programInterface, index, propCount, props, count, length, params), 0) \
+	X(GetProgramiv, QUERY, void, (GLuint program, GLenum pname, GLint* params), (program, pname, params), 0) \
+	X(GetQueryObjectiv, QUERY, void, (GLuint id, GLenum pname, GLint* params), (id, pname, params), 0) \
+	X(GetQueryObjectui64v, QUERY, void, (GLuint id, GLenum pname, GLuint64* params), (id, pname, params), 0) \
+	X(GetShaderInfoLog, QUERY, void, (GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog), (shader, bufSize, length, infoLog), 0) \
+	X(GetShaderiv, QUERY, void, (GLuint shader, GLenum pname, GLint* params), (shader, pname, params), 0) \
+	X(GetUniformLocation, QUERY, GLint, (GLuint program, const GLchar* name), (program, name), 0) \
+	X(LinkProgram, RESOURCE, void, (GLuint program), (program), 0) \
+	X(MaxShaderCompilerThreadsKHR, RESOURCE, void, (GLuint count), (count), 0) \
+	X(MemoryBarrier, STATE, void, (GLbitfield barriers), (barriers), 0) \
+	X(ProgramBinary, RESOURCE, void, (GLuint program, GLenum binaryFormat, const void* binary, GLsizei length), (program, binaryFormat, binary, length), 0) \
+	X(ProgramParameteri, RESOURCE, void, (GLuint program, GLenum pname, GLint value), (program, pname, value), 0) \
+	X(ProgramUniform1f, UNIFORM, void, (GLuint program, GLint location, GLfloat v0), (program, location, v0), 0) \
+	X(ProgramUniform1i, UNIFORM, void, (GLuint program, GLint location, GLint v0), (program, location, v0), 0) \
+	X(ProgramUniform1iv, UNIFORM, void, (GLuint program, GLint location, GLsizei count, const GLint* value), (program, location, count, value), 0) \
+	X(ProgramUniform1ui, UNIFORM, void, (GLuint program, GLint location, GLuint v0), (program, location, v0), 0) \
+	X(ProgramUniform2i, UNIFORM, void, (GLuint program, GLint location, GLint v0, GLint v1), (program, location, v0, v1), 0) \
+	X(ProgramUniform4fv, UNIFORM, void, (GLuint program, GLint location, GLsizei count, const GLfloat* value), (program, location, count, value), 0) \
+	X(ProgramUniformMatrix4fv, UNIFORM, void, (GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (program, location, count, transpose, value), 0) \
+	X(QueryCounter, QUERY, void, (GLuint id, GLenum target), (id, target), 0) \
+	X(RenderbufferStorage, RESOURCE, void, (GLenum target, GLenum internalformat, GLsizei width, GLsizei height), (target, internalformat, width, height), 0) \
+	X(ShaderSource, RESOURCE, void, (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length), (shader, count, string, length), 0) \
+	X(ShaderStorageBlockBinding, STATE, void, (GLuint program, GLuint storageBlockIndex, GLuint storageBlockBinding), (program, storageBlockIndex, storageBlockBinding), 0) \
+	X(UniformBlockBinding, STATE, void, (GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding), (program, uniformBlockIndex, uniformBlockBinding), 0) \
+	X(UseProgramStages, STATE, void, (GLuint pipeline, GLbitfield stages, GLuint program), (pipeline, stages, program), 0) \
+	X(VertexAttribDivisor, STATE, void, (GLuint index, GLuint divisor), (index, divisor), 0) \
+	X(VertexAttribPointer, STATE, void, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer), (index, size, type, normalized, stride, pointer), 0)
+
+
+// Optional layer between the engine and the driver that counts calls per entry point, bytes uploaded through
+// glBufferData/glBufferSubData, state changes and draws, per frame. It swaps GLEW's function pointers, so it costs
+// nothing until installed. Over the DRIVER backend calls are counted and forwarded; over the NULL_BACKEND they are only
+// counted and return plausible values (fresh names, successful compiles and links), so the work the engine submits can
+// be checked without a GPU or even a context
+class GLDispatch
+{
+public:
+	enum Backend { DRIVER, NULL_BACKEND };
+	enum Category { DRAW, STATE, UNIFORM, UPLOAD, RESOURCE, QUERY, CLEAR, CATEGORY_COUNT };
+
+#define X(name, category, returnType, parameters, arguments, bytes) ENTRY_##name,
+	enum EntryPoint { GL_DISPATCH_CORE_ENTRY_POINTS(X) GL_DISPATCH_GLEW_ENTRY_POINTS(X) ENTRY_POINT_COUNT };
+#undef X
+
+	struct Statistics
+	{
+		unsigned long long calls[ENTRY_POINT_COUNT] = {};
+		unsigned long long categoryCalls[CATEGORY_COUNT] = {};
+		unsigned long long uploadedBytes = 0;
+		unsigned long long totalCalls = 0;
+	};
+private:
+	bool installed;
+	Backend backend;
+	Statistics statistics;
+	Statistics lastFrameStatistics;
+	unsigned long long frameCount;
+	GLDispatch();
+	~GLDispatch() {};
+public:
+	static GLDispatch* getInstance();
+	static const char* getEntryPointName(EntryPoint entryPoint);
+	static const char* getCategoryName(Category category);
+	void install(Backend backend);
+	void uninstall(void);
+	bool isInstalled(void);
+	Backend getBackend(void);
+	// Called by the installed entry points, on the GL thread
+	inline void count(EntryPoint entryPoint, Category category, unsigned long long bytes)
+	{
+		statistics.calls[entryPoint]++;
+		statistics.categoryCalls[category]++;
+		statistics.uploadedBytes += bytes;
+		statistics.totalCalls++;
+	};
+	void endFrame(void);
+	void resetStatistics(void);
+	// Calls since the last completed frame
+	const Statistics& getStatistics(void);
+	const Statistics& getLastFrameStatistics(void);
+	unsigned long long getFrameCount(void);
+	// Accepts names with or without the gl prefix, returns 0 for unknown entry points
+	unsigned long long getCalls(const Statistics& statistics, const std::string& entryPoint);
+	void printStatistics(const Statistics& statistics);
+};
+
+#define X(name, category, returnType, parameters, arguments, bytes) extern decltype(&::gl##name) glDispatch##name;
+GL_DISPATCH_CORE_ENTRY_POINTS(X)
+#undef X
+
+#ifndef GL_DISPATCH_IMPLEMENTATION
+#define glGetError glDispatchGetError
+#define glGetString glDispatchGetString
+#define glGetIntegerv glDispatchGetIntegerv
+#define glReadPixels glDispatchReadPixels
+#define glReadBuffer glDispatchReadBuffer
+#define glDrawBuffer glDispatchDrawBuffer
+#define glFinish glDispatchFinish
+#define glTexParameteri glDispatchTexParameteri
+#define glEnable glDispatchEnable
+#define glDisable glDispatchDisable
+#define glDepthMask glDispatchDepthMask
+#define glDepthFunc glDispatchDepthFunc
+#define glColorMask glDispatchColorMask
+#define glBlendFunc glDispatchBlendFunc
+#define glPolygonMode glDispatchPolygonMode
+#define glClearColor glDispatchClearColor
+#define glClear glDispatchClear
+#define glViewport glDispatchViewport
+#define glTexImage2D glDispatchTexImage2D
+#define glGenTextures glDispatchGenTextures
+#define glDeleteTextures glDispatchDeleteTextures
+#define glBindTexture glDispatchBindTexture
+#define glDrawArrays glDispatchDrawArrays
+#define glDrawElements glDispatchDrawElements
+#endif
\ No newline at end of file
@@ -0,0 +1,297 @@
+#pragma once
+#include "GLStateCache.h"
+
+PipelineState::PipelineState(bool depthTest, bool blend, bool cullFace, GLenum polygonFace, GLenum polygonMode, GLenum blendSource,
+							 GLenum blendDestination, GLenum depthFunction, bool depthWrite, bool colorWrite) :
+	depthTest(depthTest), blend(blend), cullFace(cullFace), blendSource(blendSource), blendDestination(blendDestination),
+	polygonFace(polygonFace), polygonMode(polygonMode), depthFunction(depthFunction), depthWrite(depthWrite), colorWrite(colorWrite)
+{
+}
+
+GLStateCache* GLStateCache::stateCache = nullptr;
+
+GLStateCache* GLStateCache::getInstance()
+{
+	if (stateCache == nullptr)
+	{
+		stateCache = new GLStateCache();
+	}
+
+	return stateCache;
+}
+
+GLStateCache::GLStateCache()
+{
+	invalidate();
+}
+
+// Forget everything, so the next request for any state is issued unconditionally
+void GLStateCache::invalidate(void)
+{
+	depthTest = UNKNOWN;
+	blend = UNKNOWN;
+	cullFace = UNKNOWN;
+	blendSource = GL_NONE;
+	blendDestination = GL_NONE;
+	polygonFace = GL_NONE;
+	polygonMode = GL_NONE;
+	depthFunction = GL_NONE;
+	depthWrite = UNKNOWN;
+	colorWrite = UNKNOWN;
+	rasterizerDiscard = UNKNOWN;
+	activeTextureUnit = -1;
+	boundVertexArray = -1;
+	boundProgramPipeline = -1;
+	viewportRectangle[0] = viewportRectangle[1] = viewportRectangle[2] = viewportRectangle[3] = -1;
+
+	for (int i = 0; i < MAX_TEXTURE_UNITS; i++)
+	{
+		boundTextures[i] = -1;
+	}
+}
+
+void GLStateCache::setCapability(GLenum capability, bool enabled, TriState& cached)
+{
+	TriState requested = enabled ? ENABLED : DISABLED;
+
+	if (cached == requested)
+	{
+		statistics.skippedCalls++;
+		return;
+	}
+
+	if (enabled)
+	{
+		glEnable(capability);
+	}
+	else
+	{
+		glDisable(capability);
+	}
+
+	cached = requested;
+	statistics.issuedCalls++;
+}
+
+void GLStateCache::apply(const PipelineState& state)
+{
+	setCapability(GL_DEPTH_TEST, state.depthTest, depthTest);
+	setCapability(GL_BLEND, state.blend, blend);
+	setCapability(GL_CULL_FACE, state.cullFace, cullFace);
+
+	// Blend factors are irrelevant while blending is off, so they are left alone until it gets turned on
+	if (state.blend)
+	{
+		if (blendSource != state.blendSource || blendDestination != state.blendDestination)
+		{
+			glBlendFunc(state.blendSource, state.blendDestination);
+			blendSource = state.blendSource;
+			blendDestination = state.blendDestination;
+			statistics.issuedCalls++;
+		}
+		else
+		{
+			statistics.skippedCalls++;
+		}
+	}
+
+	if (polygonFace != state.polygonFace || polygonMode != state.polygonMode)
+	{
+		glPolygonMode(state.polygonFace, state.polygonMode);
+		polygonFace = state.polygonFace;
+		polygonMode = state.polygonMode;
+		statistics.issuedCalls++;
+	}
+	else
+	{
+		statistics.skippedCalls++;
+	}
+
+	// Like the blend factors, the depth function only matters while depth testing is on
+	if (state.depthTest)
+	{
+		if (depthFunction != state.depthFunction)
+		{
+			glDepthFunc(state.depthFunction);
+			depthFunction = state.depthFunction;
+			statistics.issuedCalls++;
+		}
+		else
+		{
+			statistics.skippedCalls++;
+		}
+	}
+
+	setDepthWrite(state.depthWrite);
+	setColorWrite(state.colorWrite);
+}
+
+void GLStateCache::setDepthWrite(bool enabled)
+{
+	TriState requested = enabled ? ENABLED : DISABLED;
+
+	if (depthWrite == requested)
+	{
+		statistics.skippedCalls++;
+		return;
+	}
+
+	glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+	depthWrite = requested;
+	statistics.issuedCalls++;
+}
+
+void GLStateCache::setColorWrite(bool enabled)
+{
+	TriState requested = enabled ? ENABLED : DISABLED;
+
+	if (colorWrite == requested)
+	{
+		statistics.skippedCalls++;
+		return;
+	}
+
+	GLboolean mask = enabled ? GL_TRUE : GL_FALSE;
+	glColorMask(mask, mask, mask, mask);
+	colorWrite = requested;
+	statistics.issuedCalls++;
+}
+
+void GLStateCache::setRasterizerDiscard(bool enabled)
+{
+	setCapability(GL_RASTERIZER_DISCARD, enabled, rasterizerDiscard);
+}
+
+void GLStateCache::clear(GLbitfield mask)
+{
+	if (mask & GL_DEPTH_BUFFER_BIT)
+	{
+		setDepthWrite(true);
+	}
+
+	if (mask & GL_COLOR_BUFFER_BIT)
+	{
+		setColorWrite(true);
+	}
+
+	glClear(mask);
+}
+
+void GLStateCache::activeTexture(GLuint unit)
+{
+	if (activeTextureUnit == (GLint)unit)
+	{
+		statistics.skippedCalls++;
+		return;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + unit);
+	activeTextureUnit = unit;
+	statistics.issuedCalls++;
+}
+
+// Only one target is tracked per unit, which is all the engine uses (GL_TEXTURE_2D)
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	if (unit < MAX_TEXTURE_UNITS && boundTextures[unit] == (GLint)texture)
+	{
+		statistics.skippedCalls++;
+		return;
+	}
+
+	activeTexture(unit);
+	glBindTexture(target, texture);
+	statistics.issuedCalls++;
+
+	if (unit < MAX_TEXTURE_UNITS)
+	{
+		boundTextures[unit] = texture;
+	}
+}
+
+void GLStateCache::bindVertexArray(GLuint vertexArray)
+{
+	if (boundVertexArray == (GLint)vertexArray)
+	{
+		statistics.skippedCalls++;
+		return;
+	}
+
+	glBindVertexArray(vertexArray);
+	boundVertexArray = vertexArray;
+	statistics.issuedCalls++;
+}
+
+void GLStateCache::bindProgramPipeline(GLuint pipeline)
+{
+	if (boundProgramPipeline == (GLint)pipeline)
+	{
+		statistics.skippedCalls++;
+		return;
+	}
+
+	glBindProgramPipeline(pipeline);
+	boundProgramPipeline = pipeline;
+	statistics.issuedCalls++;
+}
+
+void GLStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (viewportRectangle[0] == x && viewportRectangle[1] == y && viewportRectangle[2] == width && viewportRectangle[3] == height)
+	{
+		statistics.skippedCalls++;
+		return;
+	}
+
+	glViewport(x, y, width, height);
+	viewportRectangle[0] = x;
+	viewportRectangle[1] = y;
+	viewportRectangle[2] = width;
+	viewportRectangle[3] = height;
+	statistics.issuedCalls++;
+}
+
+// GL unbinds deleted objects and recycles their names, so deletions go through here to keep the cache from treating a
+// new object that reuses the name as already bound
+void GLStateCache::deleteTexture(GLuint texture)
+{
+	glDeleteTextures(1, &texture);
+
+	for (int i = 0; i < MAX_TEXTURE_UNITS; i++)
+	{
+		if (boundTextures[i] == (GLint)texture)
+		{
+			boundTextures[i] = 0;
+		}
+	}
+}
+
+void GLStateCache::deleteVertexArray(GLuint vertexArray)
+{
+	glDeleteVertexArrays(1, &vertexArray);
+
+	if (boundVertexArray == (GLint)vertexArray)
+	{
+		boundVertexArray = 0;
+	}
+}
+
+void GLStateCache::deleteProgramPipeline(GLuint pipeline)
+{
+	glDeleteProgramPipelines(1, &pipeline);
+
+	if (boundProgramPipeline == (GLint)pipeline)
+	{
+		boundProgramPipeline = 0;
+	}
+}
+
+const GLStateCache::Statistics& GLStateCache::getStatistics(void)
+{
+	return statistics;
+}
+
+void GLStateCache::resetStatistics(void)
+{
+	statistics = Statistics();
+}
\ No newline at end of file
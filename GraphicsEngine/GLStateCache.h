@@ -0,0 +1,79 @@
+#pragma once
+#include "GLDispatch.h"
+
+// Immutable description of the fixed-function state a pipeline draws with. Passes build one per pipeline and hand it to
+// the GLStateCache, which only issues the calls for the fields that differ from what is already set
+struct PipelineState
+{
+	const bool depthTest;
+	const bool blend;
+	const bool cullFace;
+	const GLenum blendSource;
+	const GLenum blendDestination;
+	const GLenum polygonFace;
+	const GLenum polygonMode;
+	const GLenum depthFunction;
+	const bool depthWrite;
+	const bool colorWrite;
+
+	PipelineState(bool depthTest, bool blend, bool cullFace, GLenum polygonFace = GL_FRONT_AND_BACK, GLenum polygonMode = GL_FILL,
+				  GLenum blendSource = GL_SRC_ALPHA, GLenum blendDestination = GL_ONE_MINUS_SRC_ALPHA, GLenum depthFunction = GL_LESS,
+				  bool depthWrite = true, bool colorWrite = true);
+};
+
+// Engine-wide shadow copy of the GL state the engine touches most. Every bind and toggle goes through here so that
+// redundant calls are dropped. Anything that changes this state behind the cache's back must call invalidate()
+class GLStateCache
+{
+public:
+	static const int MAX_TEXTURE_UNITS = 32;
+
+	struct Statistics
+	{
+		unsigned long issuedCalls = 0;
+		unsigned long skippedCalls = 0;
+	};
+private:
+	static GLStateCache* stateCache;
+	enum TriState { UNKNOWN = -1, DISABLED = 0, ENABLED = 1 };
+	TriState depthTest;
+	TriState blend;
+	TriState cullFace;
+	GLenum blendSource;
+	GLenum blendDestination;
+	GLenum polygonFace;
+	GLenum polygonMode;
+	GLenum depthFunction;
+	TriState depthWrite;
+	TriState colorWrite;
+	TriState rasterizerDiscard;
+	GLint activeTextureUnit;
+	GLint boundTextures[MAX_TEXTURE_UNITS];
+	GLint boundVertexArray;
+	GLint boundProgramPipeline;
+	GLint viewportRectangle[4];
+	Statistics statistics;
+	GLStateCache();
+	~GLStateCache() {};
+	void setCapability(GLenum capability, bool enabled, TriState& cached);
+	void setDepthWrite(bool enabled);
+	void setColorWrite(bool enabled);
+public:
+	static GLStateCache* getInstance();
+	void invalidate(void);
+	void apply(const PipelineState& state);
+	// Not part of PipelineState, since only draws that run shaders without producing pixels turn it on
+	void setRasterizerDiscard(bool enabled);
+	// glClear honours the write masks, so the ones the clear needs are turned back on first
+	void clear(GLbitfield mask);
+	void activeTexture(GLuint unit);
+	void bindTexture(GLuint unit, GLenum target, GLuint texture);
+	void bindVertexArray(GLuint vertexArray);
+	void bindProgramPipeline(GLuint pipeline);
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void deleteTexture(GLuint texture);
+	void deleteVertexArray(GLuint vertexArray);
+	void deleteProgramPipeline(GLuint pipeline);
+	const Statistics& getStatistics(void);
+	void resetStatistics(void);
+};
\ No newline at end of file
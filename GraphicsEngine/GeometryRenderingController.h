@@ -17,10 +17,16 @@ protected:
 	bool volumeRendering = true;
 
 	unsigned int lastPick;
+	// Reads the picking buffer synchronously instead of through the readback ring. Only meant as a fallback, it stalls
+	// until the GPU has finished the frame
+	bool blockingPicking = false;
 
 	virtual unsigned int getPickingID(GeometryPass* gP, double xpos, double ypos,
 									  std::string signature = "PICKING0");
 	virtual void updatePicker(GLFWwindow* window, std::string passSignature = "GEOMETRYPASS");
+	virtual void requestRegionPicking(GeometryPass* gP, double x0, double y0, double x1, double y1,
+									  std::vector<glm::ivec2> lasso = std::vector<glm::ivec2>(), std::string signature = "PICKING0");
+	virtual bool getRegionPickingIDs(GeometryPass* gP, std::vector<unsigned int>& ids, std::string signature = "PICKING0");
 	virtual void keyboardRendering(int key, int action);
 };
 
@@ -31,13 +37,21 @@ unsigned int GeometryRenderingController<T, S>::getPickingID(GeometryPass* gP, d
 	auto widthHeight = WindowContext::context->getSize();
 
 	auto picking = (PickingBuffer*)gP->getFrameBuffer(signature);
-	auto data = picking->getValues(xpos, widthHeight.second - ypos);
-	gP->setupOnHover(data[0]);
-	int d = data[0];
+	GLuint id;
 
-	delete[] data;
+	if (blockingPicking)
+	{
+		picking->getValues(xpos, widthHeight.second - ypos, &id);
+		gP->setupOnHover(id);
+
+		return id;
+	}
 
-	return d;
+	// The result lags the cursor by a frame or two. The scene context collects it every frame through
+	// GeometryPass::pollPicking, so this only has to run when the cursor moves
+	picking->requestValue(xpos, widthHeight.second - ypos);
+
+	return picking->getLatestValue();
 };
 
 template<class T, class S>
@@ -56,6 +70,32 @@ void GeometryRenderingController<T, S>::updatePicker(GLFWwindow* window, std::st
 	lastPick = currentPick;
 };
 
+// Box selection between two cursor positions, optionally narrowed to a lasso given in cursor coordinates. The result is
+// collected later through getRegionPickingIDs
+template<class T, class S>
+void GeometryRenderingController<T, S>::requestRegionPicking(GeometryPass* gP, double x0, double y0, double x1, double y1,
+															 std::vector<glm::ivec2> lasso, std::string signature)
+{
+	auto widthHeight = WindowContext::context->getSize();
+
+	for (auto& point : lasso)
+	{
+		point.y = widthHeight.second - point.y;
+	}
+
+	auto picking = (PickingBuffer*)gP->getFrameBuffer(signature);
+	picking->requestRegion(x0, widthHeight.second - y0, x1, widthHeight.second - y1, Controller<T, S>::controller->context->refMan->count,
+						   lasso);
+};
+
+template<class T, class S>
+bool GeometryRenderingController<T, S>::getRegionPickingIDs(GeometryPass* gP, std::vector<unsigned int>& ids, std::string signature)
+{
+	auto picking = (PickingBuffer*)gP->getFrameBuffer(signature);
+
+	return picking->pollRegion(ids);
+};
+
 template<class T, class S>
 void GeometryRenderingController<T, S>::keyboardRendering(int key, int action)
 {
@@ -1,6 +1,9 @@
 #pragma once
 #include "GraphicsObject.h"
+#include "GLStateCache.h"
+#include "AssetArchive.h"
 #include <fstream>
+#include <cstring>
 #include <Importer.hpp>      // C++ importer interface
 #include <scene.h>           // Output data structure
 #include <postprocess.h>     // Post processing fla
@@ -28,23 +31,13 @@ namespace Graphics
 	{
 	}
 
+	// Attribute arrays are enabled while the VAO is bound at upload time and the VAO remembers them, so binding it is
+	// all that's left to do here. The whole chain shares the root's VAO
 	void DecoratedGraphicsObject::enableBuffers(void)
 	{
-		glBindVertexArray(VAO);
+		GLStateCache::getInstance()->bindVertexArray(VAO);
 
 		//	updateIfDirty();
-
-		int index = 0;
-		if (child != nullptr)
-		{
-			index = child->layoutCount;
-			child->enableBuffers();
-		}
-
-		for (int i = index; i < layoutCount; i++)
-		{
-			glEnableVertexAttribArray(i);
-		}
 	}
 
 	std::string DecoratedGraphicsObject::printOwnProperties(void)
@@ -57,6 +50,12 @@ namespace Graphics
 		return model;
 	}
 
+	// First picking GUID of the instances drawn by this chain, 0 unless some decorator derives GUIDs on the GPU
+	unsigned int DecoratedGraphicsObject::getBaseGUID(void)
+	{
+		return child != nullptr ? child->getBaseGUID() : 0;
+	}
+
 	MeshObject::MeshObject() : DecoratedGraphicsObject(nullptr, "VERTEX")
 	{
 		layoutCount = 2;
@@ -73,18 +72,20 @@ namespace Graphics
 	{
 		glDeleteBuffers(1, &VBO);
 		glDeleteBuffers(1, &EBO);
-		glDeleteVertexArrays(1, &VAO);
+		GLStateCache::getInstance()->deleteVertexArray(VAO);
 	}
 
 	void MeshObject::commitVBOToGPU()
 	{
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &(vertices[0]), GL_DYNAMIC_DRAW);
+		Profiler::getInstance()->count(Profiler::UPLOADED_BYTES, vertices.size() * sizeof(Vertex));
 
 		if (indices.size())
 		{
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &(indices[0]), GL_DYNAMIC_DRAW);
+			Profiler::getInstance()->count(Profiler::UPLOADED_BYTES, indices.size() * sizeof(GLuint));
 		}
 
 		glEnableVertexAttribArray(0);
@@ -92,7 +93,7 @@ namespace Graphics
 		glEnableVertexAttribArray(1);
 		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
 
-		glBindVertexArray(0);
+		GLStateCache::getInstance()->bindVertexArray(0);
 
 		commitedVertexCount = vertices.size();
 		commitedIndexCount = indices.size();
@@ -101,7 +102,7 @@ namespace Graphics
 	void MeshObject::bindBuffers(void)
 	{
 		glGenVertexArrays(1, &VAO);
-		glBindVertexArray(VAO);
+		GLStateCache::getInstance()->bindVertexArray(VAO);
 		glGenBuffers(1, &VBO);
 		glGenBuffers(1, &EBO);
 
@@ -110,7 +111,7 @@ namespace Graphics
 
 	void MeshObject::updateBuffers(void)
 	{
-		glBindVertexArray(VAO);
+		GLStateCache::getInstance()->bindVertexArray(VAO);
 		commitVBOToGPU();
 	}
 
@@ -123,13 +124,14 @@ namespace Graphics
 	void MeshObject::draw(void)
 	{
 		glDrawElements(GL_TRIANGLES, commitedIndexCount, GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
 	}
 
 	void MeshObject::updateIfDirty(void)
 	{
 		if (dirty)
 		{
+			PROFILE_ZONE("MeshObject::updateIfDirty", "upload");
+
 			if (vertices.size() != commitedVertexCount || indices.size() != commitedIndexCount)
 			{
 				/*			glBindVertexArray(VAO);
@@ -164,7 +166,13 @@ namespace Graphics
 	ImportedMeshObject::ImportedMeshObject(const char* string) : MeshObject()
 	{
 		loadFile(string);
+		normalizeVertices(vertices);
+		bindBuffers();
+	}
 
+	// Centers the mesh on its average vertex and scales it down
+	void ImportedMeshObject::normalizeVertices(std::vector<Vertex>& vertices)
+	{
 		glm::vec3 avg(0.0f, 0.0f, 0.0f);
 		glm::vec3 minVec(INFINITY, INFINITY, INFINITY);
 		glm::vec3 maxVec(-INFINITY, -INFINITY, -INFINITY);
@@ -197,14 +205,26 @@ namespace Graphics
 			vertices[i].position -= avg;
 			vertices[i].position /= (20.0f * diff.length());
 		}
-
-		bindBuffers();
 	}
 
 	void ImportedMeshObject::loadFile(const char* filePath)
 	{
 		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(filePath, aiProcess_CalcTangentSpace | aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType);
+		unsigned int flags = aiProcess_CalcTangentSpace | aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType;
+		const aiScene* scene = nullptr;
+
+		// Packed meshes are parsed in place, the extension tells Assimp the format
+		if (AssetArchive::getInstance()->contains(filePath))
+		{
+			auto asset = AssetArchive::getInstance()->get(filePath);
+			auto extension = strrchr(filePath, '.');
+			scene = importer.ReadFileFromMemory(asset.data, asset.size, flags, extension != nullptr ? extension + 1 : "");
+		}
+		else
+		{
+			scene = importer.ReadFile(filePath, flags);
+		}
+
 		if (!scene)
 		{
 			return;
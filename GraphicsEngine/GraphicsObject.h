@@ -2,6 +2,8 @@
 #include "Decorator.h"
 #include "glew.h"
 #include "glm.hpp"
+#include "GLStateCache.h"
+#include "Profiler.h"
 
 // Make a factory to avoid creating erroneous patterns!
 // TODO: Add a uniform references array that somehow links to the shader
@@ -39,6 +41,7 @@ namespace Graphics {
 		virtual void updateIfDirty(void) = 0;
 		virtual std::string printOwnProperties(void);
 		glm::mat4 getModelMatrix();
+		virtual unsigned int getBaseGUID(void);
 	};
 
 	class MeshObject : public DecoratedGraphicsObject
@@ -77,13 +80,14 @@ namespace Graphics {
 		ImportedMeshObject(const char* filePath);
 		~ImportedMeshObject() {};
 		void loadFile(const char* filePath);
+		static void normalizeVertices(std::vector<Vertex>& vertices);
 	};
 
 	template <class T, class S> class ExtendedMeshObject : public DecoratedGraphicsObject
 	{
 	public:
 		std::vector<T> extendedData;
-		int commitedExtendedData;
+		size_t commitedExtendedData;
 
 		ExtendedMeshObject() {};
 		ExtendedMeshObject(DecoratedGraphicsObject* child, std::string bufferSignature);
@@ -135,18 +139,19 @@ namespace Graphics {
 		glBindBuffer(GL_ARRAY_BUFFER, DecoratedGraphicsObject::VBO);
 		glBufferData(GL_ARRAY_BUFFER, ExtendedMeshObject<T, S>::extendedData.size() * sizeof(T),
 					 &(ExtendedMeshObject<T, S>::extendedData[0]), GL_DYNAMIC_DRAW);
+		Profiler::getInstance()->count(Profiler::UPLOADED_BYTES, ExtendedMeshObject<T, S>::extendedData.size() * sizeof(T));
 
 		glEnableVertexAttribArray(DecoratedGraphicsObject::layoutCount - 1);
 		glVertexAttribPointer(DecoratedGraphicsObject::layoutCount - 1, sizeof(T) / sizeof(S), GL_FLOAT, GL_FALSE, sizeof(T), (GLvoid*)0);
 
-		glBindVertexArray(0);
+		GLStateCache::getInstance()->bindVertexArray(0);
 
 		commitedExtendedData = ExtendedMeshObject<T, S>::extendedData.size();
 	}
 
 	template <class T, class S> void ExtendedMeshObject<T, S>::bindBuffers(void)
 	{
-		glBindVertexArray(VAO);
+		GLStateCache::getInstance()->bindVertexArray(VAO);
 		glGenBuffers(1, &VBO);
 
 		commitVBOToGPU();
@@ -154,7 +159,7 @@ namespace Graphics {
 
 	template <class T, class S> void ExtendedMeshObject<T, S>::updateBuffers(void)
 	{
-		glBindVertexArray(VAO);
+		GLStateCache::getInstance()->bindVertexArray(VAO);
 
 		commitVBOToGPU();
 	}
@@ -168,9 +173,11 @@ namespace Graphics {
 	{
 		if (dirty)
 		{
+			PROFILE_ZONE("ExtendedMeshObject::updateIfDirty", "upload");
+
 			if (ExtendedMeshObject<T, S>::extendedData.size() != ExtendedMeshObject<T, S>::commitedExtendedData)
 			{
-				glBindVertexArray(VAO);
+				GLStateCache::getInstance()->bindVertexArray(VAO);
 				glDeleteBuffers(1, &VBO);
 
 				glGenBuffers(1, &VBO);
@@ -225,6 +232,7 @@ namespace Graphics {
 		glBindBuffer(GL_ARRAY_BUFFER, DecoratedGraphicsObject::VBO);
 		glBufferData(GL_ARRAY_BUFFER, ExtendedMeshObject<T, S>::extendedData.size() * sizeof(T),
 																&(ExtendedMeshObject<T, S>::extendedData[0]), GL_DYNAMIC_DRAW);
+		Profiler::getInstance()->count(Profiler::UPLOADED_BYTES, ExtendedMeshObject<T, S>::extendedData.size() * sizeof(T));
 
 		auto glType = GL_FLOAT;
 
@@ -241,14 +249,13 @@ namespace Graphics {
 		glVertexAttribPointer(DecoratedGraphicsObject::layoutCount - 1, sizeof(T) / sizeof(S), glType, GL_FALSE, sizeof(T), (GLvoid*)0);
 		glVertexAttribDivisor(DecoratedGraphicsObject::layoutCount - 1, divisor);
 
-		glBindVertexArray(0);
+		GLStateCache::getInstance()->bindVertexArray(0);
 	}
 
 	template <class T, class S> void InstancedMeshObject<T, S>::draw(void)
 	{
 		glDrawElementsInstanced(GL_TRIANGLES, InstancedMeshObject<T, S>::instancedObject->indices.size(), GL_UNSIGNED_INT, 0,
 								ExtendedMeshObject<T, S>::extendedData.size() * divisor);
-		glBindVertexArray(0);
 	}
 #pragma endregion
 
@@ -286,6 +293,7 @@ namespace Graphics {
 		glBindBuffer(GL_ARRAY_BUFFER, DecoratedGraphicsObject::VBO);
 		glBufferData(GL_ARRAY_BUFFER, ExtendedMeshObject<T, S>::extendedData.size() * sizeof(T),
 					 &(ExtendedMeshObject<T, S>::extendedData[0]), GL_DYNAMIC_DRAW);
+		Profiler::getInstance()->count(Profiler::UPLOADED_BYTES, ExtendedMeshObject<T, S>::extendedData.size() * sizeof(T));
 
 		auto glType = GL_FLOAT;
 
@@ -305,7 +313,7 @@ namespace Graphics {
 			glVertexAttribDivisor(i, InstancedMeshObject<T, S>::divisor);
 		}
 
-		glBindVertexArray(0);
+		GLStateCache::getInstance()->bindVertexArray(0);
 	}
 }
 #pragma endregion
\ No newline at end of file
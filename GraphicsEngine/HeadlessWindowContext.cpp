@@ -0,0 +1,85 @@
+#pragma once
+#include "HeadlessWindowContext.h"
+#include <iostream>
+#include <glew.h>
+#include <glfw3.h>
+
+HeadlessWindowContext::HeadlessWindowContext(int width, int height) : width(width), height(height)
+{
+	if (!glfwInit())
+	{
+		std::cerr << "Failed to initialize GLFW" << std::endl;
+		return;
+	}
+
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+	window = glfwCreateWindow(width, height, "HEADLESS", NULL, NULL);
+
+	if (window == NULL)
+	{
+		std::cerr << "Failed to create an offscreen GL 4.5 context." << std::endl;
+		glfwTerminate();
+		return;
+	}
+
+	glfwMakeContextCurrent(window);
+
+	// GLFWWindowContext::initialize leaves an existing context alone, so GLEW is set up here. The benchmark creates this
+	// context before building any pass, which is the first thing that would call it
+	glewExperimental = true;
+
+	if (glewInit() != GLEW_OK)
+	{
+		std::cerr << "Failed to initialize GLEW" << std::endl;
+		glfwDestroyWindow(window);
+		window = nullptr;
+		return;
+	}
+
+	std::cout << "OpenGL Version: " << glGetString(GL_VERSION) << " (" << glGetString(GL_RENDERER) << ")" << std::endl;
+
+	context = this;
+}
+
+HeadlessWindowContext::~HeadlessWindowContext()
+{
+	if (window != nullptr)
+	{
+		glfwDestroyWindow(window);
+	}
+
+	if (context == this)
+	{
+		context = nullptr;
+	}
+}
+
+bool HeadlessWindowContext::isValid(void)
+{
+	return window != nullptr;
+}
+
+std::pair<int, int> HeadlessWindowContext::getScreenResolution()
+{
+	return std::make_pair(width, height);
+}
+
+std::pair<int, int> HeadlessWindowContext::getSize()
+{
+	return std::make_pair(width, height);
+}
+
+std::pair<int, int> HeadlessWindowContext::getPos()
+{
+	return std::make_pair(0, 0);
+}
+
+std::pair<double, double> HeadlessWindowContext::getCursorPos()
+{
+	return std::make_pair(0.0, 0.0);
+}
\ No newline at end of file
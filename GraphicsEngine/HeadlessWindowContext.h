@@ -0,0 +1,23 @@
+#pragma once
+#include "WindowContext.h"
+
+struct GLFWwindow;
+
+// GL 4.5 core context behind a window that is never shown, sized explicitly rather than from the monitor. Used where
+// nothing is presented, such as benchmarks in CI, where it also runs on a software rasterizer (Mesa llvmpipe) under a
+// virtual display
+class HeadlessWindowContext : public WindowContext
+{
+private:
+	int width;
+	int height;
+public:
+	GLFWwindow* window = nullptr;
+	HeadlessWindowContext(int width, int height);
+	~HeadlessWindowContext();
+	bool isValid(void);
+	std::pair<int, int> getScreenResolution() override;
+	std::pair<int, int> getSize() override;
+	std::pair<int, int> getPos() override;
+	std::pair<double, double> getCursorPos() override;
+};
\ No newline at end of file
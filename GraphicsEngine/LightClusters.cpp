@@ -0,0 +1,753 @@
+#pragma once
+#include "LightClusters.h"
+#include "GLStateCache.h"
+#include "Profiler.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHT_CLUSTERS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// uvec4 lightClusterCount and vec4 lightDepthSlicing, ahead of the per cluster offset and count pairs
+	const GLsizeiptr GRID_HEADER_SIZE = 8 * sizeof(GLuint);
+	// Lights binned per task; a multiple of four, so the SIMD groups stay whole
+	const size_t LIGHTS_PER_TASK = 1024;
+
+	// Bit i is set when the sphere reaches the cluster i places after index, in bounds laid out as LightClusters keeps them
+	int touchesClusters(const std::vector<float>* bounds, size_t index, const glm::vec3& center, float radiusSquared)
+	{
+#ifdef LIGHT_CLUSTERS_SSE2
+		__m128 zero = _mm_setzero_ps();
+		__m128 distanceSquared = zero;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			__m128 centerAxis = _mm_set1_ps(center[axis]);
+			__m128 below = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&bounds[axis][index]), centerAxis), zero);
+			__m128 above = _mm_max_ps(_mm_sub_ps(centerAxis, _mm_loadu_ps(&bounds[axis + 3][index])), zero);
+			__m128 distance = _mm_add_ps(below, above);
+			distanceSquared = _mm_add_ps(distanceSquared, _mm_mul_ps(distance, distance));
+		}
+
+		return _mm_movemask_ps(_mm_cmple_ps(distanceSquared, _mm_set1_ps(radiusSquared)));
+#else
+		int mask = 0;
+
+		for (int i = 0; i < 4; i++)
+		{
+			float distanceSquared = 0.0f;
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float distance = std::max(bounds[axis][index + i] - center[axis], 0.0f) + std::max(center[axis] - bounds[axis + 3][index + i], 0.0f);
+				distanceSquared += distance * distance;
+			}
+
+			if (distanceSquared <= radiusSquared)
+			{
+				mask |= 1 << i;
+			}
+		}
+
+		return mask;
+#endif
+	}
+
+	int getTile(float ndc, int tileCount)
+	{
+		return std::min(std::max((int)std::floor((ndc * 0.5f + 0.5f) * tileCount), 0), tileCount - 1);
+	}
+}
+
+// One work group per cluster, its invocations striding over the lights. Matches are gathered in shared memory, so the
+// cluster takes a single contiguous range of the index list
+const char* LightClusters::assignmentSource = R"(layout(local_size_x = 64) in;
+
+struct Light
+{
+	vec4 positionRadius;
+	vec4 colorIntensity;
+};
+
+layout(std430, binding = 4) readonly buffer LightList
+{
+	Light lights[];
+};
+
+layout(std430, binding = 5) buffer LightClusterGrid
+{
+	uvec4 lightClusterCount;
+	vec4 lightDepthSlicing;
+	uvec2 lightClusters[];
+};
+
+layout(std430, binding = 6) buffer LightClusterIndices
+{
+	uint lightIndexCount;
+	uint lightIndices[];
+};
+
+layout(std430, binding = 7) readonly buffer LightClusterBounds
+{
+	vec4 clusterBounds[];
+};
+
+uniform mat4 view;
+uniform uint lightCount;
+
+shared uint clusterLightCount;
+shared uint clusterOffset;
+shared uint clusterLights[MAX_LIGHTS_PER_CLUSTER];
+
+void main()
+{
+	uint cluster = gl_WorkGroupID.x + (gl_WorkGroupID.y + gl_WorkGroupID.z * gl_NumWorkGroups.y) * gl_NumWorkGroups.x;
+	vec3 boundsMin = clusterBounds[2u * cluster].xyz;
+	vec3 boundsMax = clusterBounds[2u * cluster + 1u].xyz;
+
+	if (gl_LocalInvocationIndex == 0u)
+	{
+		clusterLightCount = 0u;
+	}
+
+	barrier();
+
+	for (uint i = gl_LocalInvocationIndex; i < lightCount; i += gl_WorkGroupSize.x)
+	{
+		vec4 positionRadius = lights[i].positionRadius;
+		vec3 center = (view * vec4(positionRadius.xyz, 1.0)).xyz;
+		vec3 distance = max(boundsMin - center, 0.0) + max(center - boundsMax, 0.0);
+
+		if (dot(distance, distance) <= positionRadius.w * positionRadius.w)
+		{
+			uint slot = atomicAdd(clusterLightCount, 1u);
+
+			if (slot < MAX_LIGHTS_PER_CLUSTER)
+			{
+				clusterLights[slot] = i;
+			}
+		}
+	}
+
+	barrier();
+
+	uint count = min(clusterLightCount, MAX_LIGHTS_PER_CLUSTER);
+
+	if (gl_LocalInvocationIndex == 0u)
+	{
+		clusterOffset = atomicAdd(lightIndexCount, count);
+		lightClusters[cluster] = uvec2(clusterOffset, count);
+	}
+
+	barrier();
+
+	for (uint i = gl_LocalInvocationIndex; i < count; i += gl_WorkGroupSize.x)
+	{
+		lightIndices[clusterOffset + i] = clusterLights[i];
+	}
+}
+)";
+
+unsigned int LightClusters::getDefaultThreadCount(void)
+{
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+
+	return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+}
+
+LightClusters::LightClusters(LightList* lightList, int tilesX, int tilesY, int slices, unsigned int threadCount) : lightList(lightList)
+{
+	setGridSize(tilesX, tilesY, slices);
+	setThreadCount(threadCount);
+}
+
+LightClusters::~LightClusters()
+{
+	delete threads;
+
+	GLuint buffers[] = { gridBuffer, indexBuffer, boundsBuffer };
+
+	for (auto buffer : buffers)
+	{
+		if (buffer != 0)
+		{
+			glDeleteBuffers(1, &buffer);
+		}
+	}
+
+	if (pipeline != 0)
+	{
+		GLStateCache::getInstance()->deleteProgramPipeline(pipeline);
+	}
+
+	if (program != 0)
+	{
+		glDeleteProgram(program);
+	}
+}
+
+LightList* LightClusters::getLightList(void)
+{
+	return lightList;
+}
+
+void LightClusters::setLightList(LightList* lightList)
+{
+	this->lightList = lightList;
+}
+
+// Tiles split the camera's viewport evenly whatever its size, so the grid doesn't depend on the resolution
+void LightClusters::setGridSize(int tilesX, int tilesY, int slices)
+{
+	gridSize[0] = std::max(tilesX, 1);
+	gridSize[1] = std::max(tilesY, 1);
+	gridSize[2] = std::max(slices, 1);
+	rowStride = (gridSize[0] + 3) & ~3;
+	gridDirty = true;
+}
+
+void LightClusters::setThreadCount(unsigned int threadCount)
+{
+	delete threads;
+	threads = new ThreadPool(threadCount);
+}
+
+// Near and far plane distances of a perspective or orthographic projection. An infinite far plane gets a finite one
+// far enough out for the slicing
+void LightClusters::getDepthRange(const glm::mat4& projection, float& nearDepth, float& farDepth)
+{
+	if (projection[2][3] != 0.0f)
+	{
+		nearDepth = projection[3][2] / (projection[2][2] - 1.0f);
+		farDepth = projection[3][2] / (projection[2][2] + 1.0f);
+	}
+	else
+	{
+		nearDepth = (projection[3][2] + 1.0f) / projection[2][2];
+		farDepth = (projection[3][2] - 1.0f) / projection[2][2];
+	}
+
+	if (!std::isfinite(farDepth) || farDepth <= nearDepth)
+	{
+		farDepth = std::max(nearDepth, 1e-4f) * 1e5f;
+	}
+}
+
+// Slices divide [near, far] so that each one spans the same ratio of depths, keeping clusters roughly cubic. The slicing
+// starts a little past the camera for orthographic projections, whose near plane may lie at or behind it
+void LightClusters::updateGrid(const glm::mat4& projection)
+{
+	if (!gridDirty && projection == this->projection)
+	{
+		return;
+	}
+
+	this->projection = projection;
+	getDepthRange(projection, projectionNear, farDepth);
+	nearDepth = std::max(projectionNear, farDepth * 1e-5f);
+	farDepth = std::max(farDepth, nearDepth * 2.0f);
+	sliceScale = gridSize[2] / std::log(farDepth / nearDepth);
+	sliceBias = -std::log(nearDepth) * sliceScale;
+
+	size_t clusterCount = (size_t)gridSize[0] * gridSize[1] * gridSize[2];
+	clusterCounts.assign(clusterCount, 0);
+	clusterLights.resize(clusterCount * MAX_LIGHTS_PER_CLUSTER);
+	statistics.clusters = (unsigned int)clusterCount;
+
+	buildBounds();
+	gridDirty = false;
+	boundsUploaded = false;
+}
+
+// A cluster is the part of its tile's frustum between its slice's depths; its view space box is the one around the
+// eight corners. Padding past the end of each row never touches anything
+void LightClusters::buildBounds(void)
+{
+	int tilesX = gridSize[0];
+	int tilesY = gridSize[1];
+	int slices = gridSize[2];
+	size_t size = (size_t)rowStride * tilesY * slices;
+	float infinity = std::numeric_limits<float>::infinity();
+
+	for (int component = 0; component < 6; component++)
+	{
+		bounds[component].assign(size, component < 3 ? infinity : -infinity);
+	}
+
+	// Each tile corner's view ray, from the near to the far plane
+	auto inverseProjection = glm::inverse(projection);
+	std::vector<glm::vec3> nearCorners((tilesX + 1) * (tilesY + 1));
+	std::vector<glm::vec3> farCorners(nearCorners.size());
+
+	for (int y = 0; y <= tilesY; y++)
+	{
+		for (int x = 0; x <= tilesX; x++)
+		{
+			glm::vec2 ndc(2.0f * x / tilesX - 1.0f, 2.0f * y / tilesY - 1.0f);
+			glm::vec4 nearCorner = inverseProjection * glm::vec4(ndc, -1.0f, 1.0f);
+			glm::vec4 farCorner = inverseProjection * glm::vec4(ndc, 1.0f, 1.0f);
+
+			nearCorners[y * (tilesX + 1) + x] = glm::vec3(nearCorner) / nearCorner.w;
+			farCorners[y * (tilesX + 1) + x] = glm::vec3(farCorner) / farCorner.w;
+		}
+	}
+
+	for (int slice = 0; slice < slices; slice++)
+	{
+		float depths[] = { nearDepth * std::pow(farDepth / nearDepth, (float)slice / slices),
+						   nearDepth * std::pow(farDepth / nearDepth, (float)(slice + 1) / slices) };
+
+		for (int y = 0; y < tilesY; y++)
+		{
+			for (int x = 0; x < tilesX; x++)
+			{
+				size_t index = ((size_t)slice * tilesY + y) * rowStride + x;
+
+				for (int corner = 0; corner < 8; corner++)
+				{
+					int cornerIndex = (y + ((corner >> 1) & 1)) * (tilesX + 1) + x + (corner & 1);
+					glm::vec3 nearCorner = nearCorners[cornerIndex];
+					glm::vec3 farCorner = farCorners[cornerIndex];
+					float t = (-depths[corner >> 2] - nearCorner.z) / (farCorner.z - nearCorner.z);
+					glm::vec3 point = nearCorner + t * (farCorner - nearCorner);
+
+					for (int axis = 0; axis < 3; axis++)
+					{
+						bounds[axis][index] = std::min(bounds[axis][index], point[axis]);
+						bounds[axis + 3][index] = std::max(bounds[axis + 3][index], point[axis]);
+					}
+				}
+			}
+		}
+	}
+}
+
+int LightClusters::getSlice(float depth)
+{
+	return std::min(std::max((int)std::floor(std::log(depth) * sliceScale + sliceBias), 0), gridSize[2] - 1);
+}
+
+// Moves lights [first, last) into view space, four at a time with SSE2, then finds the slices and tiles each one's
+// bounds overlap. Lights nothing can see get an empty slice range
+void LightClusters::binLights(size_t first, size_t last)
+{
+	const auto& lights = lightList->lights;
+	float* viewComponents[] = { &lightX[0], &lightY[0], &lightZ[0] };
+	size_t i = first;
+
+#ifdef LIGHT_CLUSTERS_SSE2
+	for (; i + 4 <= last; i += 4)
+	{
+		__m128 x = _mm_set_ps(lights[i + 3].position.x, lights[i + 2].position.x, lights[i + 1].position.x, lights[i].position.x);
+		__m128 y = _mm_set_ps(lights[i + 3].position.y, lights[i + 2].position.y, lights[i + 1].position.y, lights[i].position.y);
+		__m128 z = _mm_set_ps(lights[i + 3].position.z, lights[i + 2].position.z, lights[i + 1].position.z, lights[i].position.z);
+
+		for (int row = 0; row < 3; row++)
+		{
+			__m128 component = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(view[0][row])), _mm_mul_ps(y, _mm_set1_ps(view[1][row]))),
+										  _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(view[2][row])), _mm_set1_ps(view[3][row])));
+			_mm_storeu_ps(viewComponents[row] + i, component);
+		}
+	}
+#endif
+
+	for (; i < last; i++)
+	{
+		glm::vec4 position = view * glm::vec4(lights[i].position, 1.0f);
+
+		for (int row = 0; row < 3; row++)
+		{
+			viewComponents[row][i] = position[row];
+		}
+	}
+
+	for (i = first; i < last; i++)
+	{
+		glm::vec3 center(lightX[i], lightY[i], lightZ[i]);
+		float radius = lights[i].radius;
+		float closest = -center.z - radius;
+		float farthest = -center.z + radius;
+		int* tiles = &tileRanges[4 * i];
+
+		lightRadius[i] = radius;
+
+		if (radius <= 0.0f || farthest < nearDepth || closest > farDepth)
+		{
+			continue;
+		}
+
+		tiles[0] = 0;
+		tiles[1] = gridSize[0] - 1;
+		tiles[2] = 0;
+		tiles[3] = gridSize[1] - 1;
+
+		// The corners of the sphere's box bound its projection, as long as all of them lie in front of the camera.
+		// Spheres reaching the near plane keep every tile
+		if (closest > projectionNear)
+		{
+			glm::vec2 ndcMin(std::numeric_limits<float>::infinity());
+			glm::vec2 ndcMax(-std::numeric_limits<float>::infinity());
+
+			for (int corner = 0; corner < 8; corner++)
+			{
+				glm::vec3 offset(corner & 1 ? radius : -radius, corner & 2 ? radius : -radius, corner & 4 ? radius : -radius);
+				glm::vec4 clip = projection * glm::vec4(center + offset, 1.0f);
+				glm::vec2 ndc = glm::vec2(clip) / clip.w;
+
+				ndcMin = glm::min(ndcMin, ndc);
+				ndcMax = glm::max(ndcMax, ndc);
+			}
+
+			if (ndcMax.x < -1.0f || ndcMax.y < -1.0f || ndcMin.x > 1.0f || ndcMin.y > 1.0f)
+			{
+				continue;
+			}
+
+			tiles[0] = getTile(ndcMin.x, gridSize[0]);
+			tiles[1] = getTile(ndcMax.x, gridSize[0]);
+			tiles[2] = getTile(ndcMin.y, gridSize[1]);
+			tiles[3] = getTile(ndcMax.y, gridSize[1]);
+		}
+
+		sliceMin[i] = getSlice(std::max(closest, nearDepth));
+		sliceMax[i] = getSlice(std::min(farthest, farDepth));
+	}
+}
+
+// Every cluster belongs to exactly one slice, so slices can be filled side by side without synchronisation. The lights
+// binned into the slice are picked four at a time, then tested against the clusters of their tiles four at a time
+void LightClusters::assignSlice(int slice)
+{
+	int tilesX = gridSize[0];
+	int tilesY = gridSize[1];
+	size_t firstCluster = (size_t)slice * tilesX * tilesY;
+
+	std::fill(clusterCounts.begin() + firstCluster, clusterCounts.begin() + firstCluster + tilesX * tilesY, 0);
+
+	auto assignLight = [&](size_t light)
+	{
+		const int* tiles = &tileRanges[4 * light];
+		glm::vec3 center(lightX[light], lightY[light], lightZ[light]);
+		float radiusSquared = lightRadius[light] * lightRadius[light];
+
+		for (int y = tiles[2]; y <= tiles[3]; y++)
+		{
+			size_t row = ((size_t)slice * tilesY + y) * rowStride;
+			size_t rowCluster = firstCluster + (size_t)y * tilesX;
+
+			for (int x = tiles[0] & ~3; x <= tiles[1]; x += 4)
+			{
+				int mask = touchesClusters(bounds, row + x, center, radiusSquared);
+
+				for (int bit = 0; bit < 4; bit++)
+				{
+					if ((mask & (1 << bit)) == 0 || x + bit < tiles[0] || x + bit > tiles[1])
+					{
+						continue;
+					}
+
+					size_t cluster = rowCluster + x + bit;
+					GLuint& count = clusterCounts[cluster];
+
+					if (count < MAX_LIGHTS_PER_CLUSTER)
+					{
+						clusterLights[cluster * MAX_LIGHTS_PER_CLUSTER + count] = (GLuint)light;
+					}
+
+					count++;
+				}
+			}
+		}
+	};
+
+#ifdef LIGHT_CLUSTERS_SSE2
+	__m128i sliceIndex = _mm_set1_epi32(slice);
+
+	for (size_t i = 0; i < sliceMin.size(); i += 4)
+	{
+		__m128i outside = _mm_or_si128(_mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)&sliceMin[i]), sliceIndex),
+									   _mm_cmpgt_epi32(sliceIndex, _mm_loadu_si128((const __m128i*)&sliceMax[i])));
+		int mask = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF;
+
+		for (int bit = 0; mask != 0 && bit < 4; bit++)
+		{
+			if (mask & (1 << bit))
+			{
+				assignLight(i + bit);
+			}
+		}
+	}
+#else
+	for (size_t i = 0; i < lightX.size(); i++)
+	{
+		if (sliceMin[i] <= slice && slice <= sliceMax[i])
+		{
+			assignLight(i);
+		}
+	}
+#endif
+}
+
+// Lists come out in ascending light order, the same from one run to the next whatever the thread count
+void LightClusters::assignCPU(ThreadPool& threadPool)
+{
+	PROFILE_ZONE("LightClusters::assignCPU", "record");
+	auto begin = std::chrono::steady_clock::now();
+	size_t lightCount = lightList->lights.size();
+
+	// Padding lights, up to a multiple of four, have an empty slice range
+	lightX.resize(lightCount);
+	lightY.resize(lightCount);
+	lightZ.resize(lightCount);
+	lightRadius.resize(lightCount);
+	sliceMin.assign((lightCount + 3) & ~(size_t)3, 1);
+	sliceMax.assign(sliceMin.size(), 0);
+	tileRanges.resize(4 * lightCount);
+
+	if (lightCount > 0)
+	{
+		threadPool.parallelFor((lightCount + LIGHTS_PER_TASK - 1) / LIGHTS_PER_TASK, [this, lightCount](size_t task)
+		{
+			binLights(task * LIGHTS_PER_TASK, std::min(lightCount, (task + 1) * LIGHTS_PER_TASK));
+		});
+	}
+
+	threadPool.parallelFor(gridSize[2], [this](size_t slice) { assignSlice((int)slice); });
+
+	size_t clusterCount = clusterCounts.size();
+	GLuint offset = 0;
+	statistics.maxClusterLights = 0;
+	statistics.overflowedClusters = 0;
+	grid.resize(clusterCount);
+
+	for (size_t cluster = 0; cluster < clusterCount; cluster++)
+	{
+		GLuint count = std::min<GLuint>(clusterCounts[cluster], MAX_LIGHTS_PER_CLUSTER);
+
+		grid[cluster] = glm::uvec2(offset, count);
+		offset += count;
+		statistics.maxClusterLights = std::max<unsigned int>(statistics.maxClusterLights, clusterCounts[cluster]);
+
+		if (clusterCounts[cluster] > MAX_LIGHTS_PER_CLUSTER)
+		{
+			statistics.overflowedClusters++;
+		}
+	}
+
+	indices.resize(offset);
+	size_t sliceClusters = (size_t)gridSize[0] * gridSize[1];
+
+	threadPool.parallelFor(gridSize[2], [this, sliceClusters](size_t slice)
+	{
+		for (size_t cluster = slice * sliceClusters; cluster < (slice + 1) * sliceClusters; cluster++)
+		{
+			std::copy_n(clusterLights.begin() + cluster * MAX_LIGHTS_PER_CLUSTER, grid[cluster].y, indices.begin() + grid[cluster].x);
+		}
+	});
+
+	statistics.visibleLights = 0;
+
+	for (size_t i = 0; i < lightCount; i++)
+	{
+		if (sliceMin[i] <= sliceMax[i])
+		{
+			statistics.visibleLights++;
+		}
+	}
+
+	statistics.lightIndices = offset;
+	statistics.assignmentMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void LightClusters::assign(const glm::mat4& view, const glm::mat4& projection, ThreadPool* threadPool)
+{
+	this->view = view;
+	updateGrid(projection);
+
+	// Whether the compute shader builds is only known once upload has tried, on the GL thread
+	pendingCompute = useCompute && (!initialised || computeAvailable);
+
+	if (!pendingCompute)
+	{
+		assignCPU(threadPool != nullptr ? *threadPool : *threads);
+	}
+}
+
+// Compiles the assignment shader on first use. A failed compile or link leaves the clusters on the CPU path for good
+void LightClusters::initialise(void)
+{
+	initialised = true;
+
+	std::string header = "#version 430\n#define MAX_LIGHTS_PER_CLUSTER " + std::to_string(MAX_LIGHTS_PER_CLUSTER) + "u\n";
+	const char* sources[] = { header.c_str(), assignmentSource };
+	program = glCreateShaderProgramv(GL_COMPUTE_SHADER, 2, sources);
+
+	GLint linked = GL_FALSE;
+
+	if (program != 0)
+	{
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	}
+
+	if (linked != GL_TRUE)
+	{
+		std::cout << "LIGHT CLUSTER COMPUTE SHADER UNAVAILABLE, FALLING BACK TO CPU" << std::endl;
+
+		return;
+	}
+
+	viewLocation = glGetUniformLocation(program, "view");
+	lightCountLocation = glGetUniformLocation(program, "lightCount");
+
+	glGenProgramPipelines(1, &pipeline);
+	glUseProgramStages(pipeline, GL_COMPUTE_SHADER_BIT, program);
+
+	computeAvailable = true;
+}
+
+// Storage buffers only ever grow
+void LightClusters::reserve(GLuint& buffer, GLsizeiptr& bufferSize, GLsizeiptr size)
+{
+	if (buffer == 0)
+	{
+		glGenBuffers(1, &buffer);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+
+	if (bufferSize < size)
+	{
+		glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+		bufferSize = size;
+	}
+}
+
+// Leaves the grid buffer bound
+void LightClusters::uploadGridHeader(void)
+{
+	GLuint clusterCount[] = { (GLuint)gridSize[0], (GLuint)gridSize[1], (GLuint)gridSize[2], (GLuint)lightList->lights.size() };
+	GLfloat depthSlicing[] = { sliceScale, sliceBias, nearDepth, farDepth };
+
+	reserve(gridBuffer, gridBufferSize, GRID_HEADER_SIZE + statistics.clusters * sizeof(glm::uvec2));
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(clusterCount), clusterCount);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(clusterCount), sizeof(depthSlicing), depthSlicing);
+}
+
+// The index list is sized for every cluster being full, since how many entries the shader writes isn't known up front
+void LightClusters::dispatchCompute(void)
+{
+	uploadGridHeader();
+
+	GLuint indexCount = 0;
+	reserve(indexBuffer, indexBufferSize, (1 + (GLsizeiptr)statistics.clusters * MAX_LIGHTS_PER_CLUSTER) * sizeof(GLuint));
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &indexCount);
+
+	if (!boundsUploaded)
+	{
+		std::vector<glm::vec4> clusterBounds;
+		clusterBounds.reserve(2 * statistics.clusters);
+
+		for (int row = 0; row < gridSize[1] * gridSize[2]; row++)
+		{
+			for (int x = 0; x < gridSize[0]; x++)
+			{
+				size_t index = (size_t)row * rowStride + x;
+
+				clusterBounds.push_back(glm::vec4(bounds[0][index], bounds[1][index], bounds[2][index], 0.0f));
+				clusterBounds.push_back(glm::vec4(bounds[3][index], bounds[4][index], bounds[5][index], 0.0f));
+			}
+		}
+
+		reserve(boundsBuffer, boundsBufferSize, clusterBounds.size() * sizeof(glm::vec4));
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, clusterBounds.size() * sizeof(glm::vec4), &clusterBounds[0]);
+		boundsUploaded = true;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	bindBuffers();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BOUNDS_BINDING, boundsBuffer);
+	glProgramUniformMatrix4fv(program, viewLocation, 1, GL_FALSE, &view[0][0]);
+	glProgramUniform1ui(program, lightCountLocation, (GLuint)lightList->lights.size());
+
+	GLStateCache::getInstance()->bindProgramPipeline(pipeline);
+	glDispatchCompute(gridSize[0], gridSize[1], gridSize[2]);
+
+	// The lighting shaders read the lists next
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void LightClusters::upload(void)
+{
+	PROFILE_ZONE("LightClusters::upload", "replay");
+
+	lightList->upload();
+
+	if (pendingCompute)
+	{
+		pendingCompute = false;
+
+		if (!initialised)
+		{
+			initialise();
+		}
+
+		if (computeAvailable)
+		{
+			dispatchCompute();
+			return;
+		}
+
+		assignCPU(*threads);
+	}
+
+	if (grid.empty())
+	{
+		return;
+	}
+
+	uploadGridHeader();
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, GRID_HEADER_SIZE, grid.size() * sizeof(glm::uvec2), &grid[0]);
+
+	GLuint indexCount = (GLuint)indices.size();
+	reserve(indexBuffer, indexBufferSize, (1 + indices.size()) * sizeof(GLuint));
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &indexCount);
+
+	if (!indices.empty())
+	{
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), indices.size() * sizeof(GLuint), &indices[0]);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	Profiler::getInstance()->count(Profiler::UPLOADED_BYTES, GRID_HEADER_SIZE + (grid.size() * 2 + 1 + indices.size()) * sizeof(GLuint));
+}
+
+void LightClusters::bindBuffers(void)
+{
+	lightList->bindBuffer();
+
+	if (gridBuffer != 0)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GRID_BINDING, gridBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDEX_BINDING, indexBuffer);
+	}
+}
+
+bool LightClusters::usesCompute(void)
+{
+	return useCompute && computeAvailable;
+}
+
+const LightClusters::Statistics& LightClusters::getStatistics(void)
+{
+	return statistics;
+}
\ No newline at end of file
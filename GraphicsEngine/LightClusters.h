@@ -0,0 +1,108 @@
+#pragma once
+#include <vector>
+#include <glew.h>
+#include "glm.hpp"
+#include "LightList.h"
+#include "ThreadPool.h"
+
+// Splits the view frustum into a grid of clusters (froxels): screen tiles in x and y, slices growing exponentially with
+// depth in z, and lists for every cluster the lights whose sphere reaches it. Lighting shaders find a fragment's
+// cluster from its screen coordinates and view depth and only loop over that list, so their cost follows the lights
+// per pixel rather than the lights in the scene (see the <LightClusters.glsl> shader include).
+// Lists are built on the CPU, in parallel over depth slices with SSE2 where available, or with useCompute set, by a
+// compute shader. Either way they end up in two storage buffers: per cluster offset and count at GRID_BINDING, and the
+// light indices they point into at INDEX_BINDING
+class LightClusters
+{
+public:
+	static const GLuint GRID_BINDING = 5;
+	static const GLuint INDEX_BINDING = 6;
+	// Cluster bounds, only read by the compute path
+	static const GLuint BOUNDS_BINDING = 7;
+	// Lights past this many in a cluster are dropped from it and counted in overflowedClusters
+	static const int MAX_LIGHTS_PER_CLUSTER = 256;
+
+	struct Statistics
+	{
+		unsigned int clusters = 0;
+		// The compute path leaves the ones below at 0, since reading them back would stall
+		unsigned int visibleLights = 0;
+		unsigned int lightIndices = 0;
+		unsigned int maxClusterLights = 0;
+		unsigned int overflowedClusters = 0;
+		double assignmentMilliseconds = 0.0;
+	};
+private:
+	static const char* assignmentSource;
+	LightList* lightList;
+	ThreadPool* threads = nullptr;
+	int gridSize[3];
+	int rowStride = 0;
+	glm::mat4 view;
+	glm::mat4 projection;
+	float projectionNear = 0.0f;
+	float nearDepth = 0.0f;
+	float farDepth = 0.0f;
+	float sliceScale = 0.0f;
+	float sliceBias = 0.0f;
+	bool gridDirty = true;
+	bool boundsUploaded = false;
+	bool pendingCompute = false;
+	// View space cluster bounds, one padded row of tiles after another, component by component for SIMD
+	std::vector<float> bounds[6];
+	// Per light, in view space, for the light being transformed and binned
+	std::vector<float> lightX;
+	std::vector<float> lightY;
+	std::vector<float> lightZ;
+	std::vector<float> lightRadius;
+	std::vector<int> sliceMin;
+	std::vector<int> sliceMax;
+	std::vector<int> tileRanges;
+	std::vector<GLuint> clusterCounts;
+	std::vector<GLuint> clusterLights;
+	std::vector<glm::uvec2> grid;
+	std::vector<GLuint> indices;
+	Statistics statistics;
+	GLuint gridBuffer = 0;
+	GLuint indexBuffer = 0;
+	GLuint boundsBuffer = 0;
+	GLsizeiptr gridBufferSize = 0;
+	GLsizeiptr indexBufferSize = 0;
+	GLsizeiptr boundsBufferSize = 0;
+	GLuint program = 0;
+	GLuint pipeline = 0;
+	GLint viewLocation = -1;
+	GLint lightCountLocation = -1;
+	bool initialised = false;
+	bool computeAvailable = false;
+	static unsigned int getDefaultThreadCount(void);
+	void initialise(void);
+	void reserve(GLuint& buffer, GLsizeiptr& bufferSize, GLsizeiptr size);
+	void updateGrid(const glm::mat4& projection);
+	void buildBounds(void);
+	int getSlice(float depth);
+	void binLights(size_t first, size_t last);
+	void assignSlice(int slice);
+	void assignCPU(ThreadPool& threadPool);
+	void dispatchCompute(void);
+	void uploadGridHeader(void);
+public:
+	bool useCompute = false;
+
+	LightClusters(LightList* lightList, int tilesX = 16, int tilesY = 9, int slices = 24, unsigned int threadCount = getDefaultThreadCount());
+	~LightClusters();
+	LightList* getLightList(void);
+	void setLightList(LightList* lightList);
+	void setGridSize(int tilesX, int tilesY, int slices);
+	void setThreadCount(unsigned int threadCount);
+	// Builds the lists for a camera, on the CPU path right away and on the compute path at the next upload. Doesn't
+	// touch GL, so it can run while a frame is being recorded. threadPool, if given, is used instead of the clusters'
+	// own threads and must not be running anything else
+	void assign(const glm::mat4& view, const glm::mat4& projection, ThreadPool* threadPool = nullptr);
+	// Sends the lights and the lists, dispatching the compute path's assignment. Must run on the GL thread
+	void upload(void);
+	void bindBuffers(void);
+	bool usesCompute(void);
+	const Statistics& getStatistics(void);
+	static void getDepthRange(const glm::mat4& projection, float& nearDepth, float& farDepth);
+};
\ No newline at end of file
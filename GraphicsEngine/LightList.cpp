@@ -0,0 +1,81 @@
+#pragma once
+#include "LightList.h"
+#include "GLStateCache.h"
+#include "Profiler.h"
+
+Light::Light(glm::vec3 position, float radius, glm::vec3 color, float intensity) : position(position), radius(radius), color(color),
+	intensity(intensity)
+{
+}
+
+LightList::~LightList()
+{
+	if (buffer != 0)
+	{
+		glDeleteBuffers(1, &buffer);
+	}
+}
+
+// Returns the light's index, which is also its index in the shaders' light array
+size_t LightList::add(const Light& light)
+{
+	lights.push_back(light);
+	dirty = true;
+
+	return lights.size() - 1;
+}
+
+void LightList::clear(void)
+{
+	lights.clear();
+	dirty = true;
+}
+
+size_t LightList::size(void) const
+{
+	return lights.size();
+}
+
+// The buffer only grows, so lists that shrink and grow back don't reallocate. Must run on the GL thread
+void LightList::upload(void)
+{
+	if (!dirty)
+	{
+		return;
+	}
+
+	dirty = false;
+
+	if (lights.empty())
+	{
+		return;
+	}
+
+	if (buffer == 0)
+	{
+		glGenBuffers(1, &buffer);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+
+	if (bufferLights < lights.size())
+	{
+		glBufferData(GL_SHADER_STORAGE_BUFFER, lights.size() * sizeof(Light), &lights[0], GL_DYNAMIC_DRAW);
+		bufferLights = lights.size();
+	}
+	else
+	{
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lights.size() * sizeof(Light), &lights[0]);
+	}
+
+	Profiler::getInstance()->count(Profiler::UPLOADED_BYTES, lights.size() * sizeof(Light));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void LightList::bindBuffer(void)
+{
+	if (buffer != 0)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_BINDING, buffer);
+	}
+}
\ No newline at end of file
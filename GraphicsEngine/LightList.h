@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <glew.h>
+#include "glm.hpp"
+
+// Point light, laid out as the Light struct of the <LightClusters.glsl> shader include (two std430 vec4s). Its light
+// reaches radius world units and no further
+struct Light
+{
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+	float intensity;
+
+	Light(glm::vec3 position = glm::vec3(0.0f), float radius = 1.0f, glm::vec3 color = glm::vec3(1.0f), float intensity = 1.0f);
+};
+
+static_assert(sizeof(Light) == 8 * sizeof(float), "Light must match its std430 layout");
+
+// Scene lights, in world space, mirrored to a shader storage buffer at BUFFER_BINDING. Like instance data, lights are
+// edited in place and marked dirty; upload() then resends them on the GL thread
+class LightList
+{
+private:
+	GLuint buffer = 0;
+	size_t bufferLights = 0;
+public:
+	static const GLuint BUFFER_BINDING = 4;
+
+	std::vector<Light> lights;
+	bool dirty = true;
+
+	LightList() {};
+	~LightList();
+	size_t add(const Light& light);
+	void clear(void);
+	size_t size(void) const;
+	void upload(void);
+	void bindBuffer(void);
+};
\ No newline at end of file
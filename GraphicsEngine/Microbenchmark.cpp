@@ -0,0 +1,358 @@
+#pragma once
+#include "Microbenchmark.h"
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <regex>
+#include <thread>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+const void* volatile Microbenchmark::sink = nullptr;
+
+Microbenchmark::State::State(unsigned long long maxIterations, long long argument) : maxIterations(maxIterations), argument(argument)
+{
+}
+
+void Microbenchmark::State::startTimers(void)
+{
+	realStart = std::chrono::steady_clock::now();
+	cpuStart = getCPUSeconds();
+}
+
+void Microbenchmark::State::stopTimers(void)
+{
+	realSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - realStart).count();
+	cpuSeconds += getCPUSeconds() - cpuStart;
+}
+
+// Timing starts on the first call, so whatever the benchmark does before its loop is not measured
+bool Microbenchmark::State::keepRunning(void)
+{
+	if (!started)
+	{
+		started = true;
+		startTimers();
+	}
+	else
+	{
+		completedIterations++;
+	}
+
+	if (completedIterations < maxIterations)
+	{
+		return true;
+	}
+
+	if (!paused)
+	{
+		stopTimers();
+	}
+
+	return false;
+}
+
+long long Microbenchmark::State::range(void)
+{
+	return argument;
+}
+
+unsigned long long Microbenchmark::State::getIterations(void)
+{
+	return completedIterations;
+}
+
+void Microbenchmark::State::pauseTiming(void)
+{
+	if (!paused)
+	{
+		stopTimers();
+		paused = true;
+	}
+}
+
+void Microbenchmark::State::resumeTiming(void)
+{
+	if (paused)
+	{
+		startTimers();
+		paused = false;
+	}
+}
+
+void Microbenchmark::State::setItemsProcessed(unsigned long long items)
+{
+	itemsProcessed = items;
+}
+
+void Microbenchmark::State::setBytesProcessed(unsigned long long bytes)
+{
+	bytesProcessed = bytes;
+}
+
+void Microbenchmark::State::setLabel(const std::string& label)
+{
+	this->label = label;
+}
+
+std::vector<Microbenchmark::Registration>& Microbenchmark::getRegistrations(void)
+{
+	static std::vector<Registration> registrations;
+
+	return registrations;
+}
+
+// CPU time of the calling thread, which is the one running the benchmark
+double Microbenchmark::getCPUSeconds(void)
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+	{
+		return 0.0;
+	}
+
+	auto toSeconds = [](const FILETIME& time) { return (((unsigned long long)time.dwHighDateTime << 32) | time.dwLowDateTime) * 1e-7; };
+
+	return toSeconds(kernel) + toSeconds(user);
+#else
+	timespec time;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+
+	return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+}
+
+void Microbenchmark::clobberMemory(void)
+{
+#ifdef _MSC_VER
+	_ReadWriteBarrier();
+#else
+	asm volatile("" : : : "memory");
+#endif
+}
+
+void Microbenchmark::registerBenchmark(const std::string& name, Function function, std::vector<long long> arguments)
+{
+	getRegistrations().push_back({ name, function, arguments });
+}
+
+// Starts from one iteration and grows the count towards the minimum time, at most tenfold per step, reporting the
+// first run that lasts long enough
+Microbenchmark::Result Microbenchmark::runOne(const std::string& name, const Function& function, long long argument, double minSeconds)
+{
+	const unsigned long long maxIterations = 1000000000;
+	unsigned long long iterations = 1;
+
+	while (true)
+	{
+		State state(iterations, argument);
+		function(state);
+
+		if (state.realSeconds >= minSeconds || iterations >= maxIterations)
+		{
+			Result result;
+			result.name = name;
+			result.iterations = state.completedIterations;
+			result.realNanoseconds = state.realSeconds * 1e9 / std::max(state.completedIterations, 1ULL);
+			result.cpuNanoseconds = state.cpuSeconds * 1e9 / std::max(state.completedIterations, 1ULL);
+			result.itemsPerSecond = state.cpuSeconds > 0.0 ? state.itemsProcessed / state.cpuSeconds : 0.0;
+			result.bytesPerSecond = state.cpuSeconds > 0.0 ? state.bytesProcessed / state.cpuSeconds : 0.0;
+			result.label = state.label;
+
+			return result;
+		}
+
+		double multiplier = state.realSeconds > 0.0 ? minSeconds * 1.4 / state.realSeconds : 10.0;
+		auto next = (unsigned long long)(iterations * std::min(multiplier, 10.0));
+		iterations = std::min(std::max(next, iterations + 1), maxIterations);
+	}
+}
+
+std::vector<Microbenchmark::Result> Microbenchmark::run(const std::string& filter, double minSeconds)
+{
+	std::vector<Result> results;
+	std::regex pattern(filter);
+
+	for (const auto& registration : getRegistrations())
+	{
+		auto arguments = registration.arguments;
+
+		if (arguments.empty())
+		{
+			arguments.push_back(0);
+		}
+
+		for (auto argument : arguments)
+		{
+			auto name = registration.arguments.empty() ? registration.name : registration.name + "/" + std::to_string(argument);
+
+			if (std::regex_search(name, pattern))
+			{
+				results.push_back(runOne(name, registration.function, argument, minSeconds));
+			}
+		}
+	}
+
+	return results;
+}
+
+void Microbenchmark::writeJSON(const std::vector<Result>& results, std::ostream& stream)
+{
+	char date[32];
+	auto now = std::time(nullptr);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+	stream << std::setprecision(10);
+	stream << "{" << std::endl;
+	stream << "  \"context\": {" << std::endl;
+	stream << "    \"date\": \"" << date << "\"," << std::endl;
+	stream << "    \"num_cpus\": " << std::thread::hardware_concurrency() << "," << std::endl;
+#ifdef NDEBUG
+	stream << "    \"library_build_type\": \"release\"" << std::endl;
+#else
+	stream << "    \"library_build_type\": \"debug\"" << std::endl;
+#endif
+	stream << "  }," << std::endl;
+	stream << "  \"benchmarks\": [";
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const auto& result = results[i];
+
+		stream << (i > 0 ? "," : "") << std::endl << "    {" << std::endl;
+		stream << "      \"name\": \"" << result.name << "\"," << std::endl;
+		stream << "      \"run_name\": \"" << result.name << "\"," << std::endl;
+		stream << "      \"run_type\": \"iteration\"," << std::endl;
+		stream << "      \"iterations\": " << result.iterations << "," << std::endl;
+		stream << "      \"real_time\": " << result.realNanoseconds << "," << std::endl;
+		stream << "      \"cpu_time\": " << result.cpuNanoseconds << "," << std::endl;
+		stream << "      \"time_unit\": \"ns\"";
+
+		if (result.itemsPerSecond > 0.0)
+		{
+			stream << "," << std::endl << "      \"items_per_second\": " << result.itemsPerSecond;
+		}
+
+		if (result.bytesPerSecond > 0.0)
+		{
+			stream << "," << std::endl << "      \"bytes_per_second\": " << result.bytesPerSecond;
+		}
+
+		if (!result.label.empty())
+		{
+			stream << "," << std::endl << "      \"label\": \"" << result.label << "\"";
+		}
+
+		stream << std::endl << "    }";
+	}
+
+	stream << std::endl << "  ]" << std::endl << "}" << std::endl;
+}
+
+void Microbenchmark::writeTable(const std::vector<Result>& results, std::ostream& stream)
+{
+	size_t nameWidth = 9;
+
+	for (const auto& result : results)
+	{
+		nameWidth = std::max(nameWidth, result.name.size());
+	}
+
+	stream << std::left << std::setw(nameWidth + 2) << "Benchmark" << std::right << std::setw(15) << "Time" << std::setw(15) << "CPU"
+		   << std::setw(13) << "Iterations" << std::endl;
+	stream << std::string(nameWidth + 45, '-') << std::endl;
+
+	for (const auto& result : results)
+	{
+		stream << std::left << std::setw(nameWidth + 2) << result.name << std::right << std::fixed << std::setprecision(0)
+			   << std::setw(12) << result.realNanoseconds << " ns" << std::setw(12) << result.cpuNanoseconds << " ns"
+			   << std::setw(13) << result.iterations;
+
+		if (result.itemsPerSecond > 0.0)
+		{
+			stream << std::setprecision(3) << " items_per_second=" << result.itemsPerSecond / 1e6 << "M/s";
+		}
+
+		if (!result.label.empty())
+		{
+			stream << " " << result.label;
+		}
+
+		stream << std::endl;
+	}
+}
+
+int Microbenchmark::main(int argc, char** argv)
+{
+	std::string filter = ".*";
+	std::string format = "console";
+	std::string outputPath;
+	double minSeconds = 0.5;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		auto equals = argument.find('=');
+		auto name = argument.substr(0, equals);
+		auto value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+		if (name == "--benchmark_filter") filter = value;
+		else if (name == "--benchmark_min_time") minSeconds = std::stod(value);
+		else if (name == "--benchmark_format") format = value;
+		else if (name == "--benchmark_out") outputPath = value;
+		else if (name == "--benchmark_list_tests")
+		{
+			for (const auto& registration : getRegistrations())
+			{
+				if (registration.arguments.empty())
+				{
+					std::cout << registration.name << std::endl;
+				}
+
+				for (auto argument : registration.arguments)
+				{
+					std::cout << registration.name << "/" << argument << std::endl;
+				}
+			}
+
+			return 0;
+		}
+		else
+		{
+			std::cout << "UNKNOWN MICROBENCHMARK OPTION " << argument << std::endl;
+			return 2;
+		}
+	}
+
+	auto results = run(filter, minSeconds);
+
+	if (format == "json")
+	{
+		writeJSON(results, std::cout);
+	}
+	else
+	{
+		writeTable(results, std::cout);
+	}
+
+	if (!outputPath.empty())
+	{
+		std::ofstream output(outputPath, std::ios::out | std::ios::trunc);
+
+		if (!output.is_open())
+		{
+			std::cout << "COULD NOT WRITE " << outputPath << std::endl;
+			return 1;
+		}
+
+		writeJSON(results, output);
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Minimal harness in the manner of Google Benchmark. A benchmark is a function that does its setup, then loops while
+// state.keepRunning(); each registered argument makes a run named "name/argument". The iteration count grows until a
+// run lasts the minimum time, and results are printed as a table or written in Google Benchmark's JSON format, so its
+// compare tools can diff two result files
+class Microbenchmark
+{
+public:
+	class State
+	{
+		friend class Microbenchmark;
+	private:
+		unsigned long long maxIterations;
+		unsigned long long completedIterations = 0;
+		long long argument;
+		bool started = false;
+		bool paused = false;
+		std::chrono::steady_clock::time_point realStart;
+		double cpuStart = 0.0;
+		double realSeconds = 0.0;
+		double cpuSeconds = 0.0;
+		unsigned long long itemsProcessed = 0;
+		unsigned long long bytesProcessed = 0;
+		std::string label;
+		State(unsigned long long maxIterations, long long argument);
+		void startTimers(void);
+		void stopTimers(void);
+	public:
+		bool keepRunning(void);
+		long long range(void);
+		unsigned long long getIterations(void);
+		// Leaves per iteration setup or teardown out of the measurement
+		void pauseTiming(void);
+		void resumeTiming(void);
+		void setItemsProcessed(unsigned long long items);
+		void setBytesProcessed(unsigned long long bytes);
+		void setLabel(const std::string& label);
+	};
+
+	typedef std::function<void(State&)> Function;
+
+	struct Result
+	{
+		std::string name;
+		unsigned long long iterations = 0;
+		double realNanoseconds = 0.0;
+		double cpuNanoseconds = 0.0;
+		double itemsPerSecond = 0.0;
+		double bytesPerSecond = 0.0;
+		std::string label;
+	};
+private:
+	struct Registration
+	{
+		std::string name;
+		Function function;
+		std::vector<long long> arguments;
+	};
+
+	static const void* volatile sink;
+	static std::vector<Registration>& getRegistrations(void);
+	static double getCPUSeconds(void);
+	static Result runOne(const std::string& name, const Function& function, long long argument, double minSeconds);
+public:
+	static void registerBenchmark(const std::string& name, Function function, std::vector<long long> arguments = {});
+	// Runs every benchmark whose full name matches the regular expression
+	static std::vector<Result> run(const std::string& filter = ".*", double minSeconds = 0.5);
+	static void writeJSON(const std::vector<Result>& results, std::ostream& stream);
+	static void writeTable(const std::vector<Result>& results, std::ostream& stream);
+	// Accepts --benchmark_filter, --benchmark_min_time, --benchmark_format (console or json), --benchmark_out and
+	// --benchmark_list_tests
+	static int main(int argc, char** argv);
+
+	// Keeps the compiler from discarding a computed value
+	template <class T> static void doNotOptimize(const T& value);
+	// Keeps the compiler from discarding or reordering pending memory writes
+	static void clobberMemory(void);
+};
+
+template <class T> void Microbenchmark::doNotOptimize(const T& value)
+{
+#ifdef _MSC_VER
+	sink = &value;
+	_ReadWriteBarrier();
+#else
+	asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
\ No newline at end of file
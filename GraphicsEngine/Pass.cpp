@@ -5,6 +5,10 @@
 #include "GeometricalMeshObjects.h"
 #include "FrameBuffer.h"
 #include "ShaderProgramPipeline.h"
+#include "ReferencedGraphicsObject.h"
+#include "Profiler.h"
+#include "DynamicResolution.h"
+#include "LightClusters.h"
 
 Pass::Pass()
 {
@@ -19,10 +23,44 @@ Pass::~Pass()
 {
 }
 
-void Pass::setTimedPassTimeLimit(long time)
+void Pass::setUpdateRate(UpdateRate rate)
 {
-	start = std::chrono::steady_clock::now();
-	isTimedPass = true;
+	updateRate = rate;
+	// Passes that skip frames keep their render targets to themselves, which changes the FrameGraph's allocation
+	invalidateTopology();
+}
+
+void Pass::setFrameInterval(unsigned int interval, unsigned int phase)
+{
+	frameInterval = interval > 0 ? interval : 1;
+	framePhase = phase % frameInterval;
+	setUpdateRate(frameInterval > 1 ? EVERY_NTH_FRAME : EVERY_FRAME);
+}
+
+void Pass::setMaxFrequency(double hertz)
+{
+	minimumMilliseconds = hertz > 0.0 ? 1000.0 / hertz : 0.0;
+	setUpdateRate(hertz > 0.0 ? MAX_FREQUENCY : EVERY_FRAME);
+}
+
+void Pass::setTimedPassTimeLimit(long milliseconds)
+{
+	setMaxFrequency(milliseconds > 0 ? 1000.0 / milliseconds : 0.0);
+}
+
+void Pass::markInputChanged(void)
+{
+	inputChanged = true;
+}
+
+Pass::UpdateRate Pass::getUpdateRate(void)
+{
+	return updateRate;
+}
+
+bool Pass::wasExecutedThisFrame(void)
+{
+	return executedThisFrame;
 }
 
 void Pass::execute(void)
@@ -32,33 +70,109 @@ void Pass::execute(void)
 		return;
 	}
 
-	if (isTimedPass)
+	currentCount = 0;
+
+	// A pass that skips this frame still releases its consumers, which then use its last output
+	executeSingle();
+
+	for (const auto& edge : neighborEdges)
 	{
-		auto end = std::chrono::steady_clock::now();
-		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+		edge->data->destination->execute();
+	}
+}
 
-		if (duration < timedPassTimeLimit)
-			return;
+// Runs only this node, without touching the in-degree counter or propagating to neighbors. Returns false if the pass
+// isn't due this frame
+bool Pass::executeSingle(void)
+{
+	bool due = isDue();
+	advanceFrame(due);
+
+	if (!due)
+	{
+		return false;
 	}
 
-	currentCount = 0;
+	PROFILE_ZONE(signature.c_str(), "pass");
+	Profiler::getInstance()->beginGPUZone(signature.c_str(), "pass");
 
 	executeOwnBehaviour();
+	postExecute();
 
-	for (const auto& func : postExecuteFunctors)
+	Profiler::getInstance()->endGPUZone();
+
+	return true;
+}
+
+// Every pass runs on its first frame, so there is always an output to reuse
+bool Pass::isDue(void)
+{
+	if (!hasExecuted)
 	{
-		func.second();
+		return true;
 	}
 
-	for (const auto& edge : neighborEdges)
+	switch (updateRate)
 	{
-		edge->data->destination->execute();
+	case EVERY_NTH_FRAME:
+		return framesSinceExecution + 1 >= frameInterval;
+	case MAX_FREQUENCY:
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lastExecution).count() >= minimumMilliseconds;
+	case ON_INPUT_CHANGE:
+		if (inputChanged)
+		{
+			return true;
+		}
+
+		// Producers are always decided on earlier in the frame
+		for (const auto& edge : parentEdges)
+		{
+			if (edge->data->source->executedThisFrame)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	default:
+		return true;
 	}
+}
 
-	if (isTimedPass)
+void Pass::advanceFrame(bool executes)
+{
+	executedThisFrame = executes;
+
+	if (!executes)
 	{
-		start = std::chrono::steady_clock::now();
+		framesSinceExecution++;
+		return;
 	}
+
+	// The phase only offsets the runs after the first one
+	framesSinceExecution = hasExecuted ? 0 : framePhase;
+	lastExecution = std::chrono::steady_clock::now();
+	hasExecuted = true;
+	inputChanged = false;
+}
+
+void Pass::postExecute(void)
+{
+	for (const auto& func : postExecuteFunctors)
+	{
+		func.second();
+	}
+}
+
+// Passes that don't know how to record their work defer all of it to replay time
+void Pass::recordCommands(CommandBuffer& commands)
+{
+	commands.callback([this]() { executeOwnBehaviour(); });
+}
+
+bool Pass::hasSideEffects(void)
+{
+	return alwaysExecute || !postExecuteFunctors.empty();
 }
 
 void Pass::registerPostExecuteFunctor(std::string signature, std::function<void()> functor)
@@ -80,7 +194,14 @@ Graphics::DecoratedGraphicsObject* makeQuad(void)
 	return new Graphics::ExtendedMeshObject<glm::vec2, float>(displayQuad, uvMap, "TEXTURECOORD");
 }
 
-Graphics::DecoratedGraphicsObject* RenderPass::quad = makeQuad();
+// Built on first use rather than by a static initializer, so that linking passes in doesn't open a window, and a
+// context made beforehand (e.g. a headless one) is the one the quad is created in
+Graphics::DecoratedGraphicsObject* RenderPass::getQuad(void)
+{
+	static Graphics::DecoratedGraphicsObject* quad = makeQuad();
+
+	return quad;
+}
 
 RenderPass::RenderPass(std::unordered_map<std::string, ShaderProgramPipeline*> shaderPipelines, std::string signature,
 										  DecoratedFrameBuffer* frameBuffer, bool terminal) :
@@ -96,6 +217,14 @@ RenderPass::RenderPass(std::unordered_map<std::string, ShaderProgramPipeline*> s
 		intTypeUniformPointers[pipeline.second->signature] = std::unordered_map<std::string, std::tuple<std::string, GLint*>>();
 		uintTypeUniformValues[pipeline.second->signature] = std::unordered_map<std::string, std::tuple<std::string, GLuint>>();
 	}
+
+	// Passes sampling the targets of scaled passes map their texture coordinates through this
+	setupVec4f(DynamicResolution::getInstance()->resolutionScale, "resolutionScale");
+}
+
+bool RenderPass::hasSideEffects(void)
+{
+	return terminal || Pass::hasSideEffects();
 }
 
 void RenderPass::clearRenderableObjects(const std::string& signature)
@@ -129,73 +258,165 @@ void RenderPass::addRenderableObjects(Graphics::DecoratedGraphicsObject* input,
 
 void RenderPass::addFrameBuffer(DecoratedFrameBuffer* fb)
 {
-	frameBuffers.insert(std::make_pair(fb->signature, fb));
+	frameBuffers[fb->signature] = fb;
+
+	for (auto current = fb; current != nullptr; current = current->child)
+	{
+		frameBufferIndex.emplace(current->signatureID, current);
+	}
 }
 
-void RenderPass::setUniforms(const std::string& programSignature)
+// Only reads pass state, so it is safe to call from a recording thread. Lookups use find() rather than operator[] so
+// concurrent recordings never insert into the maps
+void RenderPass::setUniforms(CommandBuffer& commands, const std::string& programSignature)
 {
-	auto idsByProgram = uniformIDs[programSignature];
+	PROFILE_ZONE("RenderPass::setUniforms", "record");
+
+	auto idsByProgram = uniformIDs.find(programSignature);
 
-	for (const auto& uniformID : idsByProgram)
+	if (idsByProgram == uniformIDs.end())
 	{
-		if (std::get<3>(uniformID.second) == TEXTURE)
-		{
-			int pos = std::get<4>(uniformID.second);
-			glProgramUniform1i(std::get<1>(uniformID.second), std::get<2>(uniformID.second), pos);
-		}
+		return;
 	}
 
-	auto floatPointersByProgram = floatTypeUniformPointers[programSignature];
+	// Sampler units are set on the programs when they are reflected
+	const auto& ids = idsByProgram->second;
+
+	auto floatPointersByProgram = floatTypeUniformPointers.find(programSignature);
 	// IMPLEMENT FOR OTHER DATA TYPES
-	for (const auto& ptr : floatPointersByProgram)
+	if (floatPointersByProgram != floatTypeUniformPointers.end())
 	{
-		auto uID = uniformIDs[programSignature][std::get<0>(ptr.second)];
-
-		if (std::get<3>(uID) == MATRIX4FV)
+		for (const auto& ptr : floatPointersByProgram->second)
 		{
-			glProgramUniformMatrix4fv(std::get<1>(uID), std::get<2>(uID), 1, GL_FALSE, std::get<1>(ptr.second));
+			auto found = ids.equal_range(std::get<0>(ptr.second));
+
+			for (auto id = found.first; id != found.second; id++)
+			{
+				const auto& uID = id->second;
+
+				if (std::get<3>(uID) == MATRIX4FV)
+				{
+					commands.uniformMatrix4fv(std::get<1>(uID), std::get<2>(uID), std::get<1>(ptr.second));
+				}
+				else if (std::get<3>(uID) == VECTOR4FV)
+				{
+					commands.uniform4fv(std::get<1>(uID), std::get<2>(uID), std::get<1>(ptr.second));
+				}
+				else if (std::get<3>(uID) == FLOAT)
+				{
+					commands.uniform1f(std::get<1>(uID), std::get<2>(uID), *std::get<1>(ptr.second));
+				}
+			}
 		}
-		else if (std::get<3>(uID) == VECTOR4FV)
+	}
+
+	auto intPointersByProgram = intTypeUniformPointers.find(programSignature);
+
+	if (intPointersByProgram != intTypeUniformPointers.end())
+	{
+		for (const auto& ptr : intPointersByProgram->second)
 		{
-			glProgramUniform4fv(std::get<1>(uID), std::get<2>(uID), 1, std::get<1>(ptr.second));
+			auto found = ids.equal_range(std::get<0>(ptr.second));
+
+			for (auto id = found.first; id != found.second; id++)
+			{
+				if (std::get<3>(id->second) == VECTOR2IV)
+				{
+					commands.uniform2iv(std::get<1>(id->second), std::get<2>(id->second), std::get<1>(ptr.second));
+				}
+			}
 		}
-		else if (std::get<3>(uID) == FLOAT)
+	}
+
+	auto uintValuesByProgram = uintTypeUniformValues.find(programSignature);
+
+	if (uintValuesByProgram != uintTypeUniformValues.end())
+	{
+		for (const auto& val : uintValuesByProgram->second)
 		{
-			glProgramUniform1fv(std::get<1>(uID), std::get<2>(uID), 1, std::get<1>(ptr.second));
+			auto found = ids.equal_range(std::get<0>(val.second));
+
+			for (auto id = found.first; id != found.second; id++)
+			{
+				if (std::get<3>(id->second) == ONEUI)
+				{
+					commands.uniform1ui(std::get<1>(id->second), std::get<2>(id->second), std::get<1>(val.second));
+				}
+			}
 		}
 	}
+}
+
+void RenderPass::renderObjects(CommandBuffer& commands, const std::string& programSignature)
+{
+	PROFILE_ZONE("RenderPass::renderObjects", "record");
+
+	auto objectsByProgram = renderableObjects.find(programSignature);
+
+	if (objectsByProgram == renderableObjects.end())
+	{
+		return;
+	}
+
+	const auto& objects = objectsByProgram->second;
 
-	auto intPointerByProgram = intTypeUniformPointers[programSignature];
-	for (const auto& ptr : intPointerByProgram)
+	if (objects.size() <= OBJECTS_PER_CHUNK)
 	{
-		auto uID = uniformIDs[programSignature][std::get<0>(ptr.second)];
-		
-		if (std::get<3>(uID) == VECTOR2IV)
+		for (const auto& object : objects)
 		{
-			glProgramUniform2iv(std::get<1>(uID), std::get<2>(uID), 1, std::get<1>(ptr.second));
+			setupObjectwiseUniforms(commands, programSignature, object.first);
+			commands.drawObject(object.second);
 		}
+
+		return;
 	}
 
-	auto uintValuesByProgram = uintTypeUniformValues[programSignature];
-	for (const auto& val : uintValuesByProgram)
-	{
-		auto uID = uniformIDs[programSignature][std::get<0>(val.second)];
+	// The chunks are recorded later as jobs of their own; only their place in the buffer is kept here
+	ObjectChunk* chunk = nullptr;
 
-		if (std::get<3>(uID) == ONEUI)
+	for (const auto& object : objects)
+	{
+		if (chunk == nullptr || chunk->objects.size() == OBJECTS_PER_CHUNK)
 		{
-			glProgramUniform1ui(std::get<1>(uID), std::get<2>(uID), std::get<1>(val.second));
+			chunk = &addObjectChunk(programSignature);
+			commands.executeCommands(&chunk->commands);
 		}
+
+		chunk->objects.emplace_back(&object.first, object.second);
+	}
+}
+
+RenderPass::ObjectChunk& RenderPass::addObjectChunk(const std::string& programSignature)
+{
+	if (objectChunkCount == objectChunks.size())
+	{
+		objectChunks.emplace_back();
 	}
+
+	auto& chunk = objectChunks[objectChunkCount++];
+	chunk.programSignature = &programSignature;
+	chunk.objects.clear();
+	chunk.commands.clear();
+
+	return chunk;
 }
 
-void RenderPass::renderObjects(const std::string& programSignature)
+size_t RenderPass::getRecordingJobCount(void)
 {
-	auto objectsByProgram = renderableObjects[programSignature];
-	for (const auto& object :objectsByProgram)
+	return objectChunkCount;
+}
+
+// Only reads pass state and writes the chunk's own buffer, so chunks of one pass can be recorded side by side
+void RenderPass::recordJob(size_t job)
+{
+	PROFILE_ZONE("RenderPass::recordJob", "record");
+
+	auto& chunk = objectChunks[job];
+
+	for (const auto& object : chunk.objects)
 	{
-		setupObjectwiseUniforms(programSignature, object.first);
-		object.second->enableBuffers();
-		object.second->draw();
+		setupObjectwiseUniforms(chunk.commands, *chunk.programSignature, *object.first);
+		chunk.commands.drawObject(object.second);
 	}
 }
 
@@ -203,7 +424,8 @@ void RenderPass::registerUniforms(void)
 {
 	for (const auto& pipeline : shaderPipelines)
 	{
-		uniformIDs[pipeline.second->signature] = std::unordered_map<std::string, std::tuple<std::string, GLuint, GLuint, UniformType, int>>();
+		auto& ids = uniformIDs[pipeline.second->signature];
+		ids.clear();
 
 		for (const auto& program : pipeline.second->attachedPrograms)
 		{
@@ -211,19 +433,26 @@ void RenderPass::registerUniforms(void)
 			{
 				auto uniformID = uniformIDPair.second;
 
-				uniformIDs[pipeline.second->signature][std::get<0>(uniformID)] = std::make_tuple(
+				ids.emplace(std::get<0>(uniformID), std::make_tuple(
 					std::get<0>(uniformID),
 					program->program,
 					std::get<1>(uniformID),
 					std::get<2>(uniformID),
-					std::get<3>(uniformID));
+					std::get<3>(uniformID)));
 			}
 		}
 	}
 }
 
-void RenderPass::executeOwnBehaviour()
+void RenderPass::refreshProgramBindings(void)
 {
+	registerUniforms();
+}
+
+void RenderPass::bindInputsAndOutputs(void)
+{
+	PROFILE_ZONE("RenderPass::bindInputsAndOutputs", "replay");
+
 	// Set input textures from incoming passes for this stage
 //	std::cout << "PASS: " << signature << std::endl;
 	int count = 0;
@@ -259,30 +488,99 @@ void RenderPass::executeOwnBehaviour()
 		lastBuffer->postDrawBuffers(buff);
 	}
 
+	auto renderScale = DynamicResolution::getInstance()->applyViewport(dynamicResolution);
+
+	for (const auto& fb : frameBufferIndex)
+	{
+		fb.second->renderScale = renderScale;
+	}
+
 //	std::cout << std::endl;
+}
 
-	for (const auto pipeline : shaderPipelines)
+void RenderPass::recordCommands(CommandBuffer& commands)
+{
+	objectChunkCount = 0;
+	commands.callback([this]() { bindInputsAndOutputs(); });
+
+	if (camera != nullptr)
 	{
-		// GL configuration
-		configureGL(pipeline.second->signature);
+		inverseProjection = glm::inverse(camera->Projection);
+		inverseView = glm::inverse(camera->View);
+	}
 
-		// Shader setup
-		pipeline.second->use();
+	recordPipelines(commands);
+}
 
-		// Texture and miscellaneous uniforms setup
-		setUniforms(pipeline.second->signature);
+void RenderPass::recordPipelines(CommandBuffer& commands)
+{
+	for (const auto& pipeline : shaderPipelines)
+	{
+		auto state = [&]()
+		{
+			PROFILE_ZONE("RenderPass::getPipelineState", "record");
+			return getPipelineState(pipeline.second->signature);
+		}();
 
-		// Object rendering
-		renderObjects(pipeline.second->signature);
+		recordPipeline(commands, pipeline.second, pipeline.second->pipeline, state);
 	}
 }
 
+// Draws the renderables of shaderPipeline through pipeline, which is either its own program pipeline or one built
+// from the same programs
+void RenderPass::recordPipeline(CommandBuffer& commands, ShaderProgramPipeline* shaderPipeline, GLuint pipeline, const PipelineState& state)
+{
+	const std::string& programSignature = shaderPipeline->signature;
+
+	// GL configuration
+	commands.setPipelineState(state);
+
+	// Shader setup
+	commands.bindPipeline(pipeline);
+
+	// Texture and miscellaneous uniforms setup
+	setUniforms(commands, programSignature);
+
+	// Object rendering
+	renderObjects(commands, programSignature);
+}
+
+void RenderPass::executeOwnBehaviour()
+{
+	PROFILE_ZONE("RenderPass::executeOwnBehaviour", "pass");
+
+	prepareRecording(nullptr);
+	commandBuffer.clear();
+	recordCommands(commandBuffer);
+
+	for (size_t job = 0; job < getRecordingJobCount(); job++)
+	{
+		recordJob(job);
+	}
+
+	commandBuffer.replay();
+}
+
+void RenderPass::setDynamicResolution(bool dynamicResolution)
+{
+	this->dynamicResolution = dynamicResolution;
+}
+
+bool RenderPass::isDynamicResolution(void)
+{
+	return dynamicResolution;
+}
+
 void RenderPass::setupCamera(Camera* cam)
 {
+	camera = cam;
+
 	for (const auto pipeline : shaderPipelines)
 	{
 		updateFloatPointerBySignature<float>(pipeline.second->signature, "Projection", &(cam->Projection[0][0]));
 		updateFloatPointerBySignature<float>(pipeline.second->signature, "View", &(cam->View[0][0]));
+		updateFloatPointerBySignature<float>(pipeline.second->signature, "InverseProjection", &inverseProjection[0][0]);
+		updateFloatPointerBySignature<float>(pipeline.second->signature, "InverseView", &inverseView[0][0]);
 	}
 }
 
@@ -345,18 +643,21 @@ void RenderPass::addNeighbor(Pass* neighbor, std::vector<std::string> passedFram
 	DirectedGraphNode<Pass>::addNeighbor(neighbor, new DirectedEdge(new RenderEdgeData(this, neighbor, passedFb)));
 }
 
-DecoratedFrameBuffer* RenderPass::getFrameBuffer(std::string signature)
+DecoratedFrameBuffer* RenderPass::getFrameBuffer(const std::string& signature)
 {
-	for (const auto& fbPair : frameBuffers)
-	{
-		auto frameBuffer = fbPair.second;
-		auto foundFb = frameBuffer->signatureLookup(signature);
+	return getFrameBuffer(SignatureRegistry::findID(signature));
+}
 
-		if (foundFb != nullptr)
-		{
-			return foundFb;
-		}
+DecoratedFrameBuffer* RenderPass::getFrameBuffer(SignatureID signatureID)
+{
+	auto found = frameBufferIndex.find(signatureID);
+
+	if (found != frameBufferIndex.end())
+	{
+		return found->second;
 	}
+
+	return nullptr;
 }
 
 GeometryPass::GeometryPass(std::unordered_map<std::string, ShaderProgramPipeline*> shaderPipelines,
@@ -365,11 +666,42 @@ GeometryPass::GeometryPass(std::unordered_map<std::string, ShaderProgramPipeline
 			  int pickingBufferCount,
 			  int stencilBufferCount,
 			  bool terminal,
-			  GLenum clearType) :
-	pickingBufferCount(pickingBufferCount), stencilBufferCount(stencilBufferCount), clearType(clearType),
-	RenderPass(shaderPipelines, signature, frameBuffer, terminal)
+			  GLenum clearType,
+			  GBufferLayout gBufferLayout) :
+	RenderPass(shaderPipelines, signature, frameBuffer, terminal), clearType(clearType), gBufferLayout(gBufferLayout),
+	pickingBufferCount(pickingBufferCount), stencilBufferCount(stencilBufferCount)
 {
+	// Whatever reaches the screen directly has to cover all of it
+	dynamicResolution = !terminal;
 	initFrameBuffers();
+	resolveObjectwiseUniformLocations();
+}
+
+GeometryPass::~GeometryPass()
+{
+	if (depthPrePassQueriesCreated)
+	{
+		for (auto& query : depthPrePassQueries)
+		{
+			glDeleteQueries(2, query.queries);
+		}
+	}
+}
+
+// Resolved here on the GL thread, since recording may happen elsewhere
+void GeometryPass::resolveObjectwiseUniformLocations(void)
+{
+	for (const auto& pipeline : shaderPipelines)
+	{
+		auto vertexProgram = pipeline.second->getProgramByEnum(GL_VERTEX_SHADER);
+
+		if (vertexProgram != nullptr)
+		{
+			modelUniformLocations[pipeline.second->signature] =
+				std::make_pair(vertexProgram->program, vertexProgram->getLocationBySignature("Model"));
+			baseGUIDUniformLocations[pipeline.second->signature] = vertexProgram->getLocationBySignature("baseGUID");
+		}
+	}
 }
 
 void GeometryPass::initFrameBuffers(void)
@@ -382,69 +714,275 @@ void GeometryPass::initFrameBuffers(void)
 	int attachmentNumber = 0;
 	DecoratedFrameBuffer* lastBuffer = nullptr;
 
-	lastBuffer = frameBuffers["COLORS"] =
-		new ImageFrameBuffer(attachmentNumber++, 0, width, height, "COLORS", glm::vec4(), clearType);
-	frameBuffers["NORMALS"] =
-		new ImageFrameBuffer(attachmentNumber++, lastBuffer->FBO, width, height, "NORMALS", glm::vec4(), clearType);
-	frameBuffers["POSITIONS"] =
-		new ImageFrameBuffer(attachmentNumber++, lastBuffer->FBO, width, height, "POSITIONS", glm::vec4(), clearType);
-	frameBuffers["ABS_POSITIONS"] =
-		new ImageFrameBuffer(attachmentNumber++, lastBuffer->FBO, width, height, "ABS_POSITIONS", glm::vec4(), clearType);
+	// G-buffer targets are only sampled by downstream passes within the frame, so they can alias other transient targets.
+	// Picking and stencil buffers are read back on the CPU after the frame and must keep their own storage
+	if (gBufferLayout == COMPACT_GBUFFER)
+	{
+		// 8 bytes of color attachments a pixel instead of 16. Depth is kept whole, since the FBO needs it regardless
+		lastBuffer = new DepthFrameBuffer(0, width, height, "DEPTH");
+		addFrameBuffer(lastBuffer);
+		addFrameBuffer(new ImageFrameBuffer(attachmentNumber++, lastBuffer->FBO, width, height, "COLORS", GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE,
+											glm::vec4(), clearType, true));
+		addFrameBuffer(new ImageFrameBuffer(attachmentNumber++, lastBuffer->FBO, width, height, "NORMALS", GL_RG16, GL_RG, GL_UNSIGNED_SHORT,
+											glm::vec4(), clearType, true));
+	}
+	else
+	{
+		lastBuffer = new ImageFrameBuffer(attachmentNumber++, 0, width, height, "COLORS", glm::vec4(), clearType, true);
+		addFrameBuffer(lastBuffer);
+		addFrameBuffer(new ImageFrameBuffer(attachmentNumber++, lastBuffer->FBO, width, height, "NORMALS", glm::vec4(), clearType, true));
+		addFrameBuffer(new ImageFrameBuffer(attachmentNumber++, lastBuffer->FBO, width, height, "POSITIONS", glm::vec4(), clearType, true));
+		addFrameBuffer(new ImageFrameBuffer(attachmentNumber++, lastBuffer->FBO, width, height, "ABS_POSITIONS", glm::vec4(), clearType, true));
+	}
 
 	for (int i = 0; i < pickingBufferCount; ++i)
 	{
 		std::string key = "PICKING" + std::to_string(i);
-		frameBuffers[key] = new PickingBuffer(attachmentNumber++, lastBuffer->FBO, width, height, key);
+		addFrameBuffer(new PickingBuffer(attachmentNumber++, lastBuffer->FBO, width, height, key));
 	}
 
 	for (int i = 0; i < stencilBufferCount; ++i)
 	{
 		std::string key = "STENCIL" + std::to_string(i);
-		frameBuffers[key] = new PickingBuffer(attachmentNumber++, lastBuffer->FBO, width, height, key);
+		addFrameBuffer(new PickingBuffer(attachmentNumber++, lastBuffer->FBO, width, height, key));
 	}
 }
 
-void GeometryPass::configureGL(const std::string& programSignature)
+GeometryPass::GBufferLayout GeometryPass::getGBufferLayout(void)
 {
-	if (!shaderPipelines[programSignature]->alphaRendered)
+	return gBufferLayout;
+}
+
+// Pipelines drawn after a depth pre-pass only shade the fragments that ended up visible, and leave depth as it is
+PipelineState GeometryPass::getPipelineState(const std::string& programSignature)
+{
+	auto shaderPipeline = shaderPipelines.at(programSignature);
+	bool alpha = shaderPipeline->alphaRendered;
+	GLenum polygonFace = shaderPipeline->cullFace ? GL_FRONT : GL_FRONT_AND_BACK;
+
+	if (usesDepthPrePass(shaderPipeline))
 	{
-		glDisable(GL_BLEND);
-		glEnable(GL_DEPTH_TEST);
+		return PipelineState(true, false, shaderPipeline->cullFace, polygonFace, GL_FILL, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_EQUAL, false);
 	}
-	else
+
+	return PipelineState(!alpha, alpha, shaderPipeline->cullFace, polygonFace);
+}
+
+// Blended pipelines don't write depth to begin with, so there is nothing to lay down for them
+bool GeometryPass::usesDepthPrePass(ShaderProgramPipeline* shaderPipeline)
+{
+	return shaderPipeline->depthPrePass && shaderPipeline->depthOnlyPipeline != 0 && !shaderPipeline->alphaRendered;
+}
+
+// Pre-passed pipelines first draw depth alone through their vertex stages, then shade against it with GL_EQUAL.
+// GL_EQUAL only matches if both draws rasterize identically, which the shared vertex program gives as long as it
+// declares gl_Position invariant. Occlusion queries around both halves count what the pre-pass saved
+void GeometryPass::recordPipelines(CommandBuffer& commands)
+{
+	std::vector<ShaderProgramPipeline*> prePassed;
+
+	for (const auto& pipeline : shaderPipelines)
 	{
-		glEnable(GL_BLEND);
-		glDisable(GL_DEPTH_TEST);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		if (usesDepthPrePass(pipeline.second))
+		{
+			prePassed.push_back(pipeline.second);
+		}
 	}
 
-	if (shaderPipelines[programSignature]->cullFace)
+	if (!prePassed.empty())
 	{
-		glPolygonMode(GL_FRONT, GL_FILL);
-		glEnable(GL_CULL_FACE);
+		commands.callback([this]() { beginDepthPrePassQuery(); });
+
+		for (auto shaderPipeline : prePassed)
+		{
+			GLenum polygonFace = shaderPipeline->cullFace ? GL_FRONT : GL_FRONT_AND_BACK;
+			PipelineState depthOnly(true, false, shaderPipeline->cullFace, polygonFace, GL_FILL, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_LESS,
+									true, false);
+
+			recordPipeline(commands, shaderPipeline, shaderPipeline->depthOnlyPipeline, depthOnly);
+		}
+
+		commands.callback([this]() { beginShadingQuery(); });
+
+		for (auto shaderPipeline : prePassed)
+		{
+			recordPipeline(commands, shaderPipeline, shaderPipeline->pipeline, getPipelineState(shaderPipeline->signature));
+		}
+
+		commands.callback([this]() { endShadingQuery(); });
 	}
-	else
+
+	for (const auto& pipeline : shaderPipelines)
+	{
+		if (!usesDepthPrePass(pipeline.second))
+		{
+			recordPipeline(commands, pipeline.second, pipeline.second->pipeline, getPipelineState(pipeline.second->signature));
+		}
+	}
+}
+
+// Oldest first and without waiting, stopping at the first frame the GPU hasn't finished
+void GeometryPass::collectDepthPrePassQueries(void)
+{
+	for (int i = 0; i < DEPTH_PRE_PASS_QUERY_RING_SIZE; i++)
+	{
+		auto& query = depthPrePassQueries[(nextDepthPrePassQuery + i) % DEPTH_PRE_PASS_QUERY_RING_SIZE];
+
+		if (!query.pending)
+		{
+			continue;
+		}
+
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(query.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (available != GL_TRUE)
+		{
+			return;
+		}
+
+		GLuint64 depthSamples = 0;
+		GLuint64 shadedSamples = 0;
+		glGetQueryObjectui64v(query.queries[0], GL_QUERY_RESULT, &depthSamples);
+		glGetQueryObjectui64v(query.queries[1], GL_QUERY_RESULT, &shadedSamples);
+		query.pending = false;
+
+		depthPrePassStatistics.frames++;
+		depthPrePassStatistics.depthSamples += depthSamples;
+		depthPrePassStatistics.shadedSamples += shadedSamples;
+		depthPrePassStatistics.lastDepthSamples = depthSamples;
+		depthPrePassStatistics.lastShadedSamples = shadedSamples;
+	}
+}
+
+// The three run on the GL thread at replay. A frame finding every query of the ring still in flight goes uncounted
+void GeometryPass::beginDepthPrePassQuery(void)
+{
+	if (!depthPrePassQueriesCreated)
+	{
+		for (auto& query : depthPrePassQueries)
+		{
+			glGenQueries(2, query.queries);
+			query.pending = false;
+		}
+
+		depthPrePassQueriesCreated = true;
+	}
+
+	collectDepthPrePassQueries();
+
+	if (depthPrePassQueries[nextDepthPrePassQuery].pending)
+	{
+		openDepthPrePassQuery = -1;
+		return;
+	}
+
+	openDepthPrePassQuery = nextDepthPrePassQuery;
+	nextDepthPrePassQuery = (nextDepthPrePassQuery + 1) % DEPTH_PRE_PASS_QUERY_RING_SIZE;
+	glBeginQuery(GL_SAMPLES_PASSED, depthPrePassQueries[openDepthPrePassQuery].queries[0]);
+}
+
+void GeometryPass::beginShadingQuery(void)
+{
+	if (openDepthPrePassQuery >= 0)
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		glBeginQuery(GL_SAMPLES_PASSED, depthPrePassQueries[openDepthPrePassQuery].queries[1]);
+	}
+}
+
+void GeometryPass::endShadingQuery(void)
+{
+	if (openDepthPrePassQuery >= 0)
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		depthPrePassQueries[openDepthPrePassQuery].pending = true;
+		openDepthPrePassQuery = -1;
+	}
+}
+
+const GeometryPass::DepthPrePassStatistics& GeometryPass::getDepthPrePassStatistics(void)
+{
+	return depthPrePassStatistics;
+}
+
+void GeometryPass::resetDepthPrePassStatistics(void)
+{
+	depthPrePassStatistics = DepthPrePassStatistics();
+}
+
+void GeometryPass::setupObjectwiseUniforms(CommandBuffer& commands, const std::string& programSignature, const std::string& signature)
+{
+	auto location = modelUniformLocations.find(programSignature);
+
+	if (location == modelUniformLocations.end())
+	{
+		return;
+	}
+
+	auto object = renderableObjects.at(programSignature).at(signature);
+	auto model = object->getModelMatrix();
+	commands.uniformMatrix4fv(location->second.first, location->second.second, &(model[0][0]));
+
+	// Only objects whose picking GUIDs are derived in the shader as baseGUID + gl_InstanceID need the uniform,
+	// GUID 0 is never issued so it marks every other object
+	auto baseGUID = object->getBaseGUID();
+	auto baseGUIDLocation = baseGUIDUniformLocations.at(programSignature);
+
+	if (baseGUID != 0 && baseGUIDLocation != -1)
+	{
+		commands.uniform1ui(location->second.first, baseGUIDLocation, baseGUID);
+	}
+}
+
+// Selection changes since the last frame reach the GPU here, right before the pass draws with them
+void GeometryPass::bindInputsAndOutputs(void)
+{
+	RenderPass::bindInputsAndOutputs();
+
+	if (selectionManager != nullptr)
 	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		glDisable(GL_CULL_FACE);
+		selectionManager->upload();
+		selectionManager->bindBuffer();
 	}
 }
 
-void GeometryPass::setupObjectwiseUniforms(const std::string& programSignature, const std::string& signature)
+void GeometryPass::refreshProgramBindings(void)
 {
-	GLuint p = shaderPipelines[programSignature]->getProgramByEnum(GL_VERTEX_SHADER)->program;
-	glProgramUniformMatrix4fv(p, glGetUniformLocation(p, "Model"), 1, GL_FALSE,
-							  &(renderableObjects[programSignature][signature]->getModelMatrix()[0][0]));
+	RenderPass::refreshProgramBindings();
+	resolveObjectwiseUniformLocations();
+}
+
+void GeometryPass::setSelectionManager(Graphics::SelectionManager* selectionManager)
+{
+	this->selectionManager = selectionManager;
 }
 
 void GeometryPass::setupOnHover(unsigned int id)
 {
+	hoveredID = id;
+
 	for (const auto pipeline : shaderPipelines)
 	{
 		updateValueBySignature<unsigned int>(pipeline.second->signature, "selectedRef", id);
 	}
 }
 
+bool GeometryPass::pollPicking(const std::string& signature)
+{
+	auto picking = dynamic_cast<PickingBuffer*>(getFrameBuffer(signature));
+	GLuint id;
+
+	if (picking == nullptr || !picking->pollValue(id) || id == hoveredID)
+	{
+		return false;
+	}
+
+	setupOnHover(id);
+
+	return true;
+}
+
 IntermediatePass::IntermediatePass(std::unordered_map<std::string, ShaderProgramPipeline*> shaderPipelines,
 								   int pickingBuffers,
 								   const std::string& signature) :
@@ -452,24 +990,21 @@ IntermediatePass::IntermediatePass(std::unordered_map<std::string, ShaderProgram
 {
 	for (const auto& pipeline : renderableObjects)
 	{
-		addRenderableObjects(quad, "DISPLAYQUAD", pipeline.first);
+		addRenderableObjects(getQuad(), "DISPLAYQUAD", pipeline.first);
 	}
 }
 
-void IntermediatePass::configureGL(const std::string& programSignature)
+PipelineState IntermediatePass::getPipelineState(const std::string& programSignature)
 {
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_BLEND);
-	glEnable(GL_CULL_FACE);
-	glPolygonMode(GL_FRONT, GL_FILL);
+	return PipelineState(false, false, true, GL_FRONT);
 }
 
 LightPass::LightPass(std::unordered_map<std::string, ShaderProgramPipeline*> shaderPipelines, bool terminal) :
-	RenderPass(shaderPipelines, "LIGHTPASS", nullptr)
+	RenderPass(shaderPipelines, "LIGHTPASS", nullptr, terminal)
 {
 	if (terminal)
 	{
-		frameBuffers["DEFAULT"] = DefaultFrameBuffer::getInstance();
+		addFrameBuffer(DefaultFrameBuffer::getInstance());
 	}
 	else
 	{
@@ -478,7 +1013,7 @@ LightPass::LightPass(std::unordered_map<std::string, ShaderProgramPipeline*> sha
 	
 	for (const auto& pipeline : renderableObjects)
 	{
-		addRenderableObjects(quad, "DISPLAYQUAD", pipeline.first);
+		addRenderableObjects(getQuad(), "DISPLAYQUAD", pipeline.first);
 	}
 }
 
@@ -487,34 +1022,58 @@ LightPass::LightPass(std::unordered_map<std::string, ShaderProgramPipeline*> sha
 {
 	for (const auto& pipeline : renderableObjects)
 	{
-		addRenderableObjects(quad, "DISPLAYQUAD", pipeline.first);
+		addRenderableObjects(getQuad(), "DISPLAYQUAD", pipeline.first);
 	}
 }
 
 void LightPass::initFrameBuffers(void)
 {
 	auto widthHeight = WindowContext::context->getSize();
-	frameBuffers["MAINIMAGE"] = new ImageFrameBuffer(widthHeight.first, widthHeight.second, "MAINIMAGE", glm::vec4(), GL_COLOR_BUFFER_BIT);
+	addFrameBuffer(new ImageFrameBuffer(widthHeight.first, widthHeight.second, "MAINIMAGE", glm::vec4(), GL_COLOR_BUFFER_BIT, true));
+}
+
+PipelineState LightPass::getPipelineState(const std::string& programSignature)
+{
+	return PipelineState(depthTest, false, true, GL_FRONT);
+}
+
+void LightPass::setDepthTest(bool dT)
+{
+	depthTest = dT;
 }
 
-void LightPass::configureGL(const std::string& programSignature)
+// Assignment fans out over the recording threads before any pass records, rather than starting threads of its own
+// from inside a recording
+void LightPass::prepareRecording(ThreadPool* threads)
 {
-	if (depthTest)
+	if (lightClusters != nullptr && camera != nullptr)
 	{
-		glEnable(GL_DEPTH_TEST);
-		
+		lightClusters->assign(camera->View, camera->Projection, threads);
 	}
-	else
+}
+
+// Only the upload waits for the GL thread
+void LightPass::recordCommands(CommandBuffer& commands)
+{
+	if (lightClusters != nullptr && camera != nullptr)
 	{
-		glDisable(GL_DEPTH_TEST);
+		auto clusters = lightClusters;
+		commands.callback([clusters]()
+		{
+			clusters->upload();
+			clusters->bindBuffers();
+		});
 	}
 
-	glDisable(GL_BLEND);
-	glEnable(GL_CULL_FACE);
-	glPolygonMode(GL_FRONT, GL_FILL);
+	RenderPass::recordCommands(commands);
 }
 
-void LightPass::setDepthTest(bool dT)
+void LightPass::setLightClusters(LightClusters* lightClusters)
 {
-	depthTest = dT;
+	this->lightClusters = lightClusters;
+}
+
+LightClusters* LightPass::getLightClusters(void)
+{
+	return lightClusters;
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "DirectedGraphNode.h"
 #include "GraphicsObject.h"
 #include "ShaderProgram.h"
+#include "CommandBuffer.h"
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
@@ -11,38 +12,87 @@
 #include <tuple>
 #include <chrono>
 #include <functional>
+#include <deque>
 
 class ShaderProgramPipeline;
 class CLKernel;
 class AbstractCLBuffer;
 class DecoratedFrameBuffer;
+class ThreadPool;
 class Observer;
+class FrameGraph;
+class LightClusters;
+
+namespace Graphics
+{
+	class SelectionManager;
+}
 
 class Pass : public DirectedGraphNode<Pass>
 {
+	friend class FrameGraph;
+public:
+	// How often a pass runs. In the frames it skips, consumers sample whatever it rendered last
+	enum UpdateRate { EVERY_FRAME, EVERY_NTH_FRAME, MAX_FREQUENCY, ON_INPUT_CHANGE };
 protected:
 	int currentCount = 0;
-	bool isTimedPass = false;
-	long timedPassTimeLimit = 0;
-	std::chrono::time_point<std::chrono::steady_clock> start;
+	UpdateRate updateRate = EVERY_FRAME;
+	unsigned int frameInterval = 1;
+	unsigned int framePhase = 0;
+	double minimumMilliseconds = 0.0;
+	unsigned int framesSinceExecution = 0;
+	bool hasExecuted = false;
+	bool inputChanged = false;
+	bool executedThisFrame = false;
+	std::chrono::time_point<std::chrono::steady_clock> lastExecution;
 	std::unordered_map<std::string, ShaderProgramPipeline*> shaderPipelines;
 	std::unordered_map<std::string, std::function<void()>> postExecuteFunctors;
 
 	virtual void executeOwnBehaviour() = 0;
+	virtual bool hasSideEffects(void);
 public:
+	// Keeps the pass from being culled by a FrameGraph even if nothing downstream consumes its outputs
+	bool alwaysExecute = false;
 	Pass();
 	Pass(std::unordered_map<std::string, ShaderProgramPipeline*> shaderPipelines, std::vector<Pass*> neighbors, std::string signature);
 	Pass(std::unordered_map<std::string, ShaderProgramPipeline*> shaderPipelines, std::string signature);
-	~Pass();
+	virtual ~Pass();
 	virtual void execute(void);
-	virtual void setTimedPassTimeLimit(long time);
+	virtual bool executeSingle(void);
+	virtual bool isDue(void);
+	// Called once per frame for every scheduled pass, after deciding whether it runs
+	virtual void advanceFrame(bool executes);
+	virtual void postExecute(void);
+	// Records this pass' work without issuing GL calls, so it may run on a worker thread. Replaying the buffer on the
+	// GL thread is equivalent to executeOwnBehaviour
+	virtual void recordCommands(CommandBuffer& commands);
+	// Runs on the frame's thread before any pass records, for CPU work that fans out over threads itself. threads is
+	// the pool recording runs on, idle at this point, or null outside a FrameGraph
+	virtual void prepareRecording(ThreadPool*) {};
+	// Pieces of work recordCommands split off, recorded once it has returned. They may run on any thread, concurrently
+	// with each other, and their commands must already be referenced from the pass' buffer
+	virtual size_t getRecordingJobCount(void) { return 0; };
+	virtual void recordJob(size_t) {};
+	virtual void setUpdateRate(UpdateRate rate);
+	// Runs on one frame out of every interval, the phase staggering passes that share an interval
+	virtual void setFrameInterval(unsigned int interval, unsigned int phase = 0);
+	virtual void setMaxFrequency(double hertz);
+	// Same as setMaxFrequency(1000.0 / milliseconds)
+	virtual void setTimedPassTimeLimit(long milliseconds);
+	// Has an ON_INPUT_CHANGE pass run on the next frame even if none of its producers did
+	virtual void markInputChanged(void);
+	UpdateRate getUpdateRate(void);
+	bool wasExecutedThisFrame(void);
 	virtual void registerPostExecuteFunctor(std::string signature, std::function<void()> functor);
+	// Re-reads program handles and uniform locations after a shader hot reload, before the next frame is recorded
+	virtual void refreshProgramBindings(void) {};
 };
 
 class RenderPass : public Pass
 {
+	friend class FrameGraph;
 protected:
-	static Graphics::DecoratedGraphicsObject* quad;
+	static Graphics::DecoratedGraphicsObject* getQuad(void);
 
 	class RenderEdgeData : public DirectedGraphNode<Pass>::EdgeData
 	{
@@ -53,18 +103,47 @@ protected:
 			DirectedGraphNode<Pass>::EdgeData(source, destination) {};
 	};
 
-	std::unordered_map<std::string, std::unordered_map<std::string, std::tuple<std::string, GLuint, GLuint, UniformType, int>>> uniformIDs;
+	// A uniform active in several stages has an entry for each of their programs, all set together
+	std::unordered_map<std::string, std::unordered_multimap<std::string, std::tuple<std::string, GLuint, GLuint, UniformType, int>>> uniformIDs;
 	std::unordered_map<std::string, std::unordered_map<std::string, std::tuple<std::string, GLfloat*>>> floatTypeUniformPointers;
 	std::unordered_map<std::string, std::unordered_map<std::string, std::tuple<std::string, GLuint*>>> uintTypeUniformPointers;
 	std::unordered_map<std::string, std::unordered_map<std::string, std::tuple<std::string, GLint*>>> intTypeUniformPointers;
 	std::unordered_map<std::string, std::unordered_map<std::string, std::tuple<std::string, GLuint>>> uintTypeUniformValues;
 	std::unordered_map<std::string, std::unordered_map<std::string, Graphics::DecoratedGraphicsObject*>> renderableObjects;
+
+	// Run of objects of one pipeline recorded as a job of its own
+	struct ObjectChunk
+	{
+		const std::string* programSignature;
+		std::vector<std::pair<const std::string*, Graphics::DecoratedGraphicsObject*>> objects;
+		CommandBuffer commands;
+	};
+
+	// Pipelines with more objects than this split them into chunks of this size
+	static const size_t OBJECTS_PER_CHUNK = 64;
+	// Kept from frame to frame, and a deque so the buffers recorded commands point at never move
+	std::deque<ObjectChunk> objectChunks;
+	size_t objectChunkCount = 0;
+	// Every frame buffer owned by this pass, including the inner links of decorated chains
+	std::unordered_map<SignatureID, DecoratedFrameBuffer*> frameBufferIndex;
 	bool terminal;
+	// Whether the pass renders at the DynamicResolution scale rather than the full output resolution
+	bool dynamicResolution = false;
+	// Refreshed from the camera every recording, for passes that rebuild positions from depth
+	Camera* camera = nullptr;
+	glm::mat4 inverseProjection;
+	glm::mat4 inverseView;
+	CommandBuffer commandBuffer;
 	virtual void initFrameBuffers(void) = 0;
-	virtual void configureGL(const std::string& programSignature) {};
-	virtual void renderObjects(const std::string& programSignature);
-	virtual void setupObjectwiseUniforms(const std::string& programSignature, const std::string& signature) {};
+	virtual PipelineState getPipelineState(const std::string& programSignature) { return PipelineState(true, false, false); };
+	virtual void bindInputsAndOutputs(void);
+	virtual void recordPipelines(CommandBuffer& commands);
+	void recordPipeline(CommandBuffer& commands, ShaderProgramPipeline* shaderPipeline, GLuint pipeline, const PipelineState& state);
+	virtual void renderObjects(CommandBuffer& commands, const std::string& programSignature);
+	ObjectChunk& addObjectChunk(const std::string& programSignature);
+	virtual void setupObjectwiseUniforms(CommandBuffer&, const std::string&, const std::string&) {};
 	virtual void executeOwnBehaviour(void);
+	bool hasSideEffects(void) override;
 public:
 	bool clearBuff = true;
 	std::unordered_map<std::string, DecoratedFrameBuffer*> frameBuffers;
@@ -80,19 +159,26 @@ public:
 	virtual void addRenderableObjects(Graphics::DecoratedGraphicsObject* input, const std::string& signature,
 									  const std::string& programSignature);
 	virtual void setProbe(const std::string& passSignature, const std::string& frameBufferSignature) {};
+	void setDynamicResolution(bool dynamicResolution);
+	bool isDynamicResolution(void);
 	virtual void addFrameBuffer(DecoratedFrameBuffer* fb);
 	virtual void registerUniforms(void);
+	void refreshProgramBindings(void) override;
 	template<typename T> void updateFloatPointerBySignature(const std::string& programSignature, std::string signature, T* pointer);
 	template<typename T> void updateIntPointerBySignature(const std::string& programSignature, std::string signature, T* pointer);
 	template<typename T> void updateValueBySignature(const std::string& programSignature, std::string signature, T value);
-	virtual void setUniforms(const std::string& programSignature);
+	virtual void setUniforms(CommandBuffer& commands, const std::string& programSignature);
+	void recordCommands(CommandBuffer& commands) override;
+	size_t getRecordingJobCount(void) override;
+	void recordJob(size_t job) override;
 	virtual void setupCamera(Camera* cam);
 	virtual void setupVec4f(glm::vec4& input, std::string name);
 	virtual void setupVec2i(glm::ivec2& input, std::string name);
 	virtual void setupFloat(float* input, std::string name);
 	using Pass::addNeighbor;
 	virtual void addNeighbor(Pass* neighbor, std::vector<std::string> passedFrameBufferSignatures);
-	virtual DecoratedFrameBuffer* getFrameBuffer(std::string signature);
+	virtual DecoratedFrameBuffer* getFrameBuffer(const std::string& signature);
+	virtual DecoratedFrameBuffer* getFrameBuffer(SignatureID signatureID);
 };
 
 // IMPLEMENT FOR OTHER TYPES!!!
@@ -140,11 +226,53 @@ template<typename T> void RenderPass::updateValueBySignature(const std::string&
 
 class GeometryPass : public RenderPass
 {
+public:
+	// FULL_GBUFFER writes COLORS, NORMALS, POSITIONS and ABS_POSITIONS. COMPACT_GBUFFER writes COLORS as RGBA8, NORMALS
+	// octahedral encoded in RG16 and a sampled DEPTH texture, from which readers rebuild both positions (see the
+	// <GBuffer.glsl> shader include)
+	enum GBufferLayout { FULL_GBUFFER, COMPACT_GBUFFER };
+
+	// Occlusion query totals for the pipelines drawn with a depth pre-pass. Without the pre-pass, fragment shaders would
+	// have run for depthSamples; with it, they ran for shadedSamples
+	struct DepthPrePassStatistics
+	{
+		unsigned long long frames = 0;
+		unsigned long long depthSamples = 0;
+		unsigned long long shadedSamples = 0;
+		unsigned long long lastDepthSamples = 0;
+		unsigned long long lastShadedSamples = 0;
+	};
+
+	static const int DEPTH_PRE_PASS_QUERY_RING_SIZE = 3;
 protected:
+	struct DepthPrePassQuery
+	{
+		GLuint queries[2];
+		bool pending;
+	};
+
 	GLenum clearType;
+	GBufferLayout gBufferLayout;
+	DepthPrePassQuery depthPrePassQueries[DEPTH_PRE_PASS_QUERY_RING_SIZE];
+	bool depthPrePassQueriesCreated = false;
+	int nextDepthPrePassQuery = 0;
+	int openDepthPrePassQuery = -1;
+	DepthPrePassStatistics depthPrePassStatistics;
+	std::unordered_map<std::string, std::pair<GLuint, GLint>> modelUniformLocations;
+	std::unordered_map<std::string, GLint> baseGUIDUniformLocations;
+	Graphics::SelectionManager* selectionManager = nullptr;
+	unsigned int hoveredID = 0;
+	void resolveObjectwiseUniformLocations(void);
 	virtual void initFrameBuffers(void);
-	virtual void configureGL(const std::string& programSignature);
-	void setupObjectwiseUniforms(const std::string& programSignature, const std::string& signature) override;
+	virtual void bindInputsAndOutputs(void);
+	virtual PipelineState getPipelineState(const std::string& programSignature);
+	void setupObjectwiseUniforms(CommandBuffer& commands, const std::string& programSignature, const std::string& signature) override;
+	bool usesDepthPrePass(ShaderProgramPipeline* shaderPipeline);
+	void recordPipelines(CommandBuffer& commands) override;
+	void collectDepthPrePassQueries(void);
+	void beginDepthPrePassQuery(void);
+	void beginShadingQuery(void);
+	void endShadingQuery(void);
 public:
 	int pickingBufferCount;
 	int stencilBufferCount;
@@ -154,15 +282,24 @@ public:
 				 int pickingBufferCount = 0,
 				 int stencilBufferCount = 0,
 				 bool terminal = false,
-				 GLenum clearType = GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	~GeometryPass() {};
+				 GLenum clearType = GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT,
+				 GBufferLayout gBufferLayout = FULL_GBUFFER);
+	~GeometryPass();
+	GBufferLayout getGBufferLayout(void);
+	const DepthPrePassStatistics& getDepthPrePassStatistics(void);
+	void resetDepthPrePassStatistics(void);
 	virtual void setupOnHover(unsigned int id);
+	// Collects finished hover reads from the picking buffer and hovers the latest ID. Returns true if that changed the
+	// hovered ID. Meant to run once a frame, whether or not the cursor moved
+	bool pollPicking(const std::string& signature = "PICKING0");
+	void setSelectionManager(Graphics::SelectionManager* selectionManager);
+	void refreshProgramBindings(void) override;
 };
 
 class IntermediatePass : public GeometryPass
 {
 protected:
-	virtual void configureGL(const std::string& programSignature);
+	virtual PipelineState getPipelineState(const std::string& programSignature);
 public:
 	IntermediatePass(std::unordered_map<std::string, ShaderProgramPipeline*> shaderPipelines,
 					 int pickingBuffers,
@@ -170,17 +307,24 @@ public:
 	~IntermediatePass() {};
 };
 
+// With light clusters set, every frame assigns their lights to the camera's clusters before drawing, and binds the
+// lists for the pipelines' <LightClusters.glsl> include
 class LightPass : public RenderPass
 {
 protected:
 	bool depthTest = false;
+	LightClusters* lightClusters = nullptr;
 	virtual void initFrameBuffers(void);
-	virtual void configureGL(const std::string& programSignature);
+	virtual PipelineState getPipelineState(const std::string& programSignature);
+	void prepareRecording(ThreadPool* threads) override;
+	void recordCommands(CommandBuffer& commands) override;
 public:
 	LightPass(std::unordered_map<std::string, ShaderProgramPipeline*> shaderPipelines, bool terminal = false);
 	LightPass(std::unordered_map<std::string, ShaderProgramPipeline*> shaderPipelines,
 			  DecoratedFrameBuffer* frameBuffer);
 	~LightPass() {};
 	virtual void setDepthTest(bool dT);
+	void setLightClusters(LightClusters* lightClusters);
+	LightClusters* getLightClusters(void);
 };
 
@@ -0,0 +1,337 @@
+#pragma once
+#include "Profiler.h"
+#include <fstream>
+#include <cstring>
+
+// Profile zones can be the first to ask from any thread; a function local static is only ever created once
+Profiler* Profiler::getInstance()
+{
+	static Profiler* profiler = new Profiler();
+
+	return profiler;
+}
+
+Profiler::Profiler() : enabled(false), nextSequence(0), slots(new Slot[EVENT_CAPACITY]), epoch(std::chrono::steady_clock::now())
+{
+	for (size_t i = 0; i < EVENT_CAPACITY; i++)
+	{
+		slots[i].sequence.store(0, std::memory_order_relaxed);
+	}
+
+	resetCounters();
+}
+
+Profiler::~Profiler()
+{
+	for (auto& zone : gpuZones)
+	{
+		glDeleteQueries(2, zone.queries);
+	}
+}
+
+// Small, stable numbers make for a readable trace
+unsigned int Profiler::getThreadID(void)
+{
+	static std::atomic<unsigned int> nextThreadID(1);
+	thread_local unsigned int threadID = nextThreadID++;
+
+	return threadID;
+}
+
+void Profiler::copyName(char* destination, const char* name)
+{
+	strncpy(destination, name, sizeof(Event::name) - 1);
+	destination[sizeof(Event::name) - 1] = '\0';
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+	this->enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Profiler::isEnabled(void)
+{
+	return enabled.load(std::memory_order_relaxed);
+}
+
+// Nanoseconds since the profiler was created, the time base of every event
+long long Profiler::now(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+// Claims the next slot with a single atomic increment. Readers skip slots whose sequence is 0 or changes while they
+// copy them, so a half written event is never reported
+void Profiler::record(const char* name, const char* category, Track track, unsigned int threadID, long long startNanoseconds,
+					  long long durationNanoseconds)
+{
+	auto sequence = nextSequence.fetch_add(1, std::memory_order_relaxed);
+	auto& slot = slots[sequence % EVENT_CAPACITY];
+
+	slot.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	copyName(slot.event.name, name);
+	slot.event.category = category;
+	slot.event.track = track;
+	slot.event.threadID = threadID;
+	slot.event.startNanoseconds = startNanoseconds;
+	slot.event.durationNanoseconds = durationNanoseconds;
+
+	slot.sequence.store(sequence + 1, std::memory_order_release);
+}
+
+// Brackets GL work with two timestamp queries. Zones nest, and are ended in reverse order
+void Profiler::beginGPUZone(const char* name, const char* category)
+{
+	if (!isEnabled())
+	{
+		return;
+	}
+
+	if (gpuZones.empty())
+	{
+		gpuZones.resize(GPU_ZONE_CAPACITY);
+
+		for (auto& zone : gpuZones)
+		{
+			glGenQueries(2, zone.queries);
+			zone.pending = false;
+		}
+	}
+
+	auto index = nextGPUZone++ % GPU_ZONE_CAPACITY;
+	auto& zone = gpuZones[index];
+
+	// Only happens if results haven't been collected for a whole ring's worth of zones
+	if (zone.pending)
+	{
+		collectGPUZone(zone, true);
+	}
+
+	copyName(zone.name, name);
+	zone.category = category;
+	glQueryCounter(zone.queries[0], GL_TIMESTAMP);
+
+	openGPUZones.push_back(index);
+}
+
+void Profiler::endGPUZone(void)
+{
+	if (openGPUZones.empty())
+	{
+		return;
+	}
+
+	auto& zone = gpuZones[openGPUZones.back()];
+	openGPUZones.pop_back();
+
+	glQueryCounter(zone.queries[1], GL_TIMESTAMP);
+	zone.pending = true;
+}
+
+void Profiler::collectGPUZone(GPUZone& zone, bool wait)
+{
+	if (!wait)
+	{
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(zone.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (available != GL_TRUE)
+		{
+			return;
+		}
+	}
+
+	// GPU timestamps are moved onto the CPU timeline using the offset between the two clocks at first use
+	if (!gpuClockCalibrated)
+	{
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		gpuClockOffset = now() - (long long)gpuNow;
+		gpuClockCalibrated = true;
+	}
+
+	GLuint64 begin = 0;
+	GLuint64 end = 0;
+	glGetQueryObjectui64v(zone.queries[0], GL_QUERY_RESULT, &begin);
+	glGetQueryObjectui64v(zone.queries[1], GL_QUERY_RESULT, &end);
+
+	record(zone.name, zone.category, GPU_TRACK, 0, (long long)begin + gpuClockOffset, (long long)(end - begin));
+	zone.pending = false;
+}
+
+// Call once per frame on the GL thread; only reads queries whose results are already there
+void Profiler::collectGPUZones(void)
+{
+	for (auto& zone : gpuZones)
+	{
+		if (zone.pending)
+		{
+			collectGPUZone(zone, false);
+		}
+	}
+}
+
+// Snapshot of the ring, oldest first
+std::vector<Profiler::Event> Profiler::getEvents(void)
+{
+	std::vector<Event> events;
+	auto last = nextSequence.load(std::memory_order_acquire);
+	auto first = last > EVENT_CAPACITY ? last - EVENT_CAPACITY : 0;
+
+	events.reserve((size_t)(last - first));
+
+	for (auto sequence = first; sequence < last; sequence++)
+	{
+		auto& slot = slots[sequence % EVENT_CAPACITY];
+
+		if (slot.sequence.load(std::memory_order_acquire) != sequence + 1)
+		{
+			continue;
+		}
+
+		Event event = slot.event;
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (slot.sequence.load(std::memory_order_relaxed) == sequence + 1)
+		{
+			events.push_back(event);
+		}
+	}
+
+	return events;
+}
+
+// Over the events still in the ring
+Profiler::Statistics Profiler::getStatistics(const std::string& name, Track track)
+{
+	Statistics statistics;
+	double totalMilliseconds = 0.0;
+
+	for (const auto& event : getEvents())
+	{
+		if (event.track != track || name != event.name)
+		{
+			continue;
+		}
+
+		double milliseconds = event.durationNanoseconds / 1000000.0;
+
+		if (statistics.count == 0 || milliseconds < statistics.minMilliseconds)
+		{
+			statistics.minMilliseconds = milliseconds;
+		}
+
+		if (statistics.count == 0 || milliseconds > statistics.maxMilliseconds)
+		{
+			statistics.maxMilliseconds = milliseconds;
+		}
+
+		statistics.count++;
+		statistics.lastMilliseconds = milliseconds;
+		totalMilliseconds += milliseconds;
+	}
+
+	if (statistics.count > 0)
+	{
+		statistics.averageMilliseconds = totalMilliseconds / statistics.count;
+	}
+
+	return statistics;
+}
+
+void Profiler::writeEscaped(std::ostream& stream, const char* s)
+{
+	for (; *s != '\0'; s++)
+	{
+		if (*s == '"' || *s == '\\')
+		{
+			stream << '\\';
+		}
+
+		stream << ((unsigned char)*s < 0x20 ? ' ' : *s);
+	}
+}
+
+// Complete ("X") events in microseconds, CPU threads under one process and the GPU under another
+void Profiler::writeChromeTrace(std::ostream& stream)
+{
+	auto events = getEvents();
+
+	stream << "{\"traceEvents\":[" << std::endl;
+	stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}}," << std::endl;
+	stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+	for (const auto& event : events)
+	{
+		stream << "," << std::endl << "{\"name\":\"";
+		writeEscaped(stream, event.name);
+		stream << "\",\"cat\":\"";
+		writeEscaped(stream, event.category);
+		stream << "\",\"ph\":\"X\",\"ts\":" << event.startNanoseconds / 1000.0 << ",\"dur\":" << event.durationNanoseconds / 1000.0
+			   << ",\"pid\":" << (event.track == GPU_TRACK ? 2 : 1) << ",\"tid\":" << event.threadID << "}";
+	}
+
+	stream << std::endl << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+}
+
+bool Profiler::writeChromeTrace(const std::string& filePath)
+{
+	std::ofstream trace(filePath, std::ios::out | std::ios::trunc);
+
+	if (!trace.is_open())
+	{
+		std::cout << "COULD NOT WRITE TRACE " << filePath << std::endl;
+		return false;
+	}
+
+	trace.precision(3);
+	trace << std::fixed;
+	writeChromeTrace(trace);
+
+	std::cout << "WROTE TRACE " << filePath << std::endl;
+
+	return trace.good();
+}
+
+void Profiler::clear(void)
+{
+	for (size_t i = 0; i < EVENT_CAPACITY; i++)
+	{
+		slots[i].sequence.store(0, std::memory_order_relaxed);
+	}
+}
+
+void Profiler::count(Counter counter, long long value)
+{
+	counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+long long Profiler::getCounter(Counter counter)
+{
+	return counters[counter].load(std::memory_order_relaxed);
+}
+
+void Profiler::resetCounters(void)
+{
+	for (auto& counter : counters)
+	{
+		counter.store(0, std::memory_order_relaxed);
+	}
+}
+
+ProfileZone::ProfileZone(const char* name, const char* category) : name(name), category(category),
+	active(Profiler::getInstance()->isEnabled())
+{
+	start = active ? Profiler::getInstance()->now() : 0;
+}
+
+ProfileZone::~ProfileZone()
+{
+	if (active)
+	{
+		auto profiler = Profiler::getInstance();
+		profiler->record(name, category, Profiler::CPU_TRACK, Profiler::getThreadID(), start, profiler->now() - start);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <glew.h>
+
+// Scoped CPU zones and GL timestamp query GPU zones, collected into a fixed size ring that overwrites the oldest events.
+// CPU zones can be recorded from any thread without locking. GPU zones are opened and closed on the GL thread and read
+// back a few frames later, once their queries are available, so timing never stalls the pipeline. The ring can be
+// dumped as Chrome trace JSON (which Perfetto opens too) or summarised per zone. Disabled by default, in which case a
+// zone costs one atomic load
+class Profiler
+{
+public:
+	enum Track { CPU_TRACK, GPU_TRACK };
+	// Running totals that are kept whether or not zones are enabled
+	enum Counter { DRAW_CALLS, UPLOADED_BYTES, COUNTER_COUNT };
+
+	struct Event
+	{
+		char name[48];
+		const char* category;
+		Track track;
+		unsigned int threadID;
+		long long startNanoseconds;
+		long long durationNanoseconds;
+	};
+
+	struct Statistics
+	{
+		unsigned long count = 0;
+		double lastMilliseconds = 0.0;
+		double averageMilliseconds = 0.0;
+		double minMilliseconds = 0.0;
+		double maxMilliseconds = 0.0;
+	};
+
+	static const size_t EVENT_CAPACITY = 1 << 16;
+	static const size_t GPU_ZONE_CAPACITY = 256;
+private:
+	// sequence is 0 while the slot is being written, otherwise the event's position in the stream plus one
+	struct Slot
+	{
+		std::atomic<unsigned long long> sequence;
+		Event event;
+	};
+
+	struct GPUZone
+	{
+		char name[48];
+		const char* category;
+		GLuint queries[2];
+		bool pending;
+	};
+
+	std::atomic<bool> enabled;
+	std::atomic<unsigned long long> nextSequence;
+	std::atomic<long long> counters[COUNTER_COUNT];
+	std::unique_ptr<Slot[]> slots;
+	std::chrono::steady_clock::time_point epoch;
+	std::vector<GPUZone> gpuZones;
+	std::vector<size_t> openGPUZones;
+	size_t nextGPUZone = 0;
+	long long gpuClockOffset = 0;
+	bool gpuClockCalibrated = false;
+	Profiler();
+	~Profiler();
+	static void copyName(char* destination, const char* name);
+	void collectGPUZone(GPUZone& zone, bool wait);
+public:
+	static Profiler* getInstance();
+	static unsigned int getThreadID(void);
+	// Writes s as the inside of a JSON string
+	static void writeEscaped(std::ostream& stream, const char* s);
+	void setEnabled(bool enabled);
+	bool isEnabled(void);
+	long long now(void);
+	void record(const char* name, const char* category, Track track, unsigned int threadID, long long startNanoseconds,
+				long long durationNanoseconds);
+	void beginGPUZone(const char* name, const char* category = "gpu");
+	void endGPUZone(void);
+	void collectGPUZones(void);
+	std::vector<Event> getEvents(void);
+	Statistics getStatistics(const std::string& name, Track track = CPU_TRACK);
+	void writeChromeTrace(std::ostream& stream);
+	bool writeChromeTrace(const std::string& filePath);
+	void clear(void);
+	void count(Counter counter, long long value = 1);
+	long long getCounter(Counter counter);
+	void resetCounters(void);
+};
+
+// Records the time between its construction and destruction as a CPU zone on the calling thread
+class ProfileZone
+{
+private:
+	const char* name;
+	const char* category;
+	long long start;
+	bool active;
+public:
+	ProfileZone(const char* name, const char* category = "cpu");
+	~ProfileZone();
+};
+
+#define PROFILE_CONCATENATE_(a, b) a##b
+#define PROFILE_CONCATENATE(a, b) PROFILE_CONCATENATE_(a, b)
+#define PROFILE_ZONE(name, category) ProfileZone PROFILE_CONCATENATE(profileZone, __LINE__)(name, category)
\ No newline at end of file
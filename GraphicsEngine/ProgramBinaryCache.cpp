@@ -0,0 +1,191 @@
+#pragma once
+#include "ProgramBinaryCache.h"
+#include "GLDispatch.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// FNV-1a, stable across runs and platforms unlike std::hash
+unsigned long long ProgramBinaryCache::hashString(const std::string& s, unsigned long long hash)
+{
+	for (unsigned char c : s)
+	{
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+std::string ProgramBinaryCache::directory = "shadercache";
+bool ProgramBinaryCache::enabled = true;
+unsigned int ProgramBinaryCache::hits = 0;
+unsigned int ProgramBinaryCache::misses = 0;
+double ProgramBinaryCache::millisecondsSaved = 0.0;
+
+std::string ProgramBinaryCache::getDriverString(void)
+{
+	static std::string driver;
+
+	if (driver.empty())
+	{
+		GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+
+		for (auto name : names)
+		{
+			auto value = glGetString(name);
+			driver += value != nullptr ? (const char*)value : "";
+			driver += "|";
+		}
+	}
+
+	return driver;
+}
+
+std::string ProgramBinaryCache::getEntryPath(unsigned long long key)
+{
+	std::stringstream path;
+	path << directory << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+
+	return path.str();
+}
+
+void ProgramBinaryCache::printStatistics(void)
+{
+	std::cout << "SHADER CACHE : " << hits << "/" << hits + misses << " HITS, ~" << millisecondsSaved << " MS SAVED" << std::endl;
+}
+
+unsigned long long ProgramBinaryCache::getKey(GLenum shader, const std::string& source, const std::string& defines)
+{
+	auto hash = hashString(std::to_string(shader) + "|" + getDriverString(), 14695981039346656037ULL);
+	hash = hashString(defines, hash);
+
+	return hashString(source, hash);
+}
+
+// Returns a linked, separable program, or 0 if there is no usable entry. A stale or corrupt entry counts as a miss and
+// will be overwritten by the next storeProgram
+GLuint ProgramBinaryCache::loadProgram(unsigned long long key, const std::string& signature)
+{
+	if (!enabled)
+	{
+		return 0;
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+
+	std::ifstream entry(getEntryPath(key), std::ios::in | std::ios::binary);
+	CacheHeader header;
+
+	if (!entry.is_open() || !entry.read((char*)&header, sizeof(header)) || header.magic != CACHE_MAGIC ||
+		header.version != CACHE_VERSION || header.key != key || header.binaryLength <= 0)
+	{
+		misses++;
+		return 0;
+	}
+
+	std::vector<char> binary(header.binaryLength);
+
+	if (!entry.read(&binary[0], header.binaryLength))
+	{
+		misses++;
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+	glProgramBinary(program, header.binaryFormat, &binary[0], header.binaryLength);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+	if (linked != GL_TRUE)
+	{
+		std::cout << "SHADER CACHE REJECTED BINARY FOR " << signature << ", RECOMPILING" << std::endl;
+		glDeleteProgram(program);
+		misses++;
+
+		return 0;
+	}
+
+	double loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+	hits++;
+	millisecondsSaved += header.compileMilliseconds - loadMilliseconds;
+
+	std::cout << "SHADER CACHE HIT " << signature << std::endl;
+	printStatistics();
+
+	return program;
+}
+
+void ProgramBinaryCache::storeProgram(unsigned long long key, GLuint program, double compileMilliseconds)
+{
+	if (!enabled)
+	{
+		return;
+	}
+
+	CacheHeader header = { CACHE_MAGIC, CACHE_VERSION, key, GL_NONE, 0, compileMilliseconds };
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.binaryLength);
+
+	if (header.binaryLength <= 0)
+	{
+		return;
+	}
+
+	std::vector<char> binary(header.binaryLength);
+	glGetProgramBinary(program, header.binaryLength, NULL, &header.binaryFormat, &binary[0]);
+
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+
+	std::ofstream entry(getEntryPath(key), std::ios::out | std::ios::binary | std::ios::trunc);
+
+	if (!entry.is_open())
+	{
+		std::cout << "SHADER CACHE COULD NOT WRITE " << getEntryPath(key) << std::endl;
+		return;
+	}
+
+	entry.write((const char*)&header, sizeof(header));
+	entry.write(&binary[0], header.binaryLength);
+
+	printStatistics();
+}
+
+void ProgramBinaryCache::setDirectory(const std::string& directory)
+{
+	ProgramBinaryCache::directory = directory;
+}
+
+void ProgramBinaryCache::setEnabled(bool enabled)
+{
+	ProgramBinaryCache::enabled = enabled;
+}
+
+unsigned int ProgramBinaryCache::getHitCount(void)
+{
+	return hits;
+}
+
+unsigned int ProgramBinaryCache::getMissCount(void)
+{
+	return misses;
+}
+
+double ProgramBinaryCache::getMillisecondsSaved(void)
+{
+	return millisecondsSaved;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <glew.h>
+
+// On-disk cache of linked program binaries. Entries are keyed by a hash of the shader stage, its source, any defines
+// and the GL vendor, renderer and version strings, so a driver update or an edited shader simply misses and the program
+// is compiled from source again. Each entry remembers how long its compile took, which is what a hit is credited with
+class ProgramBinaryCache
+{
+private:
+	static const unsigned int CACHE_MAGIC = 0x43425053; // "SPBC"
+	static const unsigned int CACHE_VERSION = 1;
+
+	struct CacheHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned long long key;
+		GLenum binaryFormat;
+		GLint binaryLength;
+		double compileMilliseconds;
+	};
+
+	static std::string directory;
+	static bool enabled;
+	static unsigned int hits;
+	static unsigned int misses;
+	static double millisecondsSaved;
+	static unsigned long long hashString(const std::string& s, unsigned long long hash);
+	static std::string getDriverString(void);
+	static std::string getEntryPath(unsigned long long key);
+	static void printStatistics(void);
+public:
+	static unsigned long long getKey(GLenum shader, const std::string& source, const std::string& defines = "");
+	static GLuint loadProgram(unsigned long long key, const std::string& signature);
+	static void storeProgram(unsigned long long key, GLuint program, double compileMilliseconds);
+	static void setDirectory(const std::string& directory);
+	static void setEnabled(bool enabled);
+	static unsigned int getHitCount(void);
+	static unsigned int getMissCount(void);
+	static double getMillisecondsSaved(void);
+};
\ No newline at end of file
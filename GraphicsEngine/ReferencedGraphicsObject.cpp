@@ -1,9 +1,12 @@
 #pragma once
 #include "ReferencedGraphicsObject.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <bitset>
 
 namespace Graphics
 {
-	ReferenceManager::ReferenceManager()
+	ReferenceManager::ReferenceManager() : count(1)
 	{
 	}
 
@@ -11,27 +14,111 @@ namespace Graphics
 	{
 	}
 
-	int ReferenceManager::assignNewGUID(DecoratedGraphicsObject* gObject, int indexWithinObject)
+	// Reuses the first released range big enough, otherwise extends the GUID space. Callers hold tableMutex
+	unsigned int ReferenceManager::allocate(unsigned int number)
 	{
-		if (managedGraphicsObject.find(gObject) != managedGraphicsObject.end())
+		for (auto freeRange = freeRanges.begin(); freeRange != freeRanges.end(); freeRange++)
 		{
-			for (const auto& object : managedGraphicsObject[gObject].second)
+			if (freeRange->second >= number)
 			{
-				if (indexWithinObject == object.first)
+				unsigned int firstGUID = freeRange->first;
+				freeRange->first += number;
+				freeRange->second -= number;
+
+				if (freeRange->second == 0)
 				{
-					return object.second;
+					freeRanges.erase(freeRange);
 				}
+
+				return firstGUID;
 			}
+		}
+
+		return count.fetch_add(number);
+	}
+
+	void ReferenceManager::release(unsigned int firstGUID, unsigned int number)
+	{
+		auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), std::make_pair(firstGUID, 0u));
+		next = freeRanges.insert(next, std::make_pair(firstGUID, number));
 
-			managedGraphicsObject[gObject].second.push_back(std::pair<int, int>(indexWithinObject, count));
-			inverseLookupMap[count++] = std::make_pair(gObject, indexWithinObject);
-			return count - 1;
+		// Coalesce with the following and preceding ranges
+		auto following = next + 1;
+
+		if (following != freeRanges.end() && next->first + next->second == following->first)
+		{
+			next->second += following->second;
+			freeRanges.erase(following);
+		}
+
+		if (next != freeRanges.begin())
+		{
+			auto preceding = next - 1;
+
+			if (preceding->first + preceding->second == next->first)
+			{
+				preceding->second += next->second;
+				freeRanges.erase(next);
+			}
 		}
+	}
+
+	// Adds a range to both tables. A range that continues the object's previous one in both GUIDs and indices is merged
+	// into it, so GUIDs assigned one by one in order still end up as a single range
+	void ReferenceManager::insertRange(const GUIDRange& range)
+	{
+		auto& perObject = objectRanges[range.object];
+		auto objectNext = std::upper_bound(perObject.begin(), perObject.end(), range.firstIndex,
+										   [](int index, const GUIDRange& r) { return index < r.firstIndex; });
+
+		if (objectNext != perObject.begin())
+		{
+			auto& previous = *(objectNext - 1);
+
+			if (previous.firstIndex + (int)previous.count == range.firstIndex && previous.firstGUID + previous.count == range.firstGUID)
+			{
+				auto global = std::lower_bound(ranges.begin(), ranges.end(), previous.firstGUID,
+											   [](const GUIDRange& r, unsigned int guid) { return r.firstGUID < guid; });
+				global->count += range.count;
+				previous.count += range.count;
+
+				return;
+			}
+		}
+
+		perObject.insert(objectNext, range);
+
+		auto globalNext = std::upper_bound(ranges.begin(), ranges.end(), range.firstGUID,
+										   [](unsigned int guid, const GUIDRange& r) { return guid < r.firstGUID; });
+		ranges.insert(globalNext, range);
+	}
+
+	void ReferenceManager::eraseRange(const GUIDRange& range)
+	{
+		auto global = std::lower_bound(ranges.begin(), ranges.end(), range.firstGUID,
+									   [](const GUIDRange& r, unsigned int guid) { return r.firstGUID < guid; });
+		ranges.erase(global);
 
-		managedGraphicsObject[gObject] = std::pair<DecoratedGraphicsObject*, std::vector<std::pair<int, int>>>(gObject,
-			{ std::pair<int, int>(indexWithinObject, count) });
-		inverseLookupMap[count++] = std::make_pair(gObject, indexWithinObject);
-		return count - 1;
+		auto& perObject = objectRanges[range.object];
+		perObject.erase(std::find_if(perObject.begin(), perObject.end(),
+									 [&range](const GUIDRange& r) { return r.firstGUID == range.firstGUID; }));
+	}
+
+	int ReferenceManager::assignNewGUID(DecoratedGraphicsObject* gObject, int indexWithinObject)
+	{
+		std::lock_guard<std::mutex> lock(tableMutex);
+
+		int guid = getGUIDUnlocked(gObject, indexWithinObject);
+
+		if (guid != 0)
+		{
+			return guid;
+		}
+
+		guid = allocate(1);
+		insertRange({ (unsigned int)guid, 1, gObject, indexWithinObject });
+
+		return guid;
 	}
 
 	int ReferenceManager::assignNewGUID(void)
@@ -39,13 +126,388 @@ namespace Graphics
 		return count++;
 	}
 
+	// Untracked GUIDs for callers that keep their own mapping. Lock-free, safe from any thread
+	unsigned int ReferenceManager::assignNewGUIDs(unsigned int number)
+	{
+		return count.fetch_add(number);
+	}
+
+	// Registers instances [firstIndex, firstIndex + number) of an object under consecutive GUIDs and returns the first
+	// one. The indices must not already have GUIDs
+	unsigned int ReferenceManager::assignGUIDRange(DecoratedGraphicsObject* gObject, unsigned int number, int firstIndex)
+	{
+		if (number == 0)
+		{
+			return 0;
+		}
+
+		std::lock_guard<std::mutex> lock(tableMutex);
+
+		unsigned int firstGUID = allocate(number);
+		insertRange({ firstGUID, number, gObject, firstIndex });
+
+		return firstGUID;
+	}
+
+	int ReferenceManager::getGUIDUnlocked(DecoratedGraphicsObject* gObject, int indexWithinObject)
+	{
+		auto perObject = objectRanges.find(gObject);
+
+		if (perObject == objectRanges.end())
+		{
+			return 0;
+		}
+
+		auto& objectRange = perObject->second;
+		auto next = std::upper_bound(objectRange.begin(), objectRange.end(), indexWithinObject,
+									 [](int index, const GUIDRange& r) { return index < r.firstIndex; });
+
+		if (next == objectRange.begin())
+		{
+			return 0;
+		}
+
+		auto& range = *(next - 1);
+
+		if (indexWithinObject >= range.firstIndex + (int)range.count)
+		{
+			return 0;
+		}
+
+		return range.firstGUID + (indexWithinObject - range.firstIndex);
+	}
+
+	// 0 if the instance has no GUID
+	int ReferenceManager::getGUID(DecoratedGraphicsObject* gObject, int indexWithinObject)
+	{
+		std::lock_guard<std::mutex> lock(tableMutex);
+
+		return getGUIDUnlocked(gObject, indexWithinObject);
+	}
+
 	std::pair<DecoratedGraphicsObject*, int> ReferenceManager::getInstance(int guid)
 	{
-		if (inverseLookupMap.find(guid) != inverseLookupMap.end())
+		std::lock_guard<std::mutex> lock(tableMutex);
+
+		auto next = std::upper_bound(ranges.begin(), ranges.end(), (unsigned int)guid,
+									 [](unsigned int g, const GUIDRange& r) { return g < r.firstGUID; });
+
+		if (next != ranges.begin())
 		{
-			return inverseLookupMap[guid];
+			auto& range = *(next - 1);
+
+			if ((unsigned int)guid < range.firstGUID + range.count)
+			{
+				return std::make_pair(range.object, range.firstIndex + (int)(guid - range.firstGUID));
+			}
 		}
 
 		return std::make_pair(nullptr, 0);
 	}
+
+	// Drops the GUIDs of instances [minIndex, maxIndex] of an object and makes them available again. Ranges straddling
+	// the bounds are split
+	void ReferenceManager::deleteRange(DecoratedGraphicsObject* gObject, int minIndex, int maxIndex)
+	{
+		std::lock_guard<std::mutex> lock(tableMutex);
+
+		auto perObject = objectRanges.find(gObject);
+
+		if (perObject == objectRanges.end())
+		{
+			return;
+		}
+
+		std::vector<GUIDRange> affected;
+
+		for (const auto& range : perObject->second)
+		{
+			if (range.firstIndex <= maxIndex && range.firstIndex + (int)range.count - 1 >= minIndex)
+			{
+				affected.push_back(range);
+			}
+		}
+
+		for (const auto& range : affected)
+		{
+			int lastIndex = range.firstIndex + (int)range.count - 1;
+			int low = std::max(range.firstIndex, minIndex);
+			int high = std::min(lastIndex, maxIndex);
+
+			eraseRange(range);
+
+			if (low > range.firstIndex)
+			{
+				insertRange({ range.firstGUID, (unsigned int)(low - range.firstIndex), gObject, range.firstIndex });
+			}
+
+			if (high < lastIndex)
+			{
+				insertRange({ range.firstGUID + (unsigned int)(high + 1 - range.firstIndex), (unsigned int)(lastIndex - high), gObject, high + 1 });
+			}
+
+			release(range.firstGUID + (unsigned int)(low - range.firstIndex), (unsigned int)(high - low + 1));
+		}
+
+		if (objectRanges[gObject].empty())
+		{
+			objectRanges.erase(gObject);
+		}
+	}
+
+	size_t ReferenceManager::getRangeCount(void)
+	{
+		std::lock_guard<std::mutex> lock(tableMutex);
+
+		return ranges.size();
+	}
+
+	SelectionManager::SelectionManager(ReferenceManager* refMan) : refMan(refMan)
+	{
+	}
+
+	SelectionManager::~SelectionManager()
+	{
+		if (buffer != 0)
+		{
+			glDeleteBuffers(1, &buffer);
+		}
+	}
+
+	// Grows in whole blocks so the dirty bookkeeping and the GPU copy line up
+	void SelectionManager::reserve(size_t wordCount)
+	{
+		if (wordCount <= words.size())
+		{
+			return;
+		}
+
+		size_t blockCount = (wordCount + WORDS_PER_BLOCK - 1) / WORDS_PER_BLOCK;
+		words.resize(blockCount * WORDS_PER_BLOCK, 0);
+		dirtyBlocks.resize(blockCount, false);
+	}
+
+	void SelectionManager::markDirty(size_t word)
+	{
+		dirtyBlocks[word / WORDS_PER_BLOCK] = true;
+	}
+
+	void SelectionManager::setWord(size_t word, GLuint value)
+	{
+		if (words[word] == value)
+		{
+			return;
+		}
+
+		selectedCount -= std::bitset<32>(words[word]).count();
+		selectedCount += std::bitset<32>(value).count();
+		words[word] = value;
+		markDirty(word);
+	}
+
+	void SelectionManager::add(unsigned int guid)
+	{
+		reserve((guid >> 5) + 1);
+		setWord(guid >> 5, words[guid >> 5] | (1u << (guid & 31u)));
+	}
+
+	// Whole words are filled at once, so selecting a large object costs a word per 32 instances
+	void SelectionManager::addRange(unsigned int firstGUID, unsigned int count)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		unsigned int lastGUID = firstGUID + count - 1;
+		reserve((lastGUID >> 5) + 1);
+
+		for (unsigned int word = firstGUID >> 5; word <= lastGUID >> 5; word++)
+		{
+			unsigned int low = std::max(firstGUID, word << 5) & 31u;
+			unsigned int high = std::min(lastGUID, (word << 5) + 31) & 31u;
+			GLuint bits = (high == 31 ? ~0u : ((1u << (high + 1)) - 1)) & ~((1u << low) - 1);
+			setWord(word, words[word] | bits);
+		}
+	}
+
+	void SelectionManager::remove(unsigned int guid)
+	{
+		if ((guid >> 5) < words.size())
+		{
+			setWord(guid >> 5, words[guid >> 5] & ~(1u << (guid & 31u)));
+		}
+	}
+
+	void SelectionManager::toggle(unsigned int guid)
+	{
+		reserve((guid >> 5) + 1);
+		setWord(guid >> 5, words[guid >> 5] ^ (1u << (guid & 31u)));
+	}
+
+	bool SelectionManager::contains(unsigned int guid) const
+	{
+		return (guid >> 5) < words.size() && ((words[guid >> 5] >> (guid & 31u)) & 1u);
+	}
+
+	void SelectionManager::clear(void)
+	{
+		for (size_t word = 0; word < words.size(); word++)
+		{
+			setWord(word, 0);
+		}
+	}
+
+	void SelectionManager::select(DecoratedGraphicsObject* gObject, int indexWithinObject)
+	{
+		int guid = refMan->getGUID(gObject, indexWithinObject);
+
+		if (guid != 0)
+		{
+			add(guid);
+		}
+	}
+
+	void SelectionManager::deselect(DecoratedGraphicsObject* gObject, int indexWithinObject)
+	{
+		int guid = refMan->getGUID(gObject, indexWithinObject);
+
+		if (guid != 0)
+		{
+			remove(guid);
+		}
+	}
+
+	void SelectionManager::unite(const SelectionManager& other)
+	{
+		reserve(other.words.size());
+
+		for (size_t word = 0; word < other.words.size(); word++)
+		{
+			setWord(word, words[word] | other.words[word]);
+		}
+	}
+
+	void SelectionManager::intersect(const SelectionManager& other)
+	{
+		for (size_t word = 0; word < words.size(); word++)
+		{
+			setWord(word, word < other.words.size() ? words[word] & other.words[word] : 0);
+		}
+	}
+
+	void SelectionManager::subtract(const SelectionManager& other)
+	{
+		for (size_t word = 0; word < words.size() && word < other.words.size(); word++)
+		{
+			setWord(word, words[word] & ~other.words[word]);
+		}
+	}
+
+	size_t SelectionManager::size(void) const
+	{
+		return selectedCount;
+	}
+
+	std::vector<unsigned int> SelectionManager::getSelectedGUIDs(void) const
+	{
+		std::vector<unsigned int> guids;
+		guids.reserve(selectedCount);
+
+		for (size_t word = 0; word < words.size(); word++)
+		{
+			// Clearing the lowest set bit each step never shifts by the full word width
+			for (GLuint remaining = words[word]; remaining != 0; remaining &= remaining - 1)
+			{
+				unsigned int bit = 0;
+
+				while (((remaining >> bit) & 1u) == 0)
+				{
+					bit++;
+				}
+
+				guids.push_back((unsigned int)(word << 5) + bit);
+			}
+		}
+
+		return guids;
+	}
+
+	std::vector<std::pair<DecoratedGraphicsObject*, int>> SelectionManager::getSelectedInstances(void) const
+	{
+		std::vector<std::pair<DecoratedGraphicsObject*, int>> instances;
+
+		for (auto guid : getSelectedGUIDs())
+		{
+			auto instance = refMan->getInstance(guid);
+
+			if (instance.first != nullptr)
+			{
+				instances.push_back(instance);
+			}
+		}
+
+		return instances;
+	}
+
+	// Sends the blocks changed since the last upload, merging neighbouring ones into a single call. The buffer is
+	// reallocated, and sent whole, only when the GUID space has outgrown it. Must run on the GL thread
+	void SelectionManager::upload(void)
+	{
+		if (words.empty())
+		{
+			return;
+		}
+
+		if (buffer == 0)
+		{
+			glGenBuffers(1, &buffer);
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+
+		if (bufferWords < words.size())
+		{
+			glBufferData(GL_SHADER_STORAGE_BUFFER, words.size() * sizeof(GLuint), &words[0], GL_DYNAMIC_DRAW);
+			Profiler::getInstance()->count(Profiler::UPLOADED_BYTES, words.size() * sizeof(GLuint));
+			bufferWords = words.size();
+			std::fill(dirtyBlocks.begin(), dirtyBlocks.end(), false);
+		}
+		else
+		{
+			for (size_t block = 0; block < dirtyBlocks.size(); block++)
+			{
+				if (!dirtyBlocks[block])
+				{
+					continue;
+				}
+
+				size_t lastBlock = block;
+
+				while (lastBlock + 1 < dirtyBlocks.size() && dirtyBlocks[lastBlock + 1])
+				{
+					lastBlock++;
+				}
+
+				std::fill(dirtyBlocks.begin() + block, dirtyBlocks.begin() + lastBlock + 1, false);
+
+				size_t firstWord = block * WORDS_PER_BLOCK;
+				size_t wordCount = (lastBlock + 1 - block) * WORDS_PER_BLOCK;
+				glBufferSubData(GL_SHADER_STORAGE_BUFFER, firstWord * sizeof(GLuint), wordCount * sizeof(GLuint), &words[firstWord]);
+				Profiler::getInstance()->count(Profiler::UPLOADED_BYTES, wordCount * sizeof(GLuint));
+
+				block = lastBlock;
+			}
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	void SelectionManager::bindBuffer(void)
+	{
+		if (buffer != 0)
+		{
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_BINDING, buffer);
+		}
+	}
 }
\ No newline at end of file
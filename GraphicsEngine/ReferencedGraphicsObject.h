@@ -1,56 +1,189 @@
 #pragma once
 #include "GraphicsObject.h"
-#include <map>
+#include <vector>
+#include <unordered_map>
 #include <utility>
+#include <atomic>
+#include <mutex>
 
 //Stores and manages reference graphics object and instance index within it associated with map index
 namespace Graphics
 {
+	// GUIDs are handed out in contiguous ranges, each one mapping onto a contiguous run of instance indices of a single
+	// object, so a whole object registers in one step and lookups are binary searches over a handful of ranges
+	struct GUIDRange
+	{
+		unsigned int firstGUID;
+		unsigned int count;
+		DecoratedGraphicsObject* object;
+		int firstIndex;
+	};
+
 	class ReferenceManager
 	{
 	private:
-		std::map<DecoratedGraphicsObject*, std::pair<DecoratedGraphicsObject*, std::vector<std::pair<int, int>>>> managedGraphicsObject;
-		std::map<int, std::pair<DecoratedGraphicsObject*, int>> inverseLookupMap;
+		// Sorted by firstGUID
+		std::vector<GUIDRange> ranges;
+		// Per object, sorted by firstIndex
+		std::unordered_map<DecoratedGraphicsObject*, std::vector<GUIDRange>> objectRanges;
+		// Released GUIDs as (firstGUID, count), sorted and coalesced
+		std::vector<std::pair<unsigned int, unsigned int>> freeRanges;
+		std::mutex tableMutex;
+		unsigned int allocate(unsigned int number);
+		void release(unsigned int firstGUID, unsigned int number);
+		void insertRange(const GUIDRange& range);
+		void eraseRange(const GUIDRange& range);
+		int getGUIDUnlocked(DecoratedGraphicsObject* gObject, int indexWithinObject);
 	public:
-		unsigned int count = 1;
+		// One past the highest GUID ever issued, GUID 0 is never used
+		std::atomic<unsigned int> count;
 		ReferenceManager();
 		~ReferenceManager();
 		int assignNewGUID(DecoratedGraphicsObject* gObject, int indexWithinObject = 0);
 		int assignNewGUID(void);
+		unsigned int assignNewGUIDs(unsigned int number);
+		unsigned int assignGUIDRange(DecoratedGraphicsObject* gObject, unsigned int number, int firstIndex = 0);
+		int getGUID(DecoratedGraphicsObject* gObject, int indexWithinObject);
 		std::pair<DecoratedGraphicsObject*, int> getInstance(int guid);
 		void deleteRange(DecoratedGraphicsObject*, int minIndex, int maxIndex);
+		size_t getRangeCount(void);
 	};
 
+	// Assigns every instance of the child a picking GUID. By default the GUIDs are stored and uploaded as an instanced
+	// attribute. With derivedGUIDs set no buffer is created at all: the instances occupy one contiguous GUID range, and
+	// the vertex shader computes baseGUID + gl_InstanceID (divided by the divisor if it isn't 1) from the "baseGUID"
+	// uniform. The attribute slot stays reserved so decorators stacked on top keep the same layout in both modes
 	template<class T, class S> class ReferencedGraphicsObject : public InstancedMeshObject<T, S>
 	{
+	protected:
+		unsigned int baseGUID;
+		int numInstances;
+		bool derivedGUIDs;
 	public:
-		ReferencedGraphicsObject(ReferenceManager* refMan, DecoratedGraphicsObject* child, int numInstances, std::string bufferSignature, int divisor);
+		ReferencedGraphicsObject(ReferenceManager* refMan, DecoratedGraphicsObject* child, int numInstances, std::string bufferSignature, int divisor,
+								 bool derivedGUIDs = false);
 		~ReferencedGraphicsObject();
+
+		virtual void commitVBOToGPU(void);
+		virtual void bindBuffers(void);
+		virtual void updateBuffers(void);
+		virtual void updateIfDirty(void);
+		virtual void draw(void);
+		virtual unsigned int getBaseGUID(void);
 	};
 
 	template<class T, class S>
 	ReferencedGraphicsObject<T, S>::ReferencedGraphicsObject(ReferenceManager* refMan, DecoratedGraphicsObject* child, int numInstances,
-		std::string bufferSignature, int divisor) :
-		InstancedMeshObject<T, S>(child, bufferSignature, divisor)
+		std::string bufferSignature, int divisor, bool derivedGUIDs) :
+		InstancedMeshObject<T, S>(child, bufferSignature, divisor), numInstances(numInstances), derivedGUIDs(derivedGUIDs)
 	{
+		baseGUID = refMan->assignGUIDRange(this, numInstances);
+
+		if (derivedGUIDs)
+		{
+			DecoratedGraphicsObject::VBO = 0;
+			return;
+		}
+
+		ExtendedMeshObject<T, S>::extendedData.reserve(numInstances);
+
 		for (int i = 0; i < numInstances; i++)
 		{
-			ExtendedMeshObject<T, S>::extendedData.push_back(refMan->assignNewGUID(this, i));
+			ExtendedMeshObject<T, S>::extendedData.push_back(baseGUID + i);
 		}
 
-		glDeleteBuffers(1, &(InstancedMeshObject<T, S>::VBO));
-		InstancedMeshObject<T, S>::bindBuffers();
+		bindBuffers();
 	}
 
-
 	template<class T, class S> ReferencedGraphicsObject<T, S>::~ReferencedGraphicsObject()
 	{
 	}
 
+	template<class T, class S> void ReferencedGraphicsObject<T, S>::commitVBOToGPU(void)
+	{
+		if (!derivedGUIDs)
+		{
+			InstancedMeshObject<T, S>::commitVBOToGPU();
+		}
+	}
+
+	template<class T, class S> void ReferencedGraphicsObject<T, S>::bindBuffers(void)
+	{
+		if (!derivedGUIDs)
+		{
+			InstancedMeshObject<T, S>::bindBuffers();
+		}
+	}
+
+	template<class T, class S> void ReferencedGraphicsObject<T, S>::updateBuffers(void)
+	{
+		if (!derivedGUIDs)
+		{
+			InstancedMeshObject<T, S>::updateBuffers();
+		}
+	}
+
+	template<class T, class S> void ReferencedGraphicsObject<T, S>::updateIfDirty(void)
+	{
+		if (!derivedGUIDs)
+		{
+			InstancedMeshObject<T, S>::updateIfDirty();
+		}
+	}
+
+	template<class T, class S> void ReferencedGraphicsObject<T, S>::draw(void)
+	{
+		if (!derivedGUIDs)
+		{
+			InstancedMeshObject<T, S>::draw();
+			return;
+		}
+
+		glDrawElementsInstanced(GL_TRIANGLES, InstancedMeshObject<T, S>::instancedObject->indices.size(), GL_UNSIGNED_INT, 0,
+								numInstances * InstancedMeshObject<T, S>::divisor);
+	}
+
+	template<class T, class S> unsigned int ReferencedGraphicsObject<T, S>::getBaseGUID(void)
+	{
+		return derivedGUIDs ? baseGUID : DecoratedGraphicsObject::getBaseGUID();
+	}
+
+	// Selection set as a dense bitset over the GUID space : bit (guid & 31) of word (guid >> 5). Changes only mark the
+	// blocks they touch, and upload() sends just those to a shader storage buffer bound at BUFFER_BINDING, where shaders
+	// test membership with (selection[id >> 5] >> (id & 31)) & 1
 	class SelectionManager
 	{
 	public:
-		std::vector<std::pair<DecoratedGraphicsObject*, int>> selectedGraphicsObject;
+		static const GLuint BUFFER_BINDING = 3;
+		static const size_t WORDS_PER_BLOCK = 64;
+	private:
+		std::vector<GLuint> words;
+		std::vector<bool> dirtyBlocks;
+		size_t selectedCount = 0;
+		GLuint buffer = 0;
+		size_t bufferWords = 0;
+		void reserve(size_t wordCount);
+		void markDirty(size_t word);
+		void setWord(size_t word, GLuint value);
+	public:
 		ReferenceManager* refMan;
+		SelectionManager(ReferenceManager* refMan = nullptr);
+		~SelectionManager();
+		void add(unsigned int guid);
+		void addRange(unsigned int firstGUID, unsigned int count);
+		void remove(unsigned int guid);
+		void toggle(unsigned int guid);
+		bool contains(unsigned int guid) const;
+		void clear(void);
+		void select(DecoratedGraphicsObject* gObject, int indexWithinObject);
+		void deselect(DecoratedGraphicsObject* gObject, int indexWithinObject);
+		void unite(const SelectionManager& other);
+		void intersect(const SelectionManager& other);
+		void subtract(const SelectionManager& other);
+		size_t size(void) const;
+		std::vector<unsigned int> getSelectedGUIDs(void) const;
+		std::vector<std::pair<DecoratedGraphicsObject*, int>> getSelectedInstances(void) const;
+		void upload(void);
+		void bindBuffer(void);
 	};
 }
\ No newline at end of file
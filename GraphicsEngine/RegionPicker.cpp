@@ -0,0 +1,357 @@
+#pragma once
+#include "RegionPicker.h"
+#include "GLStateCache.h"
+#include <iostream>
+#include <algorithm>
+
+const char* RegionPicker::reductionSource = R"(#version 430
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(r32ui, binding = 0) uniform readonly uimage2D picking;
+
+layout(std430, binding = 0) buffer Result
+{
+	uint count;
+	uint capacity;
+	uint ids[];
+};
+
+layout(std430, binding = 1) buffer Mask
+{
+	uint mask[];
+};
+
+layout(std430, binding = 2) readonly buffer Lasso
+{
+	ivec2 lasso[];
+};
+
+uniform ivec2 origin;
+uniform ivec2 size;
+uniform int lassoCount;
+uniform uint idLimit;
+
+bool insideLasso(vec2 p)
+{
+	bool inside = false;
+
+	for (int i = 0, j = lassoCount - 1; i < lassoCount; j = i++)
+	{
+		vec2 a = vec2(lasso[i]);
+		vec2 b = vec2(lasso[j]);
+
+		if ((a.y > p.y) != (b.y > p.y) && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x)
+		{
+			inside = !inside;
+		}
+	}
+
+	return inside;
+}
+
+void main()
+{
+	ivec2 local = ivec2(gl_GlobalInvocationID.xy);
+
+	if (any(greaterThanEqual(local, size)))
+	{
+		return;
+	}
+
+	ivec2 pixel = origin + local;
+
+	if (lassoCount > 2 && !insideLasso(vec2(pixel) + 0.5))
+	{
+		return;
+	}
+
+	uint id = imageLoad(picking, pixel).r;
+
+	if (id == 0u || id >= idLimit)
+	{
+		return;
+	}
+
+	uint bit = 1u << (id & 31u);
+
+	if ((atomicOr(mask[id >> 5], bit) & bit) == 0u)
+	{
+		uint slot = atomicAdd(count, 1u);
+
+		if (slot < capacity)
+		{
+			ids[slot] = id;
+		}
+	}
+}
+)";
+
+RegionPicker::~RegionPicker()
+{
+	if (fence != nullptr)
+	{
+		glDeleteSync(fence);
+	}
+
+	GLuint buffers[] = { resultBuffer, maskBuffer, lassoBuffer };
+
+	for (auto buffer : buffers)
+	{
+		if (buffer != 0)
+		{
+			glDeleteBuffers(1, &buffer);
+		}
+	}
+
+	if (pipeline != 0)
+	{
+		GLStateCache::getInstance()->deleteProgramPipeline(pipeline);
+	}
+
+	if (program != 0)
+	{
+		glDeleteProgram(program);
+	}
+}
+
+// Compiles the reduction shader on first use. A failed compile or link leaves the picker on the CPU path for good
+void RegionPicker::initialise(void)
+{
+	initialised = true;
+
+	program = glCreateShaderProgramv(GL_COMPUTE_SHADER, 1, &reductionSource);
+
+	GLint linked = GL_FALSE;
+
+	if (program != 0)
+	{
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	}
+
+	if (linked != GL_TRUE)
+	{
+		std::cout << "REGION PICKING COMPUTE SHADER UNAVAILABLE, FALLING BACK TO CPU" << std::endl;
+
+		return;
+	}
+
+	originLocation = glGetUniformLocation(program, "origin");
+	sizeLocation = glGetUniformLocation(program, "size");
+	lassoCountLocation = glGetUniformLocation(program, "lassoCount");
+	idLimitLocation = glGetUniformLocation(program, "idLimit");
+
+	glGenProgramPipelines(1, &pipeline);
+	glUseProgramStages(pipeline, GL_COMPUTE_SHADER_BIT, program);
+
+	computeAvailable = true;
+}
+
+// Storage buffers only ever grow
+void RegionPicker::reserve(GLuint& buffer, GLsizeiptr& bufferSize, GLsizeiptr size)
+{
+	if (buffer == 0)
+	{
+		glGenBuffers(1, &buffer);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+
+	if (bufferSize < size)
+	{
+		glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_COPY);
+		bufferSize = size;
+	}
+}
+
+// Region coordinates are in framebuffer space (origin bottom left) and must lie inside the texture. Lasso vertices use
+// the same space; with fewer than three of them the whole rectangle is taken. IDs at or above idLimit are ignored. A
+// request still in flight is abandoned
+void RegionPicker::request(GLuint texture, GLuint FBO, GLenum attachment, int x, int y, int w, int h, unsigned int idLimit,
+						   const std::vector<glm::ivec2>& lasso)
+{
+	if (!initialised)
+	{
+		initialise();
+	}
+
+	if (fence != nullptr)
+	{
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	resultReady = false;
+
+	if (w <= 0 || h <= 0 || idLimit == 0)
+	{
+		result.clear();
+		resultReady = true;
+
+		return;
+	}
+
+	if (usesCompute())
+	{
+		requestGPU(texture, x, y, w, h, idLimit, lasso);
+	}
+	else
+	{
+		requestCPU(FBO, attachment, x, y, w, h, idLimit, lasso);
+	}
+}
+
+void RegionPicker::requestGPU(GLuint texture, int x, int y, int w, int h, unsigned int idLimit, const std::vector<glm::ivec2>& lasso)
+{
+	// A region can't hold more distinct IDs than it has pixels
+	resultCapacity = std::min<GLuint>(idLimit, (GLuint)(w * h));
+
+	reserve(resultBuffer, resultBufferSize, (2 + resultCapacity) * sizeof(GLuint));
+	GLuint header[] = { 0, resultCapacity };
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), header);
+
+	GLsizeiptr maskSize = ((idLimit + 31) / 32) * sizeof(GLuint);
+	reserve(maskBuffer, maskBufferSize, maskSize);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, maskSize, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+	reserve(lassoBuffer, lassoBufferSize, std::max<GLsizeiptr>(1, lasso.size()) * sizeof(glm::ivec2));
+
+	if (!lasso.empty())
+	{
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lasso.size() * sizeof(glm::ivec2), &lasso[0]);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, resultBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, maskBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, lassoBuffer);
+	glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32UI);
+
+	glProgramUniform2i(program, originLocation, x, y);
+	glProgramUniform2i(program, sizeLocation, w, h);
+	glProgramUniform1i(program, lassoCountLocation, (GLint)lasso.size());
+	glProgramUniform1ui(program, idLimitLocation, idLimit);
+
+	GLStateCache::getInstance()->bindProgramPipeline(pipeline);
+	glDispatchCompute((w + 15) / 16, (h + 15) / 16, 1);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void RegionPicker::requestCPU(GLuint FBO, GLenum attachment, int x, int y, int w, int h, unsigned int idLimit,
+							  const std::vector<glm::ivec2>& lasso)
+{
+	pixels.resize(w * h);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+	glReadBuffer(attachment);
+	glReadPixels(x, y, w, h, GL_RED_INTEGER, GL_UNSIGNED_INT, &pixels[0]);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	reduce(&pixels[0], x, y, w, h, idLimit, lasso, mask, result);
+	resultReady = true;
+}
+
+// Non-blocking. Returns true once, when the latest request has completed, and fills ids with its distinct GUIDs in no
+// particular order
+bool RegionPicker::poll(std::vector<unsigned int>& ids)
+{
+	if (fence != nullptr)
+	{
+		auto status = glClientWaitSync(fence, 0, 0);
+
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			return false;
+		}
+
+		glDeleteSync(fence);
+		fence = nullptr;
+
+		GLuint count = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, resultBuffer);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &count);
+		result.resize(std::min(count, resultCapacity));
+
+		if (!result.empty())
+		{
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(GLuint), result.size() * sizeof(GLuint), &result[0]);
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		resultReady = true;
+	}
+
+	if (!resultReady)
+	{
+		return false;
+	}
+
+	ids.assign(result.begin(), result.end());
+	resultReady = false;
+
+	return true;
+}
+
+bool RegionPicker::usesCompute(void)
+{
+	return computeAvailable && !forceCPU;
+}
+
+// Crossing-number test at the pixel centre, mirroring the shader so both paths select the same pixels
+bool RegionPicker::insideLasso(int x, int y, const std::vector<glm::ivec2>& lasso)
+{
+	float px = x + 0.5f;
+	float py = y + 0.5f;
+	bool inside = false;
+
+	for (size_t i = 0, j = lasso.size() - 1; i < lasso.size(); j = i++)
+	{
+		float ax = (float)lasso[i].x, ay = (float)lasso[i].y;
+		float bx = (float)lasso[j].x, by = (float)lasso[j].y;
+
+		if ((ay > py) != (by > py) && px < (bx - ax) * (py - ay) / (by - ay) + ax)
+		{
+			inside = !inside;
+		}
+	}
+
+	return inside;
+}
+
+// CPU version of the reduction over a w * h block of IDs whose bottom left pixel sits at (x, y). Needs no GL context
+void RegionPicker::reduce(const GLuint* pixels, int x, int y, int w, int h, unsigned int idLimit, const std::vector<glm::ivec2>& lasso,
+						  std::vector<GLuint>& mask, std::vector<unsigned int>& ids)
+{
+	mask.assign((idLimit + 31) / 32, 0);
+	ids.clear();
+
+	bool useLasso = lasso.size() > 2;
+
+	for (int j = 0; j < h; j++)
+	{
+		for (int i = 0; i < w; i++)
+		{
+			if (useLasso && !insideLasso(x + i, y + j, lasso))
+			{
+				continue;
+			}
+
+			GLuint id = pixels[j * w + i];
+
+			if (id == 0 || id >= idLimit)
+			{
+				continue;
+			}
+
+			GLuint bit = 1u << (id & 31u);
+
+			if ((mask[id >> 5] & bit) == 0)
+			{
+				mask[id >> 5] |= bit;
+				ids.push_back(id);
+			}
+		}
+	}
+}
\ No newline at end of file
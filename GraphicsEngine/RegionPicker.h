@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <glew.h>
+#include <glm.hpp>
+
+// Reduces a rectangular or lasso region of a picking texture to the set of distinct GUIDs it contains. A compute shader
+// marks every ID it meets in a bitmask and appends first sightings to a compact list, so only that list is read back,
+// asynchronously. Without compute support (or with forceCPU set) the region is read back and reduced on the CPU
+class RegionPicker
+{
+private:
+	static const char* reductionSource;
+	GLuint program = 0;
+	GLuint pipeline = 0;
+	GLuint resultBuffer = 0;
+	GLuint maskBuffer = 0;
+	GLuint lassoBuffer = 0;
+	GLsizeiptr resultBufferSize = 0;
+	GLsizeiptr maskBufferSize = 0;
+	GLsizeiptr lassoBufferSize = 0;
+	GLint originLocation = -1;
+	GLint sizeLocation = -1;
+	GLint lassoCountLocation = -1;
+	GLint idLimitLocation = -1;
+	GLuint resultCapacity = 0;
+	GLsync fence = nullptr;
+	bool initialised = false;
+	bool computeAvailable = false;
+	bool resultReady = false;
+	// CPU path storage, kept between requests so repeated picks don't allocate
+	std::vector<GLuint> pixels;
+	std::vector<GLuint> mask;
+	std::vector<unsigned int> result;
+	void initialise(void);
+	void reserve(GLuint& buffer, GLsizeiptr& bufferSize, GLsizeiptr size);
+	void requestGPU(GLuint texture, int x, int y, int w, int h, unsigned int idLimit, const std::vector<glm::ivec2>& lasso);
+	void requestCPU(GLuint FBO, GLenum attachment, int x, int y, int w, int h, unsigned int idLimit, const std::vector<glm::ivec2>& lasso);
+public:
+	bool forceCPU = false;
+
+	RegionPicker() {};
+	~RegionPicker();
+	void request(GLuint texture, GLuint FBO, GLenum attachment, int x, int y, int w, int h, unsigned int idLimit,
+				 const std::vector<glm::ivec2>& lasso = std::vector<glm::ivec2>());
+	bool poll(std::vector<unsigned int>& ids);
+	bool usesCompute(void);
+
+	static bool insideLasso(int x, int y, const std::vector<glm::ivec2>& lasso);
+	static void reduce(const GLuint* pixels, int x, int y, int w, int h, unsigned int idLimit, const std::vector<glm::ivec2>& lasso,
+					   std::vector<GLuint>& mask, std::vector<unsigned int>& ids);
+};
\ No newline at end of file
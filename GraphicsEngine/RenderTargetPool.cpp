@@ -0,0 +1,140 @@
+#pragma once
+#include "RenderTargetPool.h"
+#include "FrameBuffer.h"
+#include "GLStateCache.h"
+#include <algorithm>
+
+bool RenderTargetDescription::operator==(const RenderTargetDescription& other) const
+{
+	return width == other.width && height == other.height && internalFormat == other.internalFormat && format == other.format &&
+		dataType == other.dataType && filter == other.filter;
+}
+
+size_t RenderTargetDescription::getByteSize(void) const
+{
+	size_t bytesPerPixel = 4;
+
+	switch (internalFormat)
+	{
+	case GL_R8:
+		bytesPerPixel = 1;
+		break;
+	case GL_RG8:
+	case GL_R16F:
+		bytesPerPixel = 2;
+		break;
+	case GL_RGBA16F:
+	case GL_RG32F:
+		bytesPerPixel = 8;
+		break;
+	case GL_RGBA32F:
+	case GL_RGBA32UI:
+		bytesPerPixel = 16;
+		break;
+	default:
+		// RGB8 is padded to four bytes by every driver we care about, so it shares the default
+		break;
+	}
+
+	return bytesPerPixel * width * height;
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+	release();
+}
+
+GLuint RenderTargetPool::createTexture(const RenderTargetDescription& description)
+{
+	GLuint texture;
+
+	glGenTextures(1, &texture);
+	GLStateCache::getInstance()->bindTexture(0, GL_TEXTURE_2D, texture);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, description.internalFormat, description.width, description.height, 0, description.format,
+				 description.dataType, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, description.filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, description.filter);
+	GLStateCache::getInstance()->bindTexture(0, GL_TEXTURE_2D, 0);
+
+	return texture;
+}
+
+// Greedy interval assignment: walking the targets by first use, each one takes the first compatible texture that is
+// free again by then, and only allocates when none is. Textures left over from a previous plan are reused when they
+// still match, and deleted otherwise
+void RenderTargetPool::plan(std::vector<TransientTarget> targets)
+{
+	std::sort(targets.begin(), targets.end(), [](const TransientTarget& a, const TransientTarget& b)
+	{
+		return a.firstUse < b.firstUse;
+	});
+
+	std::vector<PhysicalTarget> available = physicalTargets;
+	std::vector<PhysicalTarget> assigned;
+	statistics = Statistics();
+
+	for (const auto& target : targets)
+	{
+		PhysicalTarget* match = nullptr;
+
+		for (auto& physical : assigned)
+		{
+			if (physical.description == target.description && physical.busyUntil < target.firstUse)
+			{
+				match = &physical;
+				break;
+			}
+		}
+
+		if (match == nullptr)
+		{
+			auto reusable = std::find_if(available.begin(), available.end(), [&target](const PhysicalTarget& physical)
+			{
+				return physical.description == target.description;
+			});
+
+			if (reusable != available.end())
+			{
+				assigned.push_back(*reusable);
+				available.erase(reusable);
+			}
+			else
+			{
+				assigned.push_back({ createTexture(target.description), target.description, 0 });
+			}
+
+			match = &assigned.back();
+			statistics.allocatedBytes += target.description.getByteSize();
+		}
+
+		match->busyUntil = target.lastUse;
+		target.frameBuffer->attachTexture(match->texture);
+		statistics.requestedBytes += target.description.getByteSize();
+	}
+
+	for (const auto& physical : available)
+	{
+		GLStateCache::getInstance()->deleteTexture(physical.texture);
+	}
+
+	physicalTargets = assigned;
+	statistics.requestedTargets = targets.size();
+	statistics.allocatedTargets = physicalTargets.size();
+}
+
+void RenderTargetPool::release(void)
+{
+	for (const auto& physical : physicalTargets)
+	{
+		GLStateCache::getInstance()->deleteTexture(physical.texture);
+	}
+
+	physicalTargets.clear();
+	statistics = Statistics();
+}
+
+const RenderTargetPool::Statistics& RenderTargetPool::getStatistics(void)
+{
+	return statistics;
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <glew.h>
+
+class DecoratedFrameBuffer;
+
+struct RenderTargetDescription
+{
+	int width;
+	int height;
+	GLint internalFormat;
+	GLenum format;
+	GLenum dataType;
+	GLenum filter;
+
+	bool operator==(const RenderTargetDescription& other) const;
+	size_t getByteSize(void) const;
+};
+
+// Hands out color textures for transient frame buffers. Targets are described up front together with the span of the
+// schedule during which they are written or read, and targets with identical descriptions whose spans don't overlap
+// end up aliasing the same texture
+class RenderTargetPool
+{
+public:
+	struct TransientTarget
+	{
+		DecoratedFrameBuffer* frameBuffer;
+		RenderTargetDescription description;
+		int firstUse;
+		int lastUse;
+	};
+
+	struct Statistics
+	{
+		size_t requestedTargets = 0;
+		size_t allocatedTargets = 0;
+		size_t requestedBytes = 0;
+		size_t allocatedBytes = 0;
+	};
+private:
+	struct PhysicalTarget
+	{
+		GLuint texture;
+		RenderTargetDescription description;
+		int busyUntil;
+	};
+
+	std::vector<PhysicalTarget> physicalTargets;
+	Statistics statistics;
+public:
+	RenderTargetPool() {};
+	~RenderTargetPool();
+	static GLuint createTexture(const RenderTargetDescription& description);
+	void plan(std::vector<TransientTarget> targets);
+	void release(void);
+	const Statistics& getStatistics(void);
+};
\ No newline at end of file
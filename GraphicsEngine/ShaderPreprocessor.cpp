@@ -0,0 +1,316 @@
+#pragma once
+#include "ShaderPreprocessor.h"
+#include "AssetArchive.h"
+#include <iostream>
+#include <algorithm>
+
+namespace
+{
+	// Decoding side of GeometryPass' COMPACT_GBUFFER. uv runs over the whole target before any resolutionScale is
+	// applied, and depth is what the DEPTH texture holds
+	const char* gBufferSource = R"(vec2 octahedronWrap(vec2 v)
+{
+	return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Unit normal to the [0, 1] pair stored in NORMALS
+vec2 encodeNormal(vec3 normal)
+{
+	normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+	normal.xy = normal.z >= 0.0 ? normal.xy : octahedronWrap(normal.xy);
+
+	return normal.xy * 0.5 + 0.5;
+}
+
+vec3 decodeNormal(vec2 encoded)
+{
+	encoded = encoded * 2.0 - 1.0;
+	vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float t = clamp(-normal.z, 0.0, 1.0);
+	normal.xy += vec2(normal.x >= 0.0 ? -t : t, normal.y >= 0.0 ? -t : t);
+
+	return normalize(normal);
+}
+
+vec3 reconstructViewPosition(vec2 uv, float depth, mat4 inverseProjection)
+{
+	vec4 position = inverseProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+
+	return position.xyz / position.w;
+}
+
+vec3 reconstructWorldPosition(vec3 viewPosition, mat4 inverseView)
+{
+	return (inverseView * vec4(viewPosition, 1.0)).xyz;
+}
+
+vec3 reconstructWorldPosition(vec2 uv, float depth, mat4 inverseProjection, mat4 inverseView)
+{
+	return reconstructWorldPosition(reconstructViewPosition(uv, depth, inverseProjection), inverseView);
+}
+)";
+
+	// Reading side of LightClusters. A fragment's lights are those of its cluster:
+	//	uvec2 clusterLights = getClusterLights(getLightCluster(uv, -viewPosition.z));
+	//	for (uint i = 0u; i < clusterLights.y; i++) { Light light = getClusterLight(clusterLights, i); ... }
+	const char* lightClustersSource = R"(struct Light
+{
+	vec4 positionRadius;
+	vec4 colorIntensity;
+};
+
+layout(std430, binding = 4) readonly buffer LightList
+{
+	Light lights[];
+};
+
+layout(std430, binding = 5) readonly buffer LightClusterGrid
+{
+	uvec4 lightClusterCount;
+	vec4 lightDepthSlicing;
+	uvec2 lightClusters[];
+};
+
+layout(std430, binding = 6) readonly buffer LightClusterIndices
+{
+	uint lightIndexCount;
+	uint lightIndices[];
+};
+
+// uv runs over the camera's viewport, viewDepth is the distance in front of the camera
+uint getLightCluster(vec2 uv, float viewDepth)
+{
+	uvec2 tile = uvec2(clamp(uv, 0.0, 0.99999) * vec2(lightClusterCount.xy));
+	float slice = log(max(viewDepth, lightDepthSlicing.z)) * lightDepthSlicing.x + lightDepthSlicing.y;
+	uint depthSlice = uint(clamp(slice, 0.0, float(lightClusterCount.z - 1u)));
+
+	return tile.x + (tile.y + depthSlice * lightClusterCount.y) * lightClusterCount.x;
+}
+
+// Offset into lightIndices and count
+uvec2 getClusterLights(uint cluster)
+{
+	return lightClusters[cluster];
+}
+
+Light getClusterLight(uvec2 clusterLights, uint i)
+{
+	return lights[lightIndices[clusterLights.x + i]];
+}
+
+// Falls smoothly to 0 at the light's radius, where culling stops considering it
+float getLightAttenuation(Light light, vec3 worldPosition)
+{
+	vec3 toLight = light.positionRadius.xyz - worldPosition;
+	float distanceSquared = dot(toLight, toLight);
+	float ratio = distanceSquared / (light.positionRadius.w * light.positionRadius.w);
+	float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+
+	return light.colorIntensity.w * window * window / (distanceSquared + 1.0);
+}
+)";
+}
+
+std::unordered_map<std::string, std::string>& ShaderPreprocessor::getBuiltInIncludes(void)
+{
+	static std::unordered_map<std::string, std::string> builtInIncludes = { { "GBuffer.glsl", gBufferSource },
+																			{ "LightClusters.glsl", lightClustersSource } };
+
+	return builtInIncludes;
+}
+
+void ShaderPreprocessor::addBuiltInInclude(const std::string& name, const std::string& source)
+{
+	getBuiltInIncludes()[name] = source;
+}
+
+std::string ShaderPreprocessor::getDirectory(const std::string& filePath)
+{
+	auto separator = filePath.find_last_of("/\\");
+
+	return separator == std::string::npos ? "" : filePath.substr(0, separator + 1);
+}
+
+// Sorted and deduplicated, so the same set always names the same variant
+std::vector<std::string> ShaderPreprocessor::canonicalizeDefines(std::vector<std::string> defines)
+{
+	std::sort(defines.begin(), defines.end());
+	defines.erase(std::unique(defines.begin(), defines.end()), defines.end());
+
+	return defines;
+}
+
+std::string ShaderPreprocessor::getDefinesKey(const std::vector<std::string>& defines)
+{
+	std::string key;
+
+	for (const auto& define : canonicalizeDefines(defines))
+	{
+		key += (key.empty() ? "" : ";") + define;
+	}
+
+	return key;
+}
+
+// "NAME" becomes "#define NAME", "NAME=VALUE" becomes "#define NAME VALUE"
+void ShaderPreprocessor::writeDefines(const std::vector<std::string>& defines, std::stringstream& output)
+{
+	for (const auto& define : defines)
+	{
+		auto equals = define.find('=');
+
+		if (equals == std::string::npos)
+		{
+			output << "#define " << define << "\n";
+		}
+		else
+		{
+			output << "#define " << define.substr(0, equals) << " " << define.substr(equals + 1) << "\n";
+		}
+	}
+}
+
+bool ShaderPreprocessor::expand(const std::string& filePath, int fileIndex, const std::vector<std::string>& defines, bool& definesWritten,
+								std::vector<std::string>& includedFiles, std::vector<std::string>& includeStack, std::stringstream& output, bool preferLooseFiles)
+{
+	// Built-in includes go by their bracketed name, which no file path can collide with
+	AssetView asset;
+	auto& builtInIncludes = getBuiltInIncludes();
+	auto builtIn = filePath.size() > 2 && filePath.front() == '<' ? builtInIncludes.find(filePath.substr(1, filePath.size() - 2)) :
+		builtInIncludes.end();
+
+	if (builtIn != builtInIncludes.end())
+	{
+		asset.data = builtIn->second.data();
+		asset.size = builtIn->second.size();
+	}
+	else
+	{
+		asset = AssetArchive::getInstance()->get(filePath, preferLooseFiles);
+	}
+
+	if (!asset.valid())
+	{
+		std::cout << "Impossible to open" << filePath << "Are you in the right directory?" << std::endl;
+		return false;
+	}
+
+	includeStack.push_back(filePath);
+
+	int lineNumber = 0;
+	bool succeeded = true;
+
+	// Lines are copied straight from the asset; only preprocessor directives are looked at more closely
+	for (auto cursor = asset.data, end = asset.data + asset.size; cursor < end;)
+	{
+		auto lineEnd = std::find(cursor, end, '\n');
+		auto lineStart = cursor;
+		cursor = lineEnd == end ? end : lineEnd + 1;
+		lineNumber++;
+
+		auto start = std::find_if(lineStart, lineEnd, [](char c) { return c != ' ' && c != '\t'; });
+
+		if (start == lineEnd || *start != '#')
+		{
+			output.write(lineStart, lineEnd - lineStart);
+			output << "\n";
+			continue;
+		}
+
+		std::string line(lineStart, lineEnd);
+		std::string directive(start, lineEnd);
+
+		if (!definesWritten && directive.compare(0, 8, "#version") == 0)
+		{
+			output << line << "\n";
+			writeDefines(defines, output);
+			output << "#line " << lineNumber + 1 << " " << fileIndex << "\n";
+			definesWritten = true;
+			continue;
+		}
+
+		if (directive.compare(0, 8, "#include") != 0)
+		{
+			output << line << "\n";
+			continue;
+		}
+
+		auto open = directive.find_first_of("\"<");
+		auto close = open == std::string::npos ? std::string::npos : directive.find_first_of("\">", open + 1);
+
+		if (close == std::string::npos)
+		{
+			std::cout << "MALFORMED INCLUDE IN " << filePath << " LINE " << lineNumber << std::endl;
+			succeeded = false;
+			continue;
+		}
+
+		auto includeName = directive.substr(open + 1, close - open - 1);
+		auto includePath = getDirectory(filePath) + includeName;
+
+		if (directive[open] == '<' && getBuiltInIncludes().count(includeName) > 0)
+		{
+			includePath = "<" + includeName + ">";
+		}
+
+		if (std::find(includeStack.begin(), includeStack.end(), includePath) != includeStack.end())
+		{
+			std::cout << "CIRCULAR INCLUDE OF " << includePath << " FROM " << filePath << std::endl;
+			succeeded = false;
+			continue;
+		}
+
+		// Every file is pulled in at most once per program
+		if (std::find(includedFiles.begin(), includedFiles.end(), includePath) == includedFiles.end())
+		{
+			int includeIndex = (int)includedFiles.size();
+			includedFiles.push_back(includePath);
+
+			output << "#line 1 " << includeIndex << "\n";
+			succeeded &= expand(includePath, includeIndex, defines, definesWritten, includedFiles, includeStack, output, preferLooseFiles);
+		}
+
+		output << "#line " << lineNumber + 1 << " " << fileIndex << "\n";
+	}
+
+	includeStack.pop_back();
+
+	return succeeded;
+}
+
+// Produces the complete source for filePath under the given defines. includedFiles receives every file the result
+// depends on, filePath first, which is what hot reloading watches. preferLooseFiles reads files on disk ahead of the
+// asset archive, so reloads pick up edits to packed shaders
+bool ShaderPreprocessor::process(const std::string& filePath, const std::vector<std::string>& defines, std::string& source,
+								 std::vector<std::string>& includedFiles, bool preferLooseFiles)
+{
+	std::stringstream output;
+	std::vector<std::string> includeStack;
+	bool definesWritten = false;
+
+	includedFiles.clear();
+	includedFiles.push_back(filePath);
+
+	auto canonicalDefines = canonicalizeDefines(defines);
+	bool succeeded = expand(filePath, 0, canonicalDefines, definesWritten, includedFiles, includeStack, output, preferLooseFiles);
+
+	if (!succeeded && output.str().empty())
+	{
+		return false;
+	}
+
+	// Without a #version line the defines simply go first
+	if (!definesWritten && !canonicalDefines.empty())
+	{
+		std::stringstream prefixed;
+		writeDefines(canonicalDefines, prefixed);
+		prefixed << "#line 1 0\n" << output.str();
+		source = prefixed.str();
+	}
+	else
+	{
+		source = output.str();
+	}
+
+	return succeeded;
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <sstream>
+#include <unordered_map>
+
+// Expands #include "file" directives (relative to the including file, each file included once) and injects a define
+// set right after #version. #line directives keep compiler messages pointing at the right line; the source string
+// number in them is the file's index in includedFiles, the top level file being 0. #include <name> pulls in a built-in
+// include when one has that name, such as GBuffer.glsl with the compact G-buffer decoding helpers or LightClusters.glsl
+// with the clustered light lists, and a file otherwise
+class ShaderPreprocessor
+{
+private:
+	static std::unordered_map<std::string, std::string>& getBuiltInIncludes(void);
+	static std::string getDirectory(const std::string& filePath);
+	static void writeDefines(const std::vector<std::string>& defines, std::stringstream& output);
+	static bool expand(const std::string& filePath, int fileIndex, const std::vector<std::string>& defines, bool& definesWritten,
+					   std::vector<std::string>& includedFiles, std::vector<std::string>& includeStack, std::stringstream& output, bool preferLooseFiles);
+public:
+	static std::vector<std::string> canonicalizeDefines(std::vector<std::string> defines);
+	static std::string getDefinesKey(const std::vector<std::string>& defines);
+	// Makes source available as #include <name>, replacing any built-in include of that name
+	static void addBuiltInInclude(const std::string& name, const std::string& source);
+	static bool process(const std::string& filePath, const std::vector<std::string>& defines, std::string& source,
+						std::vector<std::string>& includedFiles, bool preferLooseFiles = false);
+};
\ No newline at end of file
@@ -1,52 +1,81 @@
 #pragma once
 #include "ShaderProgram.h"
 #include "ShaderProgramPipeline.h"
+#include "ProgramBinaryCache.h"
+#include "ShaderWatcher.h"
+#include "ShaderPreprocessor.h"
+#include "ThreadPool.h"
+#include "GLDispatch.h"
+#include "AssetArchive.h"
+#include <chrono>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 
 std::vector<ShaderProgram*> ShaderProgram::compiledPrograms;
+std::unordered_map<SignatureID, ShaderProgram*> ShaderProgram::programsByFilePath;
+std::unordered_map<SignatureID, ShaderProgram*> ShaderProgram::programsBySignature;
+std::vector<ShaderProgram*> ShaderProgram::reloadingPrograms;
+bool ShaderProgram::hotReload = false;
+bool ShaderProgram::batching = false;
+std::unordered_map<std::string, GLuint> ShaderProgram::blockBindings;
+unsigned int ShaderProgram::generation = 0;
 
-ShaderProgram* ShaderProgram::getCompiledProgram(std::string filePath)
+ShaderProgram* ShaderProgram::getCompiledProgram(const std::string& filePath, const std::vector<std::string>& defines)
 {
-	for (int i = 0; i < compiledPrograms.size(); i++)
+	auto found = programsByFilePath.find(SignatureRegistry::findID(getVariantKey(filePath, defines)));
+
+	if (found != programsByFilePath.end())
 	{
-		if (compiledPrograms[i]->filePath == filePath)
-		{
-			return compiledPrograms[i];
-		}
+		return found->second;
 	}
 
 	return nullptr;
 }
 
-ShaderProgram* ShaderProgram::getCompiledProgramBySignature(std::string signature)
+ShaderProgram* ShaderProgram::getCompiledProgramBySignature(const std::string& signature)
 {
-	for (int i = 0; i < compiledPrograms.size(); i++)
+	auto found = programsBySignature.find(SignatureRegistry::findID(signature));
+
+	if (found != programsBySignature.end())
 	{
-		if (compiledPrograms[i]->signature == signature)
-		{
-			return compiledPrograms[i];
-		}
+		return found->second;
 	}
 
 	return nullptr;
 }
 
+// The default variant keeps the plain file path as its key
+std::string ShaderProgram::getVariantKey(const std::string& filePath, const std::vector<std::string>& defines)
+{
+	if (defines.empty())
+	{
+		return filePath;
+	}
+
+	return filePath + "#" + ShaderPreprocessor::getDefinesKey(defines);
+}
 
 ShaderProgram::ShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs,
-							 std::string signature, GLenum shader, GLenum shaderBit) : 
-	filePath(filePath), signature(signature), shader(shader), shaderBit(shaderBit)
+							 std::string signature, GLenum shader, GLenum shaderBit, const std::vector<std::string>& defines) : 
+	filePath(filePath), defines(ShaderPreprocessor::canonicalizeDefines(defines)), shader(shader), shaderBit(shaderBit),
+	signature(signature), signatureID(SignatureRegistry::getID(signature))
 {
-	loadShaderProgram();
-	bindShaderProgram();
+	for (size_t i = 0; i < uIDs.size(); i++)
+	{
+		uniformDeclarations.push_back(std::make_tuple(std::string(std::get<0>(uIDs[i])), std::get<1>(uIDs[i])));
+	}
 
-	for (int i = 0, count = 0; i < uIDs.size(); i++)
+	// compileBatch loads, compiles and resolves the program itself
+	if (batching)
 	{
-		uniformIDs[std::get<0>(uIDs[i])] = std::make_tuple(std::get<0>(uIDs[i]),
-			glGetUniformLocation(program, std::get<0>(uIDs[i])), std::get<1>(uIDs[i]),
-								 std::get<1>(uIDs[i]) == TEXTURE ? count++ : -1);
+		return;
 	}
+
+	loadShaderProgram();
+	bindShaderProgram();
+	reflect();
 }
 
 ShaderProgram::~ShaderProgram()
@@ -62,29 +91,254 @@ ShaderProgram::~ShaderProgram()
 	}
 }
 
-void ShaderProgram::loadShaderProgram()
+void ShaderProgram::loadShaderProgram(bool preferLooseFiles)
+{
+	ShaderPreprocessor::process(filePath, defines, programString, includedFiles, preferLooseFiles);
+}
+
+// Watches the files on disk the includes are read from. Built-in includes have no file behind them
+void ShaderProgram::watchIncludedFiles(void)
+{
+	for (const auto& includedFile : includedFiles)
+	{
+		if (includedFile.front() != '<')
+		{
+			ShaderWatcher::getInstance()->addPath(AssetArchive::getInstance()->getLooseFilePath(includedFile));
+		}
+	}
+}
+
+UniformType ShaderProgram::getUniformType(GLenum glType)
+{
+	switch (glType)
+	{
+	case GL_FLOAT:
+		return FLOAT;
+	case GL_UNSIGNED_INT:
+		return ONEUI;
+	case GL_UNSIGNED_INT_VEC2:
+		return TWOUI;
+	case GL_FLOAT_MAT4:
+		return MATRIX4FV;
+	case GL_FLOAT_VEC4:
+		return VECTOR4FV;
+	case GL_INT_VEC2:
+		return VECTOR2IV;
+	case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE: case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_BUFFER: case GL_SAMPLER_2D_RECT:
+	case GL_INT_SAMPLER_2D: case GL_INT_SAMPLER_3D: case GL_INT_SAMPLER_2D_ARRAY: case GL_INT_SAMPLER_BUFFER:
+	case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_3D: case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+	case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE: case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+		return TEXTURE;
+	default:
+		return OTHER;
+	}
+}
+
+std::string ShaderProgram::getResourceName(GLenum programInterface, GLuint index, GLint nameLength)
+{
+	std::vector<char> name(nameLength + 1);
+	glGetProgramResourceName(program, programInterface, index, nameLength + 1, nullptr, &name[0]);
+
+	// Arrays are reported as "name[0]" but set through their plain name
+	std::string resourceName(&name[0]);
+	auto bracket = resourceName.find("[0]");
+
+	return bracket != std::string::npos && bracket + 3 == resourceName.size() ? resourceName.substr(0, bracket) : resourceName;
+}
+
+// Rebuilds everything known about the linked program from the driver : active uniforms with their types and block
+// offsets, uniform and storage blocks, and inputs. Samplers get their texture units here, once per link, and blocks
+// named through setBlockBinding get their binding points
+void ShaderProgram::reflect(void)
+{
+	reflectedUniforms.clear();
+	reflectedInputs.clear();
+	uniformIDs.clear();
+
+	GLint uniformCount = 0;
+	glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+
+	const GLenum uniformProperties[] = { GL_NAME_LENGTH, GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE, GL_BLOCK_INDEX, GL_OFFSET };
+
+	for (GLint i = 0; i < uniformCount; i++)
+	{
+		GLint values[6];
+		glGetProgramResourceiv(program, GL_UNIFORM, i, 6, uniformProperties, 6, nullptr, values);
+
+		ReflectedUniform uniform = { getResourceName(GL_UNIFORM, i, values[0]), values[2], (GLenum)values[1], values[3], values[4],
+									 values[5], getUniformType(values[1]), -1 };
+		reflectedUniforms.push_back(uniform);
+	}
+
+	// Declared samplers take units in declaration order, which is the order passes bind their inputs in. Samplers
+	// nobody declared follow
+	int textureUnit = 0;
+
+	for (const auto& declaration : uniformDeclarations)
+	{
+		auto found = std::find_if(reflectedUniforms.begin(), reflectedUniforms.end(),
+								  [&declaration](const ReflectedUniform& uniform) { return uniform.name == std::get<0>(declaration); });
+
+		if (found == reflectedUniforms.end())
+		{
+			std::cout << "UNIFORM " << std::get<0>(declaration) << " IS NOT ACTIVE IN " << signature << std::endl;
+		}
+		else if (found->type != std::get<1>(declaration))
+		{
+			std::cout << "UNIFORM " << std::get<0>(declaration) << " IN " << signature << " IS DECLARED WITH THE WRONG TYPE" << std::endl;
+		}
+
+		if (std::get<1>(declaration) == TEXTURE)
+		{
+			if (found != reflectedUniforms.end())
+			{
+				found->textureUnit = textureUnit;
+			}
+
+			textureUnit++;
+		}
+	}
+
+	for (auto& uniform : reflectedUniforms)
+	{
+		if (uniform.type == TEXTURE && uniform.textureUnit < 0)
+		{
+			uniform.textureUnit = textureUnit;
+			textureUnit += uniform.arraySize;
+		}
+
+		if (uniform.type == TEXTURE)
+		{
+			std::vector<GLint> units(uniform.arraySize);
+
+			for (size_t i = 0; i < units.size(); i++)
+			{
+				units[i] = uniform.textureUnit + i;
+			}
+
+			glProgramUniform1iv(program, uniform.location, (GLsizei)units.size(), &units[0]);
+		}
+
+		// Block members have no location of their own
+		if (uniform.location >= 0)
+		{
+			uniformIDs[uniform.name] = std::make_tuple(uniform.name, uniform.location, uniform.type, uniform.textureUnit);
+		}
+	}
+
+	reflectBlocks();
+
+	GLint inputCount = 0;
+	glGetProgramInterfaceiv(program, GL_PROGRAM_INPUT, GL_ACTIVE_RESOURCES, &inputCount);
+
+	const GLenum inputProperties[] = { GL_NAME_LENGTH, GL_TYPE, GL_LOCATION };
+
+	for (GLint i = 0; i < inputCount; i++)
+	{
+		GLint values[3];
+		glGetProgramResourceiv(program, GL_PROGRAM_INPUT, i, 3, inputProperties, 3, nullptr, values);
+
+		ReflectedInput input = { getResourceName(GL_PROGRAM_INPUT, i, values[0]), values[2], (GLenum)values[1] };
+		reflectedInputs.push_back(input);
+	}
+}
+
+void ShaderProgram::reflectBlocks(void)
 {
-	std::string shaderCodeString;
-	std::ifstream shaderCodeStream(filePath, std::ios::in);
-	if (shaderCodeStream.is_open()) {
-		std::string Line = "";
-		while (getline(shaderCodeStream, Line))
-			shaderCodeString += "\n" + Line;
-		shaderCodeStream.close();
-		programString = shaderCodeString;
+	reflectedBlocks.clear();
+
+	const GLenum blockInterfaces[] = { GL_UNIFORM_BLOCK, GL_SHADER_STORAGE_BLOCK };
+	const GLenum blockProperties[] = { GL_NAME_LENGTH, GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+
+	for (auto blockInterface : blockInterfaces)
+	{
+		GLint blockCount = 0;
+		glGetProgramInterfaceiv(program, blockInterface, GL_ACTIVE_RESOURCES, &blockCount);
+
+		for (GLint i = 0; i < blockCount; i++)
+		{
+			GLint values[3];
+			glGetProgramResourceiv(program, blockInterface, i, 3, blockProperties, 3, nullptr, values);
+
+			ReflectedBlock block = { getResourceName(blockInterface, i, values[0]), blockInterface, (GLuint)values[1], values[2] };
+			auto binding = blockBindings.find(block.name);
+
+			if (binding != blockBindings.end() && binding->second != block.binding)
+			{
+				block.binding = binding->second;
+
+				if (blockInterface == GL_UNIFORM_BLOCK)
+				{
+					glUniformBlockBinding(program, i, block.binding);
+				}
+				else
+				{
+					glShaderStorageBlockBinding(program, i, block.binding);
+				}
+			}
+
+			reflectedBlocks.push_back(block);
+		}
 	}
-	else {
-		std::cout << "Impossible to open" << filePath << "Are you in the right directory?" << std::endl;
+}
+
+// Binds every uniform or storage block called blockName to binding, in the programs that exist and in later ones,
+// so buffer owners and shaders only have to agree on the name
+void ShaderProgram::setBlockBinding(const std::string& blockName, GLuint binding)
+{
+	blockBindings[blockName] = binding;
+
+	for (auto program : compiledPrograms)
+	{
+		program->reflectBlocks();
+	}
+}
+
+const ShaderProgram::ReflectedUniform* ShaderProgram::getReflectedUniform(const std::string& name)
+{
+	for (const auto& uniform : reflectedUniforms)
+	{
+		if (uniform.name == name)
+		{
+			return &uniform;
+		}
 	}
+
+	return nullptr;
 }
 
 void ShaderProgram::bindShaderProgram(void)
+{
+	submitShaderProgram();
+	completeShaderProgram();
+}
+
+// Takes the program from the binary cache or issues its compile, without waiting for the result
+void ShaderProgram::submitShaderProgram(void)
 {
 	std::cout << "BINDING " << signature << " SHADER..." << std::endl;
 
-	const char* pStringPointer = programString.c_str();
+	cacheKey = ProgramBinaryCache::getKey(shader, programString, ShaderPreprocessor::getDefinesKey(defines));
+	program = ProgramBinaryCache::loadProgram(cacheKey, signature);
+	cached = program != 0;
 
-	program = glCreateShaderProgramv(shader, 1, &pStringPointer);
+	if (!cached)
+	{
+		compileStart = std::chrono::steady_clock::now();
+		program = beginCompile(submittedShader);
+	}
+}
+
+// Waits for the submitted compile, reports it and registers the program if it linked
+bool ShaderProgram::completeShaderProgram(void)
+{
+	if (!cached)
+	{
+		finishCompile(program, submittedShader);
+		submittedShader = 0;
+		compileMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+	}
 
 	// Check shader program
 	GLint Result = GL_FALSE;
@@ -93,7 +347,8 @@ void ShaderProgram::bindShaderProgram(void)
 
 	std::cout << Result << " ACTIVE UNIFORMS" << std::endl;
 
-	glGetProgramiv(program, GL_ATTACHED_SHADERS, &Result);
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
 	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if (InfoLogLength > 0)
 	{
@@ -101,12 +356,403 @@ void ShaderProgram::bindShaderProgram(void)
 		glGetProgramInfoLog(program, InfoLogLength, NULL, &errorMessage[0]);
 		printf("%s\n", &errorMessage[0]);
 	}
-	else
+
+	if (linked == GL_TRUE)
 	{
+		if (!cached)
+		{
+			ProgramBinaryCache::storeProgram(cacheKey, program, compileMilliseconds);
+		}
+
 		compiledPrograms.push_back(this);
+		programsByFilePath[SignatureRegistry::getID(getVariantKey(filePath, defines))] = this;
+		programsBySignature[signatureID] = this;
+
+		if (hotReload)
+		{
+			watchIncludedFiles();
+		}
 	}
 
 	std::cout << std::endl;
+
+	return linked == GL_TRUE;
+}
+
+// Reads and preprocesses every source on worker threads, then submits all compiles before querying any of them, so
+// drivers that compile in the background (KHR_parallel_shader_compile, or their own threading) overlap the work and
+// startup waits for the slowest program rather than the sum. Returns the programs in order, nullptr where one failed.
+// Programs that already exist are returned as they are
+std::vector<ShaderProgram*> ShaderProgram::compileBatch(const std::vector<ProgramDescription>& descriptions)
+{
+	auto begin = std::chrono::steady_clock::now();
+
+	std::vector<ShaderProgram*> programs(descriptions.size(), nullptr);
+	std::vector<ShaderProgram*> submitted;
+	std::unordered_map<std::string, ShaderProgram*> submittedByKey;
+
+	batching = true;
+
+	for (size_t i = 0; i < descriptions.size(); i++)
+	{
+		const auto& description = descriptions[i];
+		auto key = getVariantKey(description.filePath, ShaderPreprocessor::canonicalizeDefines(description.defines));
+
+		programs[i] = getCompiledProgram(description.filePath, description.defines);
+
+		if (programs[i] == nullptr && submittedByKey.find(key) != submittedByKey.end())
+		{
+			programs[i] = submittedByKey[key];
+		}
+
+		if (programs[i] != nullptr)
+		{
+			continue;
+		}
+
+		switch (description.shader)
+		{
+		case GL_VERTEX_SHADER:
+			programs[i] = new VertexShaderProgram(description.filePath, description.uIDs, description.signature, description.defines);
+			break;
+		case GL_FRAGMENT_SHADER:
+			programs[i] = new FragmentShaderProgram(description.filePath, description.uIDs, description.signature, description.defines);
+			break;
+		case GL_GEOMETRY_SHADER:
+			programs[i] = new GeometryShaderProgram(description.filePath, description.uIDs, description.signature, description.defines);
+			break;
+		default:
+			std::cout << "UNSUPPORTED SHADER STAGE FOR " << description.signature << std::endl;
+			continue;
+		}
+
+		submitted.push_back(programs[i]);
+		submittedByKey[key] = programs[i];
+	}
+
+	batching = false;
+
+	// Nothing in loading touches GL
+	unsigned int threadCount = std::thread::hardware_concurrency();
+	ThreadPool loadingThreads(threadCount > 1 ? threadCount - 1 : 0);
+
+	loadingThreads.parallelFor(submitted.size(), [&submitted](size_t i)
+	{
+		submitted[i]->loadShaderProgram();
+	});
+
+	// Raises the driver's compiler thread count before anything is submitted
+	isParallelCompileSupported();
+
+	for (auto program : submitted)
+	{
+		program->submitShaderProgram();
+	}
+
+	double serialMilliseconds = 0.0;
+
+	for (auto program : submitted)
+	{
+		bool linked = program->completeShaderProgram();
+		serialMilliseconds += program->compileMilliseconds;
+
+		if (linked)
+		{
+			program->reflect();
+			continue;
+		}
+
+		std::replace(programs.begin(), programs.end(), program, (ShaderProgram*)nullptr);
+		delete program;
+	}
+
+	auto milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+	std::cout << "COMPILED " << submitted.size() << " SHADER PROGRAMS IN " << milliseconds << " MS ("
+			  << serialMilliseconds << " MS OF INDIVIDUAL COMPILE TIME)" << std::endl << std::endl;
+
+	return programs;
+}
+
+// Same as glCreateShaderProgramv, except that the program is flagged as retrievable before linking so the binary
+// cache can read it back
+GLuint ShaderProgram::compileShaderProgram(void)
+{
+	GLuint shaderObject;
+	GLuint compiledProgram = beginCompile(shaderObject);
+	finishCompile(compiledProgram, shaderObject);
+
+	return compiledProgram;
+}
+
+// Issues the compile and link without querying anything, so drivers that compile in the background can return at once
+GLuint ShaderProgram::beginCompile(GLuint& shaderObject)
+{
+	const char* pStringPointer = programString.c_str();
+
+	shaderObject = glCreateShader(shader);
+	glShaderSource(shaderObject, 1, &pStringPointer, NULL);
+	glCompileShader(shaderObject);
+
+	GLuint compiledProgram = glCreateProgram();
+	glProgramParameteri(compiledProgram, GL_PROGRAM_SEPARABLE, GL_TRUE);
+	glProgramParameteri(compiledProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glAttachShader(compiledProgram, shaderObject);
+	glLinkProgram(compiledProgram);
+
+	return compiledProgram;
+}
+
+// Waits for the compile if it's still running, prints the shader log if it failed and releases the shader object
+bool ShaderProgram::finishCompile(GLuint compiledProgram, GLuint shaderObject)
+{
+	GLint compiled = GL_FALSE;
+	glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &compiled);
+
+	if (compiled != GL_TRUE)
+	{
+		int infoLogLength;
+		glGetShaderiv(shaderObject, GL_INFO_LOG_LENGTH, &infoLogLength);
+
+		if (infoLogLength > 0)
+		{
+			std::vector<char> errorMessage(infoLogLength + 1);
+			glGetShaderInfoLog(shaderObject, infoLogLength, NULL, &errorMessage[0]);
+			printf("%s\n", &errorMessage[0]);
+		}
+	}
+
+	glDetachShader(compiledProgram, shaderObject);
+	glDeleteShader(shaderObject);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(compiledProgram, GL_LINK_STATUS, &linked);
+
+	return compiled == GL_TRUE && linked == GL_TRUE;
+}
+
+bool ShaderProgram::isParallelCompileSupported(void)
+{
+	static int supported = -1;
+
+	if (supported < 0)
+	{
+		supported = (GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile) ? 1 : 0;
+
+		if (supported)
+		{
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		}
+	}
+
+	return supported == 1;
+}
+
+void ShaderProgram::setHotReload(bool enabled)
+{
+	hotReload = enabled;
+
+	if (!enabled)
+	{
+		ShaderWatcher::getInstance()->stop();
+		return;
+	}
+
+	for (auto program : compiledPrograms)
+	{
+		program->watchIncludedFiles();
+	}
+
+	ShaderWatcher::getInstance()->start();
+}
+
+unsigned int ShaderProgram::getGeneration(void)
+{
+	return generation;
+}
+
+// Rereads the source and starts compiling it next to the live program, which keeps being used until the new one is
+// ready. A reload already in flight is abandoned in favour of the newer source
+void ShaderProgram::beginReload(void)
+{
+	if (pendingProgram != 0)
+	{
+		glDetachShader(pendingProgram, pendingShader);
+		glDeleteShader(pendingShader);
+		glDeleteProgram(pendingProgram);
+	}
+	else
+	{
+		reloadingPrograms.push_back(this);
+	}
+
+	std::cout << "RELOADING " << signature << " SHADER..." << std::endl;
+
+	// The edit is on disk, even if the shader was first loaded from the asset archive
+	loadShaderProgram(true);
+	reloadStart = std::chrono::steady_clock::now();
+
+	// An edit may have pulled in new includes
+	if (hotReload)
+	{
+		watchIncludedFiles();
+	}
+
+	pendingProgram = beginCompile(pendingShader);
+}
+
+ShaderProgram::ReloadStatus ShaderProgram::pollReload(void)
+{
+	if (isParallelCompileSupported())
+	{
+		GLint completed = GL_FALSE;
+		glGetProgramiv(pendingProgram, GL_COMPLETION_STATUS_KHR, &completed);
+
+		if (completed != GL_TRUE)
+		{
+			return RELOAD_PENDING;
+		}
+	}
+
+	GLuint compiledProgram = pendingProgram;
+	pendingProgram = 0;
+
+	if (!finishCompile(compiledProgram, pendingShader))
+	{
+		int infoLogLength;
+		glGetProgramiv(compiledProgram, GL_INFO_LOG_LENGTH, &infoLogLength);
+
+		if (infoLogLength > 0)
+		{
+			std::vector<char> errorMessage(infoLogLength + 1);
+			glGetProgramInfoLog(compiledProgram, infoLogLength, NULL, &errorMessage[0]);
+			printf("%s\n", &errorMessage[0]);
+		}
+
+		std::cout << "RELOAD OF " << signature << " FAILED, KEEPING THE PREVIOUS PROGRAM" << std::endl;
+		glDeleteProgram(compiledProgram);
+
+		return RELOAD_FAILED;
+	}
+
+	compileMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reloadStart).count();
+
+	GLuint previousProgram = program;
+	program = compiledProgram;
+
+	reflect();
+
+	for (auto pipeline : ShaderProgramPipeline::pipelines)
+	{
+		if (pipeline->attachedProgramsBySignature.find(signatureID) != pipeline->attachedProgramsBySignature.end())
+		{
+			glUseProgramStages(pipeline->pipeline, shaderBit, program);
+			pipeline->warmed = false;
+
+			if (pipeline->depthOnlyPipeline != 0 && shader != GL_FRAGMENT_SHADER)
+			{
+				glUseProgramStages(pipeline->depthOnlyPipeline, shaderBit, program);
+			}
+		}
+	}
+
+	glDeleteProgram(previousProgram);
+	ProgramBinaryCache::storeProgram(ProgramBinaryCache::getKey(shader, programString, ShaderPreprocessor::getDefinesKey(defines)),
+									program, compileMilliseconds);
+
+	std::cout << "RELOADED " << signature << " IN " << compileMilliseconds << " MS" << std::endl;
+
+	return RELOAD_SWAPPED;
+}
+
+// Called on the GL thread between frames. Starts reloads for changed files and swaps in every program that has
+// finished linking. Returns true if anything was swapped, in which case the generation moves on and passes refresh
+// their uniform tables before recording the next frame
+bool ShaderProgram::processReloads(void)
+{
+	if (!hotReload)
+	{
+		return false;
+	}
+
+	// A changed include reloads every variant of every program built from it
+	for (const auto& path : ShaderWatcher::getInstance()->takeChangedPaths())
+	{
+		for (auto program : compiledPrograms)
+		{
+			if (program->includes(path))
+			{
+				program->beginReload();
+			}
+		}
+	}
+
+	bool swapped = false;
+
+	for (auto reloading = reloadingPrograms.begin(); reloading != reloadingPrograms.end();)
+	{
+		auto status = (*reloading)->pollReload();
+
+		if (status == RELOAD_PENDING)
+		{
+			reloading++;
+			continue;
+		}
+
+		swapped |= status == RELOAD_SWAPPED;
+		reloading = reloadingPrograms.erase(reloading);
+	}
+
+	if (swapped)
+	{
+		generation++;
+		ShaderProgramPipeline::warmUpChanged();
+	}
+
+	return swapped;
+}
+
+// path is a watched path, so it is matched against where each include is read from on disk
+bool ShaderProgram::includes(const std::string& path)
+{
+	auto archive = AssetArchive::getInstance();
+
+	return std::any_of(includedFiles.begin(), includedFiles.end(),
+					   [&](const std::string& includedFile) { return archive->getLooseFilePath(includedFile) == path; });
+}
+
+// Returns this program compiled with variantDefines on top of its own defines, compiling it on first use
+ShaderProgram* ShaderProgram::getVariant(const std::vector<std::string>& variantDefines)
+{
+	auto variant = defines;
+	variant.insert(variant.end(), variantDefines.begin(), variantDefines.end());
+	variant = ShaderPreprocessor::canonicalizeDefines(variant);
+
+	if (variant == defines)
+	{
+		return this;
+	}
+
+	std::vector<std::tuple<const GLchar*, UniformType>> uIDs;
+
+	for (const auto& declaration : uniformDeclarations)
+	{
+		uIDs.push_back(std::make_tuple(std::get<0>(declaration).c_str(), std::get<1>(declaration)));
+	}
+
+	auto variantSignature = signature + "[" + ShaderPreprocessor::getDefinesKey(variantDefines) + "]";
+
+	switch (shader)
+	{
+	case GL_VERTEX_SHADER:
+		return getShaderProgram<VertexShaderProgram>(filePath, uIDs, variantSignature, variant);
+	case GL_FRAGMENT_SHADER:
+		return getShaderProgram<FragmentShaderProgram>(filePath, uIDs, variantSignature, variant);
+	case GL_GEOMETRY_SHADER:
+		return getShaderProgram<GeometryShaderProgram>(filePath, uIDs, variantSignature, variant);
+	default:
+		return nullptr;
+	}
 }
 
 void ShaderProgram::attachToPipeline(ShaderProgramPipeline* pipeline)
@@ -116,26 +762,32 @@ void ShaderProgram::attachToPipeline(ShaderProgramPipeline* pipeline)
 
 GLint ShaderProgram::getLocationBySignature(std::string s)
 {
-	if (uniformIDs.find(s) != uniformIDs.end())
+	auto found = uniformIDs.find(s);
+
+	if (found != uniformIDs.end())
 	{
-		return std::get<1>(uniformIDs[s]);
+		return std::get<1>(found->second);
 	}
 
-	return 0;
+	// Like glGetUniformLocation, so setting an unknown uniform is ignored rather than hitting location 0
+	return -1;
 }
 
-VertexShaderProgram::VertexShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs, std::string signature) :
-	ShaderProgram(filePath, uIDs, signature, GL_VERTEX_SHADER, GL_VERTEX_SHADER_BIT)
+VertexShaderProgram::VertexShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs, std::string signature,
+										 const std::vector<std::string>& defines) :
+	ShaderProgram(filePath, uIDs, signature, GL_VERTEX_SHADER, GL_VERTEX_SHADER_BIT, defines)
 {
 }
 
-FragmentShaderProgram::FragmentShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs, std::string signature) :
-	ShaderProgram(filePath, uIDs, signature, GL_FRAGMENT_SHADER, GL_FRAGMENT_SHADER_BIT)
+FragmentShaderProgram::FragmentShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs, std::string signature,
+										 const std::vector<std::string>& defines) :
+	ShaderProgram(filePath, uIDs, signature, GL_FRAGMENT_SHADER, GL_FRAGMENT_SHADER_BIT, defines)
 {
 }
 
-GeometryShaderProgram::GeometryShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs, std::string signature) :
-	ShaderProgram(filePath, uIDs, signature, GL_GEOMETRY_SHADER, GL_GEOMETRY_SHADER_BIT)
+GeometryShaderProgram::GeometryShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs, std::string signature,
+										 const std::vector<std::string>& defines) :
+	ShaderProgram(filePath, uIDs, signature, GL_GEOMETRY_SHADER, GL_GEOMETRY_SHADER_BIT, defines)
 {
 
 }
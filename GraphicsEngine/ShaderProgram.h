@@ -3,48 +3,158 @@
 #include <string>
 #include <tuple>
 #include <map>
+#include <unordered_map>
+#include <chrono>
 #include "glew.h"
+#include "SignatureRegistry.h"
 
 class ShaderProgramPipeline;
 
-enum UniformType {FLOAT, ONEUI, TWOUI, MATRIX4FV, VECTOR4FV, VECTOR2IV, TEXTURE};
+enum UniformType {FLOAT, ONEUI, TWOUI, MATRIX4FV, VECTOR4FV, VECTOR2IV, TEXTURE, OTHER};
 
 class ShaderProgram
 {
+public:
+	enum ReloadStatus { RELOAD_PENDING, RELOAD_SWAPPED, RELOAD_FAILED };
+	// One entry of a compileBatch
+	struct ProgramDescription
+	{
+		std::string filePath;
+		std::vector<std::tuple<const GLchar*, UniformType>> uIDs;
+		std::string signature;
+		GLenum shader;
+		std::vector<std::string> defines;
+	};
+	// What reflection finds in a linked program. Block members carry their block index and byte offset, everything
+	// else has block index -1 and a location
+	struct ReflectedUniform
+	{
+		std::string name;
+		GLint location;
+		GLenum glType;
+		GLint arraySize;
+		GLint blockIndex;
+		GLint offset;
+		UniformType type;
+		int textureUnit;
+	};
+	struct ReflectedBlock
+	{
+		std::string name;
+		GLenum blockInterface;
+		GLuint binding;
+		GLint dataSize;
+	};
+	struct ReflectedInput
+	{
+		std::string name;
+		GLint location;
+		GLenum glType;
+	};
 protected:
-	static ShaderProgram* getCompiledProgram(std::string filePath);
-	static ShaderProgram* getCompiledProgramBySignature(std::string signature);
+	static std::vector<ShaderProgram*> reloadingPrograms;
+	static bool hotReload;
+	// Set while compileBatch constructs programs, which then leave loading and compiling to it
+	static bool batching;
+	// State carried from submitShaderProgram to completeShaderProgram
+	GLuint submittedShader = 0;
+	bool cached = false;
+	unsigned long long cacheKey = 0;
+	std::chrono::time_point<std::chrono::steady_clock> compileStart;
+	void submitShaderProgram(void);
+	bool completeShaderProgram(void);
+	static std::unordered_map<std::string, GLuint> blockBindings;
+	static UniformType getUniformType(GLenum glType);
+	std::string getResourceName(GLenum programInterface, GLuint index, GLint nameLength);
+	void reflect(void);
+	void reflectBlocks(void);
+	static unsigned int generation;
+	// Replacement being compiled by a hot reload, swapped in by pollReload once it has linked
+	GLuint pendingProgram = 0;
+	GLuint pendingShader = 0;
+	std::chrono::time_point<std::chrono::steady_clock> reloadStart;
+	GLuint beginCompile(GLuint& shaderObject);
+	bool finishCompile(GLuint compiledProgram, GLuint shaderObject);
+	void beginReload(void);
+	ReloadStatus pollReload(void);
+	static bool isParallelCompileSupported(void);
+	static std::unordered_map<SignatureID, ShaderProgram*> programsByFilePath;
+	static std::unordered_map<SignatureID, ShaderProgram*> programsBySignature;
+	static ShaderProgram* getCompiledProgram(const std::string& filePath,
+											 const std::vector<std::string>& defines = std::vector<std::string>());
+	static ShaderProgram* getCompiledProgramBySignature(const std::string& signature);
+	static std::string getVariantKey(const std::string& filePath, const std::vector<std::string>& defines);
 	ShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs,
-				  std::string signature, GLenum shader, GLenum shaderBit);
-	~ShaderProgram();
+				  std::string signature, GLenum shader, GLenum shaderBit,
+				  const std::vector<std::string>& defines = std::vector<std::string>());
+	virtual ~ShaderProgram();
 public:
 	static std::vector<ShaderProgram*> compiledPrograms;
 	template<class T> static T* getShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs,
 												 std::string signature);
+	template<class T> static T* getShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs,
+												 std::string signature, const std::vector<std::string>& defines);
+	template<class T> static T* getShaderProgram(std::string filePath, std::string signature,
+												 const std::vector<std::string>& defines = std::vector<std::string>());
 	template<class T> static T* getShaderProgram(std::string filePath);
+	static std::vector<ShaderProgram*> compileBatch(const std::vector<ProgramDescription>& descriptions);
+	static void setBlockBinding(const std::string& blockName, GLuint binding);
+	static void setHotReload(bool enabled);
+	static bool processReloads(void);
+	static unsigned int getGeneration(void);
 	std::string filePath;
+	// Canonical define set this variant was compiled with, and every file its source was assembled from
+	std::vector<std::string> defines;
+	std::vector<std::string> includedFiles;
+	// Uniforms in the order they were declared, so variants assign texture units the same way. Declaring is optional,
+	// reflection finds every active uniform; declared ones are checked against it and fix the sampler order
+	std::vector<std::tuple<std::string, UniformType>> uniformDeclarations;
+	std::vector<ReflectedUniform> reflectedUniforms;
+	std::vector<ReflectedBlock> reflectedBlocks;
+	std::vector<ReflectedInput> reflectedInputs;
 	std::string programString;
 	GLuint program;
 	GLenum shader;
 	GLenum shaderBit;
 	std::string signature;
+	SignatureID signatureID;
+	// 0 when the program came from the binary cache
+	double compileMilliseconds = 0.0;
 	std::map<std::string, std::tuple<std::string, GLint, UniformType, int>> uniformIDs;
 	virtual void bindShaderProgram();
-	virtual void loadShaderProgram();
+	virtual void loadShaderProgram(bool preferLooseFiles = false);
+	void watchIncludedFiles(void);
+	GLuint compileShaderProgram(void);
+	bool includes(const std::string& filePath);
+	ShaderProgram* getVariant(const std::vector<std::string>& variantDefines);
 	virtual void attachToPipeline(ShaderProgramPipeline* pipeline);
 	GLint getLocationBySignature(std::string s);
+	const ReflectedUniform* getReflectedUniform(const std::string& name);
 };
 
 template<class T> T* ShaderProgram::getShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs,
 													 std::string signature)
 {
-	T* prog = (T*)getCompiledProgram(filePath);
+	return getShaderProgram<T>(filePath, uIDs, signature, std::vector<std::string>());
+}
+
+// Uniforms come from reflection alone
+template<class T> T* ShaderProgram::getShaderProgram(std::string filePath, std::string signature, const std::vector<std::string>& defines)
+{
+	return getShaderProgram<T>(filePath, std::vector<std::tuple<const GLchar*, UniformType>>(), signature, defines);
+}
+
+// Programs are keyed by file and define set; a variant is compiled the first time it is asked for and shared afterwards
+template<class T> T* ShaderProgram::getShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs,
+													 std::string signature, const std::vector<std::string>& defines)
+{
+	T* prog = (T*)getCompiledProgram(filePath, defines);
 
 	if (prog == nullptr)
 	{
-		prog = new T(filePath, uIDs, signature);
+		prog = new T(filePath, uIDs, signature, defines);
 
-		if (getCompiledProgram(filePath) == nullptr)
+		if (getCompiledProgram(filePath, defines) == nullptr)
 		{
 			delete prog;
 			prog = nullptr;
@@ -62,21 +172,24 @@ template<class T> T* ShaderProgram::getShaderProgram(std::string signature)
 class VertexShaderProgram : public ShaderProgram
 {
 public:
-	VertexShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs, std::string signature);
+	VertexShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs, std::string signature,
+						  const std::vector<std::string>& defines = std::vector<std::string>());
 	~VertexShaderProgram() {};
 };
 
 class FragmentShaderProgram : public ShaderProgram
 {
 public:
-	FragmentShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs, std::string signature);
+	FragmentShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs, std::string signature,
+						  const std::vector<std::string>& defines = std::vector<std::string>());
 	~FragmentShaderProgram() {};
 };
 
 class GeometryShaderProgram : public ShaderProgram
 {
 public:
-	GeometryShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs, std::string signature);
+	GeometryShaderProgram(std::string filePath, std::vector<std::tuple<const GLchar*, UniformType>> uIDs, std::string signature,
+						  const std::vector<std::string>& defines = std::vector<std::string>());
 	~GeometryShaderProgram() {};
 	void setGeometryInputType(GLuint type);
 	void setGeometryOutputType(GLuint type);
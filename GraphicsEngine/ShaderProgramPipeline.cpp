@@ -1,41 +1,176 @@
 #pragma once
 #include "ShaderProgramPipeline.h"
 #include "ShaderProgram.h"
+#include "GLStateCache.h"
+#include "ShaderPreprocessor.h"
 #include <iostream>
+#include <chrono>
+#include <algorithm>
 
 std::vector<ShaderProgramPipeline*> ShaderProgramPipeline::pipelines;
+std::unordered_map<SignatureID, ShaderProgramPipeline*> ShaderProgramPipeline::pipelinesBySignature;
+bool ShaderProgramPipeline::warmUpStarted = false;
 
 ShaderProgramPipeline* ShaderProgramPipeline::getPipeline(std::string s)
 {
-	for (int i = 0; i < pipelines.size(); i++)
+	auto found = pipelinesBySignature.find(SignatureRegistry::getID(s));
+
+	if (found != pipelinesBySignature.end())
+	{
+		return found->second;
+	}
+
+	auto p = new ShaderProgramPipeline(s);
+
+	found = pipelinesBySignature.find(p->signatureID);
+
+	if (found != pipelinesBySignature.end())
 	{
-		if (pipelines[i]->signature == s)
+		return found->second;
+	}
+
+	delete p;
+	return nullptr;
+}
+
+// The pipeline s with every attached program swapped for its variant under defines. Variants are built once and
+// registered under "s[defines]"
+ShaderProgramPipeline* ShaderProgramPipeline::getPipelineVariant(std::string s, const std::vector<std::string>& defines)
+{
+	auto key = ShaderPreprocessor::getDefinesKey(defines);
+	auto base = getPipeline(s);
+
+	if (base == nullptr || key.empty())
+	{
+		return base;
+	}
+
+	auto variantSignature = s + "[" + key + "]";
+	auto found = pipelinesBySignature.find(SignatureRegistry::findID(variantSignature));
+
+	if (found != pipelinesBySignature.end())
+	{
+		return found->second;
+	}
+
+	auto variant = getPipeline(variantSignature);
+
+	if (variant == nullptr)
+	{
+		return nullptr;
+	}
+
+	variant->alphaRendered = base->alphaRendered;
+	variant->cullFace = base->cullFace;
+	variant->setDepthPrePass(base->depthPrePass);
+
+	for (auto program : base->attachedPrograms)
+	{
+		auto variantProgram = program->getVariant(defines);
+
+		if (variantProgram == nullptr)
 		{
-			return pipelines[i];
+			std::cout << "FAILED TO BUILD VARIANT " << variantSignature << ", FALLING BACK TO " << s << std::endl;
+			return base;
 		}
+
+		variantProgram->attachToPipeline(variant);
 	}
 
-	auto p = new ShaderProgramPipeline(s);
+	warmUpChanged();
+
+	return variant;
+}
+
+// Many drivers finish compiling, or recompile for the actual state, the first time a program is drawn with. This draws
+// a few vertices through every pipeline that hasn't been used yet, with rasterization discarded, so that happens during
+// startup instead of on the first frames
+void ShaderProgramPipeline::warmUp(void)
+{
+	warmUpStarted = true;
+	auto begin = std::chrono::steady_clock::now();
+	auto stateCache = GLStateCache::getInstance();
+	int warmedCount = 0;
+
+	GLuint vertexArray;
+	glGenVertexArrays(1, &vertexArray);
+	stateCache->bindVertexArray(vertexArray);
+	stateCache->setRasterizerDiscard(true);
 
-	for (int i = 0; i < pipelines.size(); i++)
+	for (auto pipeline : pipelines)
 	{
-		if (pipelines[i]->signature == s)
+		if (pipeline->warmed || pipeline->attachedPrograms.empty())
+		{
+			continue;
+		}
+
+		GLenum mode = pipeline->getWarmUpMode();
+		pipeline->use();
+		glDrawArrays(mode, 0, 6);
+
+		if (pipeline->depthOnlyPipeline != 0)
 		{
-			return pipelines[i];
+			stateCache->bindProgramPipeline(pipeline->depthOnlyPipeline);
+			glDrawArrays(mode, 0, 6);
 		}
+
+		pipeline->warmed = true;
+		warmedCount++;
 	}
 
-	delete p;
-	return nullptr;
+	stateCache->setRasterizerDiscard(false);
+	stateCache->deleteVertexArray(vertexArray);
+
+	if (warmedCount == 0)
+	{
+		return;
+	}
+
+	auto milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+	std::cout << "WARMED UP " << warmedCount << " PIPELINES IN " << milliseconds << " MS" << std::endl << std::endl;
+}
+
+void ShaderProgramPipeline::warmUpChanged(void)
+{
+	bool changed = std::any_of(pipelines.begin(), pipelines.end(), [](ShaderProgramPipeline* pipeline)
+	{
+		return !pipeline->warmed && !pipeline->attachedPrograms.empty();
+	});
+
+	if (warmUpStarted && changed)
+	{
+		warmUp();
+	}
+}
+
+// The primitive has to be what the first stage after the vertex one takes: patches for tessellation, or the input
+// type of a geometry stage. Six vertices make at least one primitive of any kind
+GLenum ShaderProgramPipeline::getWarmUpMode(void)
+{
+	if (getProgramByEnum(GL_TESS_CONTROL_SHADER) != nullptr || getProgramByEnum(GL_TESS_EVALUATION_SHADER) != nullptr)
+	{
+		return GL_PATCHES;
+	}
+
+	GLint mode = GL_TRIANGLES;
+	auto geometryProgram = getProgramByEnum(GL_GEOMETRY_SHADER);
+
+	if (geometryProgram != nullptr)
+	{
+		glGetProgramiv(geometryProgram->program, GL_GEOMETRY_INPUT_TYPE, &mode);
+	}
+
+	return (GLenum)mode;
 }
 
-ShaderProgramPipeline::ShaderProgramPipeline(std::string s) : signature(s)
+ShaderProgramPipeline::ShaderProgramPipeline(std::string s) : signature(s), signatureID(SignatureRegistry::getID(s))
 {
 	glGetError();
 
 	std::cout << "CREATING PROGRAM PIPELINE..." << std::endl;
 	glGenProgramPipelines(1, &pipeline);
-	glBindProgramPipeline(pipeline);
+	GLStateCache::getInstance()->bindProgramPipeline(pipeline);
 	
 	GLenum error = glGetError();
 
@@ -46,6 +181,7 @@ ShaderProgramPipeline::ShaderProgramPipeline(std::string s) : signature(s)
 	else
 	{
 		pipelines.push_back(this);
+		pipelinesBySignature[signatureID] = this;
 	}
 
 	std::cout << std::endl;
@@ -55,7 +191,13 @@ ShaderProgramPipeline::~ShaderProgramPipeline()
 {
 	glGetError();
 	std::cout << "DELETING SHADER PROGRAM " << signature << std::endl;
-	glDeleteProgramPipelines(1, &pipeline);
+	GLStateCache::getInstance()->deleteProgramPipeline(pipeline);
+
+	if (depthOnlyPipeline != 0)
+	{
+		GLStateCache::getInstance()->deleteProgramPipeline(depthOnlyPipeline);
+	}
+
 	GLenum error = glGetError();
 
 	if (error != GL_NO_ERROR)
@@ -71,6 +213,11 @@ void ShaderProgramPipeline::attachProgram(ShaderProgram* program)
 	std::cout << "ATTACHING " << program->signature << " TO PIPELINE " << pipeline << std::endl;
 
 	glUseProgramStages(pipeline, program->shaderBit, program->program);
+
+	if (depthOnlyPipeline != 0 && program->shader != GL_FRAGMENT_SHADER)
+	{
+		glUseProgramStages(depthOnlyPipeline, program->shaderBit, program->program);
+	}
 	
 	// Check program pipeline
 	GLint Result = GL_FALSE;
@@ -97,23 +244,48 @@ void ShaderProgramPipeline::attachProgram(ShaderProgram* program)
 
 
 	attachedPrograms.push_back(program);
+	attachedProgramsBySignature[program->signatureID] = program;
+	warmed = false;
 }
 
 void ShaderProgramPipeline::use(void)
 {
-	glBindProgramPipeline(pipeline);
+	GLStateCache::getInstance()->bindProgramPipeline(pipeline);
 }
 
-ShaderProgram* ShaderProgramPipeline::getProgramBySignature(std::string signature)
+// Programs attached later are added to the depth only pipeline as they come, so this can be set at any point
+void ShaderProgramPipeline::setDepthPrePass(bool enabled)
 {
-	for (int i = 0; i < attachedPrograms.size(); i++)
+	depthPrePass = enabled;
+
+	if (!enabled || depthOnlyPipeline != 0)
+	{
+		return;
+	}
+
+	glGenProgramPipelines(1, &depthOnlyPipeline);
+	warmed = false;
+
+	for (auto program : attachedPrograms)
 	{
-		if (attachedPrograms[i]->signature == signature)
+		if (program->shader != GL_FRAGMENT_SHADER)
 		{
-			return attachedPrograms[i];
+			glUseProgramStages(depthOnlyPipeline, program->shaderBit, program->program);
 		}
 	}
 
+	warmUpChanged();
+}
+
+ShaderProgram* ShaderProgramPipeline::getProgramBySignature(std::string signature)
+{
+	auto found = attachedProgramsBySignature.find(SignatureRegistry::findID(signature));
+
+	if (found != attachedProgramsBySignature.end())
+	{
+		return found->second;
+	}
+
 	return nullptr;
 }
 
@@ -134,12 +306,11 @@ GLint ShaderProgramPipeline::getUniformByID(std::string signature)
 {
 	for (int i = 0; i < attachedPrograms.size(); i++)
 	{
-		for (const auto& uniformID : attachedPrograms[i]->uniformIDs)
+		auto found = attachedPrograms[i]->uniformIDs.find(signature);
+
+		if (found != attachedPrograms[i]->uniformIDs.end())
 		{
-			if (std::get<0>(uniformID.second) == signature)
-			{
-				return std::get<1>(uniformID.second);
-			}
+			return std::get<1>(found->second);
 		}
 	}
 
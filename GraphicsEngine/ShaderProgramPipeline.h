@@ -1,25 +1,45 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include <glew.h>
+#include "SignatureRegistry.h"
 
 class ShaderProgram;
 
 class ShaderProgramPipeline
 {
 private:
+	// Set by the first warmUp, after which pipelines built or relinked later are warmed as they come
+	static bool warmUpStarted;
 	ShaderProgramPipeline(std::string s);
 	~ShaderProgramPipeline();
+	GLenum getWarmUpMode(void);
 public:
 	bool alphaRendered = false;
 	bool cullFace = false;
+	// Lay down depth in a pre-pass before shading, in GeometryPasses. Unsuitable for fragment shaders that discard or
+	// write gl_FragDepth; set through setDepthPrePass
+	bool depthPrePass = false;
+	// Set once the pipeline has been drawn with by warmUp, and cleared when its programs change
+	bool warmed = false;
 	static std::vector<ShaderProgramPipeline*> pipelines;
+	static std::unordered_map<SignatureID, ShaderProgramPipeline*> pipelinesBySignature;
 	static ShaderProgramPipeline* getPipeline(std::string s);
+	static ShaderProgramPipeline* getPipelineVariant(std::string s, const std::vector<std::string>& defines);
+	static void warmUp(void);
+	// Warms the pipelines that aren't, if warmUp has run before. Must run on the GL thread
+	static void warmUpChanged(void);
 	std::string signature;
+	SignatureID signatureID;
 	GLuint pipeline;
+	// Every stage but the fragment one, for drawing into depth only. 0 unless depthPrePass has been set
+	GLuint depthOnlyPipeline = 0;
 	std::vector<ShaderProgram*> attachedPrograms;
+	std::unordered_map<SignatureID, ShaderProgram*> attachedProgramsBySignature;
 	void attachProgram(ShaderProgram* program);
 	void use(void);
+	void setDepthPrePass(bool enabled);
 	ShaderProgram* getProgramBySignature(std::string s);
 	ShaderProgram* getProgramByEnum(GLenum e);
 	GLint getUniformByID(std::string s);
@@ -0,0 +1,224 @@
+#pragma once
+#include "ShaderWatcher.h"
+#include <iostream>
+#include <chrono>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+ShaderWatcher* ShaderWatcher::watcher = nullptr;
+
+ShaderWatcher* ShaderWatcher::getInstance()
+{
+	if (watcher == nullptr)
+	{
+		watcher = new ShaderWatcher();
+	}
+
+	return watcher;
+}
+
+ShaderWatcher::ShaderWatcher() : running(false)
+{
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+	stop();
+}
+
+void ShaderWatcher::start(void)
+{
+	if (running)
+	{
+		return;
+	}
+
+#ifdef __linux__
+	inotifyDescriptor = inotify_init1(IN_NONBLOCK);
+
+	if (inotifyDescriptor < 0)
+	{
+		std::cout << "INOTIFY UNAVAILABLE, POLLING SHADER FILES INSTEAD" << std::endl;
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(pathMutex);
+
+		for (const auto& directory : watchedPaths)
+		{
+			watchDirectory(directory.first);
+		}
+	}
+#endif
+
+	running = true;
+	thread = std::thread(&ShaderWatcher::watch, this);
+
+	std::cout << "WATCHING SHADER FILES FOR CHANGES" << std::endl;
+}
+
+void ShaderWatcher::stop(void)
+{
+	if (!running)
+	{
+		return;
+	}
+
+	running = false;
+	thread.join();
+
+#ifdef __linux__
+	if (inotifyDescriptor >= 0)
+	{
+		close(inotifyDescriptor);
+		inotifyDescriptor = -1;
+		watchDescriptors.clear();
+	}
+#endif
+}
+
+std::string ShaderWatcher::getDirectory(const std::string& filePath)
+{
+	auto separator = filePath.find_last_of("/\\");
+
+	return separator == std::string::npos ? "." : filePath.substr(0, separator);
+}
+
+long long ShaderWatcher::getModificationTime(const std::string& filePath)
+{
+	struct stat status;
+
+	if (stat(filePath.c_str(), &status) != 0)
+	{
+		return 0;
+	}
+
+	return (long long)status.st_mtime;
+}
+
+// Callers hold pathMutex
+void ShaderWatcher::watchDirectory(const std::string& directory)
+{
+#ifdef __linux__
+	if (inotifyDescriptor < 0)
+	{
+		return;
+	}
+
+	int descriptor = inotify_add_watch(inotifyDescriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+
+	if (descriptor < 0)
+	{
+		std::cout << "COULD NOT WATCH " << directory << std::endl;
+		return;
+	}
+
+	watchDescriptors[descriptor] = directory;
+#endif
+}
+
+void ShaderWatcher::addPath(const std::string& filePath)
+{
+	std::lock_guard<std::mutex> lock(pathMutex);
+
+	auto directory = getDirectory(filePath);
+	bool newDirectory = watchedPaths.find(directory) == watchedPaths.end();
+
+	watchedPaths[directory].insert(filePath);
+	modificationTimes[filePath] = getModificationTime(filePath);
+
+	if (newDirectory && running)
+	{
+		watchDirectory(directory);
+	}
+}
+
+std::vector<std::string> ShaderWatcher::takeChangedPaths(void)
+{
+	std::lock_guard<std::mutex> lock(pathMutex);
+
+	std::vector<std::string> paths(changedPaths.begin(), changedPaths.end());
+	changedPaths.clear();
+
+	return paths;
+}
+
+// Callers hold pathMutex
+void ShaderWatcher::pathChanged(const std::string& filePath)
+{
+	modificationTimes[filePath] = getModificationTime(filePath);
+	changedPaths.insert(filePath);
+}
+
+void ShaderWatcher::pollModificationTimes(void)
+{
+	std::lock_guard<std::mutex> lock(pathMutex);
+
+	for (auto& modificationTime : modificationTimes)
+	{
+		auto current = getModificationTime(modificationTime.first);
+
+		if (current != 0 && current != modificationTime.second)
+		{
+			pathChanged(modificationTime.first);
+		}
+	}
+}
+
+void ShaderWatcher::watch(void)
+{
+	while (running)
+	{
+#ifdef __linux__
+		if (inotifyDescriptor >= 0)
+		{
+			pollfd descriptor = { inotifyDescriptor, POLLIN, 0 };
+
+			// The timeout only bounds how long stop() waits
+			if (poll(&descriptor, 1, 100) <= 0)
+			{
+				continue;
+			}
+
+			alignas(inotify_event) char buffer[4096];
+			auto length = read(inotifyDescriptor, buffer, sizeof(buffer));
+
+			std::lock_guard<std::mutex> lock(pathMutex);
+
+			for (ssize_t offset = 0; offset < length;)
+			{
+				auto event = (const inotify_event*)(buffer + offset);
+				offset += sizeof(inotify_event) + event->len;
+
+				auto directory = watchDescriptors.find(event->wd);
+
+				if (event->len == 0 || directory == watchDescriptors.end())
+				{
+					continue;
+				}
+
+				auto& files = watchedPaths[directory->second];
+				auto filePath = directory->second + "/" + event->name;
+
+				// Paths are matched the way they were registered, with or without the "./" of the current directory
+				if (files.find(filePath) != files.end())
+				{
+					pathChanged(filePath);
+				}
+				else if (directory->second == "." && files.find(event->name) != files.end())
+				{
+					pathChanged(event->name);
+				}
+			}
+
+			continue;
+		}
+#endif
+		pollModificationTimes();
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+// Watches shader source files from a background thread and collects the ones that changed. On Linux this uses inotify
+// on the containing directories, so editors that save by renaming a temporary file are caught too; elsewhere it falls
+// back to polling modification times. Nothing here touches GL, the changed paths are picked up on the GL thread
+class ShaderWatcher
+{
+private:
+	static ShaderWatcher* watcher;
+	std::thread thread;
+	std::atomic<bool> running;
+	std::mutex pathMutex;
+	// Watched file paths, grouped by directory
+	std::unordered_map<std::string, std::unordered_set<std::string>> watchedPaths;
+	std::unordered_map<std::string, long long> modificationTimes;
+	std::unordered_map<int, std::string> watchDescriptors;
+	std::unordered_set<std::string> changedPaths;
+	int inotifyDescriptor = -1;
+	ShaderWatcher();
+	~ShaderWatcher();
+	void watch(void);
+	void watchDirectory(const std::string& directory);
+	void pollModificationTimes(void);
+	void pathChanged(const std::string& filePath);
+	static std::string getDirectory(const std::string& filePath);
+	static long long getModificationTime(const std::string& filePath);
+public:
+	static ShaderWatcher* getInstance();
+	void start(void);
+	void stop(void);
+	void addPath(const std::string& filePath);
+	std::vector<std::string> takeChangedPaths(void);
+};
\ No newline at end of file
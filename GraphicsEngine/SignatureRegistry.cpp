@@ -0,0 +1,63 @@
+#pragma once
+#include "SignatureRegistry.h"
+
+// Function-local statics, since signatures can get interned from other static initializers
+std::unordered_map<std::string, SignatureID>& SignatureRegistry::getIDs()
+{
+	static std::unordered_map<std::string, SignatureID> ids;
+	return ids;
+}
+
+std::vector<std::string>& SignatureRegistry::getStrings()
+{
+	static std::vector<std::string> strings(1);
+	return strings;
+}
+
+SignatureID SignatureRegistry::getID(const std::string& signature)
+{
+	auto& ids = getIDs();
+	auto found = ids.find(signature);
+
+	if (found != ids.end())
+	{
+		return found->second;
+	}
+
+	auto& strings = getStrings();
+	SignatureID id = strings.size();
+	strings.push_back(signature);
+	ids[signature] = id;
+
+	return id;
+}
+
+SignatureID SignatureRegistry::findID(const std::string& signature)
+{
+	auto& ids = getIDs();
+	auto found = ids.find(signature);
+
+	if (found != ids.end())
+	{
+		return found->second;
+	}
+
+	return INVALID;
+}
+
+const std::string& SignatureRegistry::getSignature(SignatureID id)
+{
+	auto& strings = getStrings();
+
+	if (id >= strings.size())
+	{
+		return strings[INVALID];
+	}
+
+	return strings[id];
+}
+
+size_t SignatureRegistry::size(void)
+{
+	return getStrings().size() - 1;
+}
\ No newline at end of file
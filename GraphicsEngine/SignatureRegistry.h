@@ -0,0 +1,21 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+typedef unsigned int SignatureID;
+
+// Global interning table for signatures. Every distinct signature string maps to a compact, stable integer ID so that
+// decorator chains, pass graphs and program caches can be indexed by hash instead of compared string by string
+class SignatureRegistry
+{
+private:
+	static std::unordered_map<std::string, SignatureID>& getIDs();
+	static std::vector<std::string>& getStrings();
+public:
+	static const SignatureID INVALID = 0;
+	static SignatureID getID(const std::string& signature);
+	static SignatureID findID(const std::string& signature);
+	static const std::string& getSignature(SignatureID id);
+	static size_t size(void);
+};
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned int workerCount) : nextIndex(0)
+{
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	wakeCondition.notify_all();
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+unsigned int ThreadPool::getWorkerCount(void)
+{
+	return workers.size();
+}
+
+void ThreadPool::runJobs(void)
+{
+	for (size_t i = nextIndex++; i < jobCount; i = nextIndex++)
+	{
+		job(i);
+	}
+}
+
+void ThreadPool::workerLoop(void)
+{
+	unsigned long seenGeneration = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [this, seenGeneration]() { return stopping || generation != seenGeneration; });
+
+			if (stopping)
+			{
+				return;
+			}
+
+			seenGeneration = generation;
+		}
+
+		runJobs();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finishedWorkers++;
+		}
+
+		doneCondition.notify_all();
+	}
+}
+
+// Blocks until function has been called for every index in [0, count). Indices are handed out dynamically, so jobs of
+// uneven cost still balance across threads. Every worker checks in once per call, so none can still be touching the
+// previous job when the next one is published
+void ThreadPool::parallelFor(size_t count, std::function<void(size_t)> function)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	if (workers.empty() || count == 1)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			function(i);
+		}
+
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = function;
+		jobCount = count;
+		nextIndex = 0;
+		finishedWorkers = 0;
+		generation++;
+	}
+
+	wakeCondition.notify_all();
+
+	runJobs();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this]() { return finishedWorkers == workers.size(); });
+	job = nullptr;
+}
\ No newline at end of file
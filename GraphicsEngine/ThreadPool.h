@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+// Fixed set of worker threads for fork-join CPU work. The calling thread always takes part, so a pool with zero workers
+// simply runs everything inline
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+	std::function<void(size_t)> job;
+	std::atomic<size_t> nextIndex;
+	size_t jobCount = 0;
+	size_t finishedWorkers = 0;
+	unsigned long generation = 0;
+	bool stopping = false;
+	void workerLoop(void);
+	void runJobs(void);
+public:
+	ThreadPool(unsigned int workerCount);
+	~ThreadPool();
+	unsigned int getWorkerCount(void);
+	void parallelFor(size_t count, std::function<void(size_t)> function);
+};
\ No newline at end of file
@@ -6,7 +6,7 @@ class WindowContext
 public:
 	static WindowContext* context;
 	WindowContext() {};
-	~WindowContext() {};
+	virtual ~WindowContext() {};
 	virtual std::pair<int, int> getScreenResolution() = 0;
 	virtual std::pair<int, int> getSize() = 0;
 	virtual std::pair<int, int> getPos() = 0;